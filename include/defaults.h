@@ -20,6 +20,90 @@
 
 #define JSON_BUFFER_SIZE (12 * 1024)
 
+// /json responses: how many may be in flight, how long an encoded one is reused, and the largest one cached
+#define JSON_MAX_CONCURRENT 2
+#define JSON_CACHE_TTL_MS 1000
+#define JSON_CACHE_MAX_SIZE (8 * 1024)
+// /json responses smaller than this are sent uncompressed even when the client accepts gzip
+#define GZIP_MIN_SIZE 256
+
+// Most devices a sorted /json/devices page can reach (offset + limit)
+#define DEVICES_MAX_RANKED 200
+
+// Settings changed by commands are written once none changed for the delay, or once the oldest
+// change has waited the max
+#define SETTINGS_FLUSH_DELAY_MS 2000
+#define SETTINGS_FLUSH_MAX_WAIT_MS 10000
+
+// Device configs from mqtt are applied once none arrived for the quiet period, or when the oldest
+// staged one has waited the max, or once this many are staged
+#define CONFIG_BATCH_QUIET_MS 500
+#define CONFIG_BATCH_MAX_WAIT_MS 5000
+#define CONFIG_BATCH_MAX 100
+
+// Configs are considered replayed this long after subscribing if none are left to apply, even if none came
+#define CONFIG_REPLAY_WAIT_MS 5000
+
+// Device configs and irks are saved to flash this long after they last changed, to resolve aliases at boot
+#define CONFIG_SNAPSHOT_DELAY_MS 30000
+
+// A window with fewer adverts than this restarts the scan. Only if the controller also looks stuck (the
+// scan won't start, or the host lost sync) is the BLE stack reinitialized, and after that the node
+// rebooted, the last only once it has been up long enough
+#define BLE_LIVENESS_WINDOW_MS 30000
+#define BLE_LIVENESS_MIN_ADVERTS 1
+#ifndef ALLOW_BLE_CONTROLLER_RESTART_AFTER_SECS
+#define ALLOW_BLE_CONTROLLER_RESTART_AFTER_SECS 1800
+#endif
+
+// Fingerprints kept in RTC memory across a software restart, and the longest id kept with them
+#define WARM_RESTART_ENTRIES 48
+#define WARM_RESTART_ID_SIZE 40
+
+// Removed fingerprints remembered for /json/devices?since=
+#define DEVICE_TOMBSTONES 64
+
+// Web socket clients subscribed to device deltas, how often they get a batch, and the largest batch
+#define WS_MAX_SUBSCRIBERS 4
+#define WS_DELTA_INTERVAL_MS 1000
+#define WS_DELTA_BUFFER_SIZE (4 * 1024)
+
+// /events clients, events queued per client (oldest dropped when full), size of one event, and how many may sit in a client's socket
+#define EVENTS_MAX_CLIENTS 2
+#define EVENTS_QUEUE_DEPTH 16
+#define EVENTS_PAYLOAD_SIZE 160
+#define EVENTS_MAX_IN_FLIGHT 4
+
+// /ws/adverts inspector: clients, adverts waiting to be sent, size of one, and the longest filter
+#define INSPECT_MAX_CLIENTS 2
+#define INSPECT_QUEUE_DEPTH 8
+#define INSPECT_LINE_SIZE 256
+#define INSPECT_FILTER_SIZE 32
+
+// Sizes of the static buffers mqtt messages are serialized into
+#define REPORT_BUFFER_SIZE 512
+#define TELEMETRY_BUFFER_SIZE 768
+
+// Startup phases timed, and the buffer the breakdown is serialized into for mqtt and /json
+#define BOOT_PROFILE_PHASES 64
+#define BOOT_PROFILE_BUFFER_SIZE 3072
+#define DISCOVERY_BUFFER_SIZE 1024
+#define DISCOVERY_COMMON_BUFFER_SIZE 384
+
+// Fragmented mqtt messages being reassembled at once, and the largest one accepted
+#define MQTT_REASSEMBLY_SLOTS 2
+#define MQTT_REASSEMBLY_MAX_PAYLOAD 4096
+
+// Home Assistant discovery messages published per loop() iteration
+#define DISCOVERY_PUBLISHES_PER_LOOP 3
+
+// Outbox: entries held in RAM, size of one held report/event, and how much may spill to SPIFFS
+#define OUTBOX_RAM_ENTRIES 16
+#define OUTBOX_ID_SIZE 64
+#define OUTBOX_PAYLOAD_SIZE 320
+#define OUTBOX_FILE_MAX (16 * 1024)
+#define OUTBOX_REPLAY_INTERVAL_MS 50
+
 #define BLE_SCAN_INTERVAL 0x80
 #define BLE_SCAN_WINDOW 0x80
 
@@ -0,0 +1,22 @@
+#include "ChangeLog.h"
+
+#include <algorithm>
+
+void ChangeLog::remove(const String &id, const String &mac) {
+    if (tombstones.size() >= capacity && !tombstones.empty()) {
+        forgotten = tombstones.front().generation;
+        tombstones.erase(tombstones.begin());
+    }
+    tombstones.push_back({next(), id, mac});
+}
+
+bool ChangeLog::removedSince(uint32_t since) const {
+    return since >= forgotten && since <= generation;
+}
+
+bool ChangeLog::nextRemoved(uint32_t after, Removed &removed) const {
+    auto it = std::upper_bound(tombstones.begin(), tombstones.end(), after, [](uint32_t generation, const Removed &r) { return generation < r.generation; });
+    if (it == tombstones.end()) return false;
+    removed = *it;
+    return true;
+}
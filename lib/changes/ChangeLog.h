@@ -0,0 +1,37 @@
+#pragma once
+#include <Arduino.h>
+
+#include <atomic>
+#include <vector>
+
+// The generation pollers ask for changes since. Every change takes the next value, and every removal
+// also leaves a tombstone so a poller can drop what it had. Only the newest tombstones are kept; a
+// poller that is further behind than that has to start over.
+//
+// next() and current() can be called from anywhere. remove() and nextRemoved() need the owner's lock.
+class ChangeLog {
+   public:
+    struct Removed {
+        uint32_t generation;
+        String id, mac;
+    };
+
+    explicit ChangeLog(size_t capacity) : capacity(capacity) {}
+
+    uint32_t current() const { return generation; }
+    uint32_t next() { return ++generation; }
+
+    void remove(const String &id, const String &mac);
+    // False if removals after `since` were already forgotten, or `since` is from before a reboot. Checked
+    // again after the tombstones were read, as they can be forgotten meanwhile.
+    bool removedSince(uint32_t since) const;
+    // The first tombstone after the generation `after`, oldest first
+    bool nextRemoved(uint32_t after, Removed &removed) const;
+    size_t size() const { return tombstones.size(); }
+
+   private:
+    size_t capacity;
+    std::atomic<uint32_t> generation{0};
+    std::atomic<uint32_t> forgotten{0};  // Generation of the newest tombstone dropped
+    std::vector<Removed> tombstones;     // Oldest first
+};
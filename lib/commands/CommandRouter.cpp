@@ -0,0 +1,95 @@
+#include "CommandRouter.h"
+
+#include <vector>
+
+namespace CommandRouter {
+
+struct Route {
+    String command;
+    TCommandHandler handler;
+    bool republish;
+};
+
+static const uint8_t EMPTY = 0xFF;
+
+std::vector<Route> routes;
+std::vector<uint8_t> table;  // slot -> index into routes
+uint32_t seed = 0, mask = 0;
+bool dirty = true;
+
+static uint32_t hash(const char *s, size_t length, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < length; i++) {
+        h ^= (uint8_t)s[i];
+        h *= 16777619u;
+    }
+    // fmix32 so the low bits used for the slot depend on every character
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+void Register(const String &command, TCommandHandler handler, bool republish) {
+    for (auto &route : routes)
+        if (route.command == command) {
+            route.handler = handler;
+            route.republish = republish;
+            return;
+        }
+    if (routes.size() >= EMPTY) {
+        log_e("Too many commands, can't register %s", command.c_str());
+        return;
+    }
+    routes.push_back({command, handler, republish});
+    dirty = true;
+}
+
+// Searches for a seed that puts every command in its own slot, so a lookup is one hash and one compare
+void Build() {
+    dirty = false;
+    if (routes.empty()) {
+        table.clear();
+        return;
+    }
+
+    size_t size = 8;
+    while (size < routes.size() * 4) size <<= 1;
+    for (;; size <<= 1) {
+        for (uint32_t s = 1; s <= 1000; s++) {
+            table.assign(size, EMPTY);
+            bool collision = false;
+            for (size_t i = 0; i < routes.size() && !collision; i++) {
+                auto slot = hash(routes[i].command.c_str(), routes[i].command.length(), s) & (size - 1);
+                if (table[slot] != EMPTY)
+                    collision = true;
+                else
+                    table[slot] = i;
+            }
+            if (!collision) {
+                seed = s;
+                mask = size - 1;
+                return;
+            }
+        }
+    }
+}
+
+bool Dispatch(const char *command, size_t length, String &pay, bool *republish) {
+    if (dirty) Build();
+    if (table.empty()) return false;
+
+    auto i = table[hash(command, length, seed) & mask];
+    if (i == EMPTY) return false;
+
+    auto &route = routes[i];
+    if (route.command.length() != length || memcmp(route.command.c_str(), command, length) != 0) return false;
+
+    route.handler(pay);
+    if (republish) *republish = route.republish;
+    return true;
+}
+
+}  // namespace CommandRouter
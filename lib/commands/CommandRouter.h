@@ -0,0 +1,15 @@
+#pragma once
+#include <Arduino.h>
+
+#include <functional>
+
+namespace CommandRouter {
+
+typedef std::function<void(String &pay)> TCommandHandler;
+
+// republish: whether the node's retained state (online/discovery) needs to be sent again after the command
+void Register(const String &command, TCommandHandler handler, bool republish = true);
+void Build();
+bool Dispatch(const char *command, size_t length, String &pay, bool *republish = nullptr);
+
+}  // namespace CommandRouter
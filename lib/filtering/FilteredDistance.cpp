@@ -59,6 +59,15 @@ void FilteredDistance::addMeasurement(float dist) {
     }
 }
 
+void FilteredDistance::restore(const State &state) {
+    x = state.x;
+    dx = state.dx;
+    lastDist = state.lastDist;
+    readIndex = 0;
+    initSpike(state.mean);
+    lastTime = micros();
+}
+
 const float FilteredDistance::getDistance() const {
     return lastDist;
 }
@@ -8,6 +8,11 @@
 
 class FilteredDistance {
    public:
+    // Enough to carry the filter across a restart; the spike window comes back flat at its mean
+    struct State {
+        float x, dx, lastDist, mean;
+    };
+
     FilteredDistance(float minCutoff = 1.0f, float beta = 0.0f, float dcutoff = 1.0f);
     void addMeasurement(float dist);
     const float getMedianDistance() const;
@@ -16,6 +21,9 @@ class FilteredDistance {
 
     bool hasValue() const { return lastTime != 0; }
 
+    State save() const { return {x, dx, lastDist, total / static_cast<float>(NUM_READINGS)}; }
+    void restore(const State &state);
+
    private:
     float minCutoff;
     float beta;
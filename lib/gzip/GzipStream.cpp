@@ -0,0 +1,184 @@
+#include "GzipStream.h"
+
+#include <string.h>
+
+static const uint16_t lengthBase[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t lengthExtra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t distanceBase[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769};
+static const uint8_t distanceExtra[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8};
+
+static const uint32_t crcTable[16] = {0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+                                      0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t len) {
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ crcTable[crc & 15];
+        crc = (crc >> 4) ^ crcTable[crc & 15];
+    }
+    return ~crc;
+}
+
+GzipStream::GzipStream() {
+    memset(head, 0, sizeof(head));
+    static const uint8_t header[] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+    for (auto b : header) putByte(b);
+    putBits(0, 1);  // Not the final block
+    putBits(1, 2);  // Fixed Huffman codes
+}
+
+void GzipStream::putByte(uint8_t b) {
+    out[(outStart + outLen) % OUT] = b;
+    outLen++;
+}
+
+void GzipStream::putBits(uint32_t value, uint32_t count) {
+    bits |= value << bitCount;
+    bitCount += count;
+    while (bitCount >= 8) {
+        putByte(bits & 0xff);
+        bits >>= 8;
+        bitCount -= 8;
+    }
+}
+
+// Huffman codes are stored most significant bit first, everything else least significant bit first
+void GzipStream::putCode(uint32_t code, uint32_t length) {
+    uint32_t reversed = 0;
+    for (uint32_t i = 0; i < length; i++, code >>= 1) reversed = (reversed << 1) | (code & 1);
+    putBits(reversed, length);
+}
+
+static void fixedCode(uint32_t symbol, uint32_t &code, uint32_t &length) {
+    if (symbol < 144) {
+        code = 0x30 + symbol;
+        length = 8;
+    } else if (symbol < 256) {
+        code = 0x190 + symbol - 144;
+        length = 9;
+    } else if (symbol < 280) {
+        code = symbol - 256;
+        length = 7;
+    } else {
+        code = 0xc0 + symbol - 280;
+        length = 8;
+    }
+}
+
+void GzipStream::literal(uint8_t c) {
+    uint32_t code, length;
+    fixedCode(c, code, length);
+    putCode(code, length);
+}
+
+void GzipStream::match(size_t length, size_t distance) {
+    size_t l = 0;
+    while (l + 1 < sizeof(lengthBase) / sizeof(lengthBase[0]) && lengthBase[l + 1] <= length) l++;
+    uint32_t code, bitsLength;
+    fixedCode(257 + l, code, bitsLength);
+    putCode(code, bitsLength);
+    if (lengthExtra[l]) putBits(length - lengthBase[l], lengthExtra[l]);
+
+    size_t d = 0;
+    while (d + 1 < sizeof(distanceBase) / sizeof(distanceBase[0]) && distanceBase[d + 1] <= distance) d++;
+    putCode(d, 5);
+    if (distanceExtra[d]) putBits(distance - distanceBase[d], distanceExtra[d]);
+}
+
+static inline uint32_t hash(const uint8_t *p) {
+    return ((p[0] << 6) ^ (p[1] << 3) ^ p[2]) & ((1 << 9) - 1);
+}
+
+void GzipStream::insert(size_t p) {
+    head[hash(window + p)] = p + 1;
+}
+
+// Keeps the last WINDOW bytes before pos and makes room after them
+void GzipStream::slide() {
+    size_t shift = pos - WINDOW;
+    memmove(window, window + shift, end - shift);
+    pos -= shift;
+    end -= shift;
+    for (auto &h : head) h = h > shift ? h - shift : 0;
+}
+
+void GzipStream::deflate() {
+    // A symbol is at most 31 bits, so 8 bytes of room always fits one and whatever bits were left over
+    while (outFree() >= 8 && (finishing ? pos < end : end - pos >= MAX_MATCH)) {
+        size_t available = end - pos;
+        if (available < MIN_MATCH) {
+            literal(window[pos++]);
+            continue;
+        }
+
+        uint32_t h = hash(window + pos);
+        size_t best = 0, distance = 0;
+        if (head[h]) {
+            size_t candidate = head[h] - 1;
+            distance = pos - candidate;
+            if (distance > 0 && distance <= WINDOW) {
+                size_t max = available < MAX_MATCH ? available : MAX_MATCH;
+                while (best < max && window[candidate + best] == window[pos + best]) best++;
+            }
+        }
+        head[h] = pos + 1;
+
+        if (best >= MIN_MATCH) {
+            match(best, distance);
+            for (size_t i = 1; i < best && pos + i + MIN_MATCH <= end; i++) insert(pos + i);
+            pos += best;
+        } else
+            literal(window[pos++]);
+    }
+}
+
+size_t GzipStream::write(const uint8_t *data, size_t len) {
+    size_t taken = 0;
+    while (taken < len && !finishing) {
+        deflate();
+        if (end == BUFFER) {
+            if (pos <= WINDOW) break;  // Output is full, it has to be read first
+            slide();
+        }
+        size_t n = len - taken < BUFFER - end ? len - taken : BUFFER - end;
+        memcpy(window + end, data + taken, n);
+        crc = crc32(crc, data + taken, n);
+        end += n;
+        taken += n;
+        inTotal += n;
+    }
+    deflate();
+    return taken;
+}
+
+void GzipStream::finish() {
+    finishing = true;
+}
+
+size_t GzipStream::read(uint8_t *data, size_t max) {
+    size_t n = 0;
+    while (n < max) {
+        deflate();
+        if (finishing && pos == end && !trailerDone && outFree() >= 16) {
+            putCode(0, 7);  // End of block
+            putBits(1, 1);  // Final, empty block
+            putBits(1, 2);
+            putCode(0, 7);
+            if (bitCount) putBits(0, 8 - bitCount);
+            for (int i = 0; i < 4; i++) putByte(crc >> (8 * i));
+            for (int i = 0; i < 4; i++) putByte(inTotal >> (8 * i));
+            trailerDone = true;
+        }
+        if (!outLen) break;
+
+        size_t chunk = OUT - outStart < outLen ? OUT - outStart : outLen;
+        if (chunk > max - n) chunk = max - n;
+        memcpy(data + n, out + outStart, chunk);
+        outStart = (outStart + chunk) % OUT;
+        outLen -= chunk;
+        n += chunk;
+    }
+    outTotal += n;
+    return n;
+}
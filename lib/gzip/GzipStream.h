@@ -0,0 +1,52 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Gzip compressor for streaming responses with a fixed, small memory footprint: a 1 KB window,
+// greedy LZ77 matching on a single hash head per bucket and the fixed Huffman codes, so there
+// are no tables to build. Far from zlib's ratio on arbitrary data, but JSON with the same keys
+// in every row compresses well. About 3 KB per stream and nothing allocated after construction.
+class GzipStream {
+   public:
+    static const size_t WINDOW = 1024;
+
+    GzipStream();
+
+    // Takes as much input as fits, returns how much that was. Returns less than len when the
+    // output needs to be read first.
+    size_t write(const uint8_t *data, size_t len);
+    // No more input; the rest of the output (and the gzip trailer) becomes readable
+    void finish();
+    size_t read(uint8_t *data, size_t max);
+
+    // Everything has been written, finished and read
+    bool done() const { return finishing && pos == end && outLen == 0 && trailerDone; }
+
+    size_t totalIn() const { return inTotal; }
+    size_t totalOut() const { return outTotal; }
+
+   private:
+    static const size_t BUFFER = 2 * WINDOW;
+    static const size_t HASH_BITS = 9;
+    static const size_t OUT = 256;
+    static const size_t MIN_MATCH = 3, MAX_MATCH = 258;
+
+    uint8_t window[BUFFER];
+    uint16_t head[1 << HASH_BITS];  // position + 1 of the newest string with that hash, 0 = none
+    uint8_t out[OUT];
+    size_t pos = 0, end = 0, outStart = 0, outLen = 0;
+    uint32_t bits = 0, bitCount = 0;
+    uint32_t crc = 0;
+    size_t inTotal = 0, outTotal = 0;
+    bool finishing = false, trailerDone = false;
+
+    void deflate();
+    void slide();
+    void insert(size_t p);
+    void putBits(uint32_t value, uint32_t count);
+    void putByte(uint8_t b);
+    void putCode(uint32_t code, uint32_t length);
+    void literal(uint8_t c);
+    void match(size_t length, size_t distance);
+    size_t outFree() const { return OUT - outLen; }
+};
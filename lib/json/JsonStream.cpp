@@ -0,0 +1,19 @@
+#include "JsonStream.h"
+
+#include <string.h>
+
+size_t JsonStream::read(uint8_t *buffer, size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen) {
+        if (sent == length) {
+            sent = length = 0;
+            if (!next()) break;
+            continue;  // The piece may have been empty (an element that didn't fit)
+        }
+        auto n = maxLen - written < length - sent ? maxLen - written : length - sent;
+        memcpy(buffer + written, pending + sent, n);
+        sent += n;
+        written += n;
+    }
+    return written;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "JsonWriter.h"
+
+// A JSON document sent in pieces that are written one at a time into a single fixed buffer, so memory
+// use doesn't depend on how big the document gets. Subclasses produce the pieces in next().
+class JsonStream {
+   public:
+    explicit JsonStream(size_t capacity) : pending(new char[capacity]), capacity(capacity) {}
+    virtual ~JsonStream() { delete[] pending; }
+    JsonStream(const JsonStream &) = delete;
+    JsonStream &operator=(const JsonStream &) = delete;
+
+    // Copies out as much as fits, 0 once the document is complete
+    size_t read(uint8_t *buffer, size_t maxLen);
+
+   protected:
+    // Writes the next piece with piece() or element(), false when there is nothing left
+    virtual bool next() = 0;
+
+    // Anything but an array element: the document's start, keys, closing brackets
+    template <typename F>
+    bool piece(F write) {
+        JsonWriter doc(pending, capacity);
+        write(doc);
+        length = doc.overflowed() ? 0 : doc.length();
+        return !doc.overflowed();
+    }
+
+    // An array starts, the next element gets no separator
+    void beginElements() { first = true; }
+
+    // One array element. If it doesn't fit nothing is written, not even the separator, and it is false.
+    template <typename F>
+    bool element(F write) {
+        size_t offset = first ? 0 : 1;
+        pending[0] = ',';
+        JsonWriter doc(pending + offset, capacity - offset);
+        write(doc);
+        if (doc.overflowed()) {
+            length = 0;
+            return false;
+        }
+        length = offset + doc.length();
+        first = false;
+        return true;
+    }
+
+   private:
+    char *pending;
+    size_t capacity, length = 0, sent = 0;
+    bool first = true;
+};
@@ -0,0 +1,169 @@
+#include "JsonWriter.h"
+
+#include <cmath>
+#include <cstring>
+
+static constexpr char hexmap[] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
+
+JsonWriter::JsonWriter(char *buffer, size_t capacity) : buf(buffer), cap(capacity) {
+    reset();
+}
+
+void JsonWriter::reset() {
+    len = 0;
+    comma = false;
+    overflow = cap == 0;
+    if (cap) buf[0] = 0;
+}
+
+void JsonWriter::put(char c) {
+    if (overflow) return;
+    if (len + 1 >= cap) {
+        overflow = true;
+        return;
+    }
+    buf[len++] = c;
+    buf[len] = 0;
+}
+
+void JsonWriter::put(const char *s, size_t n) {
+    if (overflow) return;
+    if (len + n >= cap) {
+        overflow = true;
+        return;
+    }
+    memcpy(buf + len, s, n);
+    len += n;
+    buf[len] = 0;
+}
+
+void JsonWriter::putEscaped(const char *s) {
+    put('"');
+    for (; *s && !overflow; s++) {
+        auto c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            put('\\');
+            put((char)c);
+        } else if (c == '\n') {
+            put("\\n", 2);
+        } else if (c == '\r') {
+            put("\\r", 2);
+        } else if (c == '\t') {
+            put("\\t", 2);
+        } else if (c < 0x20) {
+            char u[6] = {'\\', 'u', '0', '0', hexmap[c >> 4], hexmap[c & 0x0F]};
+            put(u, sizeof(u));
+        } else {
+            put((char)c);
+        }
+    }
+    put('"');
+}
+
+void JsonWriter::putUInt(unsigned long long value, uint8_t minDigits) {
+    char digits[21];
+    uint8_t n = 0;
+    do {
+        digits[n++] = char('0' + value % 10);
+        value /= 10;
+    } while (value && n < sizeof(digits));
+    while (n < minDigits && n < sizeof(digits)) digits[n++] = '0';
+    while (n) put(digits[--n]);
+}
+
+void JsonWriter::key(const char *k) {
+    if (comma) put(',');
+    comma = true;
+    if (k) {
+        putEscaped(k);
+        put(':');
+    }
+}
+
+JsonWriter &JsonWriter::beginObject(const char *k) {
+    key(k);
+    put('{');
+    comma = false;
+    return *this;
+}
+
+JsonWriter &JsonWriter::endObject() {
+    put('}');
+    comma = true;
+    return *this;
+}
+
+JsonWriter &JsonWriter::beginArray(const char *k) {
+    key(k);
+    put('[');
+    comma = false;
+    return *this;
+}
+
+JsonWriter &JsonWriter::endArray() {
+    put(']');
+    comma = true;
+    return *this;
+}
+
+JsonWriter &JsonWriter::add(const char *k, const char *value) {
+    key(k);
+    if (value)
+        putEscaped(value);
+    else
+        put("null", 4);
+    return *this;
+}
+
+JsonWriter &JsonWriter::add(const char *k, bool value) {
+    key(k);
+    if (value)
+        put("true", 4);
+    else
+        put("false", 5);
+    return *this;
+}
+
+JsonWriter &JsonWriter::addInt(const char *k, long long value) {
+    key(k);
+    if (value < 0) {
+        put('-');
+        putUInt(0ULL - (unsigned long long)value);
+    } else
+        putUInt((unsigned long long)value);
+    return *this;
+}
+
+JsonWriter &JsonWriter::addUInt(const char *k, unsigned long long value) {
+    key(k);
+    putUInt(value);
+    return *this;
+}
+
+JsonWriter &JsonWriter::addFixed(const char *k, float value, uint8_t decimals) {
+    key(k);
+    if (!std::isfinite(value)) {
+        put("null", 4);
+        return *this;
+    }
+    if (decimals > 6) decimals = 6;
+    unsigned long long scale = 1;
+    for (uint8_t i = 0; i < decimals; i++) scale *= 10;
+    auto scaled = (long long)std::llround((double)value * (double)scale);
+    if (scaled < 0) {
+        put('-');
+        scaled = -scaled;
+    }
+    putUInt((unsigned long long)scaled / scale);
+    if (decimals) {
+        put('.');
+        putUInt((unsigned long long)scaled % scale, decimals);
+    }
+    return *this;
+}
+
+JsonWriter &JsonWriter::addRaw(const char *k, const char *json, size_t length) {
+    key(k);
+    put(json, length ? length : strlen(json));
+    return *this;
+}
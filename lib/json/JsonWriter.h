@@ -0,0 +1,53 @@
+#pragma once
+#include <Arduino.h>
+
+#include <type_traits>
+
+// Streams JSON straight into a caller provided buffer. No document, no String,
+// no heap: once the buffer is full every further write is dropped and
+// overflowed() reports it, so callers can simply skip the publish.
+class JsonWriter {
+   public:
+    JsonWriter(char *buffer, size_t capacity);
+
+    JsonWriter &beginObject(const char *key = nullptr);
+    JsonWriter &endObject();
+    JsonWriter &beginArray(const char *key = nullptr);
+    JsonWriter &endArray();
+
+    JsonWriter &add(const char *key, const char *value);
+    JsonWriter &add(const char *key, const String &value) { return add(key, value.c_str()); }
+    JsonWriter &add(const char *key, bool value);
+    template <typename T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
+    JsonWriter &add(const char *key, T value) {
+        if (std::is_signed<T>::value) return addInt(key, (long long)value);
+        return addUInt(key, (unsigned long long)value);
+    }
+
+    // Fixed-point number with exactly `decimals` digits after the point (like String(value, decimals))
+    JsonWriter &addFixed(const char *key, float value, uint8_t decimals = 2);
+    // Already encoded JSON (object, array, number...) copied verbatim
+    JsonWriter &addRaw(const char *key, const char *json, size_t length = 0);
+
+    // Array elements
+    JsonWriter &add(const char *value) { return add(nullptr, value); }
+    JsonWriter &add(const String &value) { return add(nullptr, value.c_str()); }
+
+    void reset();
+    bool overflowed() const { return overflow; }
+    size_t length() const { return len; }
+    const char *c_str() const { return buf; }
+
+   private:
+    char *buf;
+    size_t cap, len = 0;
+    bool comma = false, overflow = false;
+
+    JsonWriter &addInt(const char *key, long long value);
+    JsonWriter &addUInt(const char *key, unsigned long long value);
+    void key(const char *k);
+    void put(char c);
+    void put(const char *s, size_t n);
+    void putEscaped(const char *s);
+    void putUInt(unsigned long long value, uint8_t minDigits = 1);
+};
@@ -0,0 +1,105 @@
+#include "Metrics.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+Metric *Metric::firstMetric = nullptr;
+Metric *Metric::lastMetric = nullptr;
+
+// snprintf returns what it would have written, which is what tells us whether it fit
+static int fit(int n, size_t max) {
+    return n >= 0 && (size_t)n < max ? n : -1;
+}
+
+Metric::Metric(const char *name, const char *help, const char *type) : name(name), help(help), type(type) {
+    if (lastMetric)
+        lastMetric->nextMetric = this;
+    else
+        firstMetric = this;
+    lastMetric = this;
+}
+
+int Metric::header(size_t line, char *buffer, size_t max) const {
+    if (line == 0) return fit(snprintf(buffer, max, "# HELP %s %s\n", name, help), max);
+    if (line == 1) return fit(snprintf(buffer, max, "# TYPE %s %s\n", name, type), max);
+    return 0;
+}
+
+int Counter::line(size_t line, char *buffer, size_t max) const {
+    if (line < 2) return header(line, buffer, max);
+    if (line == 2) return fit(snprintf(buffer, max, "%s_total %" PRIu64 "\n", name, read()), max);
+    return 0;
+}
+
+int Gauge::line(size_t line, char *buffer, size_t max) const {
+    if (line < 2) return header(line, buffer, max);
+    if (line == 2) return fit(snprintf(buffer, max, "%s %" PRId64 "\n", name, read()), max);
+    return 0;
+}
+
+HistogramBase::HistogramBase(const char *name, const char *help, const char *label, const char *const *values, size_t series, const Bucket *buckets, size_t bucketCount, std::atomic<uint32_t> *counts, std::atomic<uint64_t> *sums)
+    : Metric(name, help, "histogram"), label(label), values(values), series(series), buckets(buckets), bucketCount(bucketCount), counts(counts), sums(sums) {
+}
+
+void HistogramBase::observe(size_t s, uint32_t micros) {
+    if (s >= series) return;
+    size_t b = 0;
+    while (b < bucketCount && micros > buckets[b].micros) b++;
+    counts[s * (bucketCount + 1) + b]++;
+    sums[s] += micros;
+}
+
+// Per series: one line per bucket, +Inf, _count and _sum
+int HistogramBase::line(size_t line, char *buffer, size_t max) const {
+    if (line < 2) return header(line, buffer, max);
+    size_t perSeries = bucketCount + 3;
+    size_t s = (line - 2) / perSeries, l = (line - 2) % perSeries;
+    if (s >= series) return 0;
+
+    auto c = counts + s * (bucketCount + 1);
+    uint64_t cumulative = 0;
+    for (size_t b = 0; b <= l && b <= bucketCount; b++) cumulative += c[b];
+
+    if (l < bucketCount)
+        return fit(snprintf(buffer, max, "%s_bucket{%s=\"%s\",le=\"%s\"} %" PRIu64 "\n", name, label, values[s], buckets[l].le, cumulative), max);
+    if (l == bucketCount)
+        return fit(snprintf(buffer, max, "%s_bucket{%s=\"%s\",le=\"+Inf\"} %" PRIu64 "\n", name, label, values[s], cumulative), max);
+    if (l == bucketCount + 1)
+        return fit(snprintf(buffer, max, "%s_count{%s=\"%s\"} %" PRIu64 "\n", name, label, values[s], cumulative), max);
+    uint64_t sum = sums[s];
+    return fit(snprintf(buffer, max, "%s_sum{%s=\"%s\"} %" PRIu64 ".%06" PRIu64 "\n", name, label, values[s], sum / 1000000, sum % 1000000), max);
+}
+
+bool MetricsRenderer::nextLine() {
+    while (metric) {
+        int n = metric->line(line++, pending, sizeof(pending));
+        if (n > 0) {
+            pendingLen = n;
+            return true;
+        }
+        if (n == 0) {  // No more lines in this metric; -1 (longer than pending) is skipped
+            metric = metric->next();
+            line = 0;
+        }
+    }
+    if (eof) return false;
+    eof = true;
+    pendingLen = snprintf(pending, sizeof(pending), "# EOF\n");
+    return true;
+}
+
+size_t MetricsRenderer::read(char *buffer, size_t max) {
+    size_t written = 0;
+    while (written < max) {
+        if (pendingSent == pendingLen) {
+            pendingSent = pendingLen = 0;
+            if (!nextLine()) break;
+        }
+        size_t n = pendingLen - pendingSent < max - written ? pendingLen - pendingSent : max - written;
+        memcpy(buffer + written, pending + pendingSent, n);
+        pendingSent += n;
+        written += n;
+    }
+    return written;
+}
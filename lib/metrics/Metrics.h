@@ -0,0 +1,105 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+// Registry of metrics rendered as OpenMetrics text. Metrics are static objects that link themselves
+// into a list when constructed and read their values through plain function pointers, so neither
+// registering nor rendering allocates.
+class Metric {
+   public:
+    Metric(const char *name, const char *help, const char *type);
+
+    // Writes line number `line` of this metric to buffer. Returns its length, 0 when there are no more
+    // lines and -1 when it does not fit in max.
+    virtual int line(size_t line, char *buffer, size_t max) const = 0;
+
+    const Metric *next() const { return nextMetric; }
+    static const Metric *first() { return firstMetric; }
+
+   protected:
+    const char *name;
+    const char *help;
+    const char *type;
+
+    // The # HELP and # TYPE lines; returns 0 for lines past them
+    int header(size_t line, char *buffer, size_t max) const;
+
+   private:
+    Metric *nextMetric = nullptr;
+    static Metric *firstMetric;
+    static Metric *lastMetric;
+};
+
+// Monotonic total, name without the _total suffix
+class Counter : public Metric {
+   public:
+    typedef uint64_t (*TRead)();
+    Counter(const char *name, const char *help, TRead read) : Metric(name, help, "counter"), read(read) {}
+    int line(size_t line, char *buffer, size_t max) const override;
+
+   private:
+    TRead read;
+};
+
+class Gauge : public Metric {
+   public:
+    typedef int64_t (*TRead)();
+    Gauge(const char *name, const char *help, TRead read) : Metric(name, help, "gauge"), read(read) {}
+    int line(size_t line, char *buffer, size_t max) const override;
+
+   private:
+    TRead read;
+};
+
+// Upper bound of a histogram bucket, le is how it is written out (in seconds)
+struct Bucket {
+    uint32_t micros;
+    const char *le;
+};
+
+// Durations in microseconds, one series per label value. Storage comes from Histogram below.
+class HistogramBase : public Metric {
+   public:
+    HistogramBase(const char *name, const char *help, const char *label, const char *const *values, size_t series, const Bucket *buckets, size_t bucketCount, std::atomic<uint32_t> *counts, std::atomic<uint64_t> *sums);
+    void observe(size_t series, uint32_t micros);
+    int line(size_t line, char *buffer, size_t max) const override;
+
+   private:
+    const char *label;
+    const char *const *values;
+    size_t series;
+    const Bucket *buckets;
+    size_t bucketCount;
+    std::atomic<uint32_t> *counts;  // [series][bucketCount + 1], the last one is +Inf
+    std::atomic<uint64_t> *sums;    // [series]
+};
+
+template <size_t Series, size_t Buckets>
+class Histogram : public HistogramBase {
+   public:
+    Histogram(const char *name, const char *help, const char *label, const char *const (&values)[Series], const Bucket (&buckets)[Buckets])
+        : HistogramBase(name, help, label, values, Series, buckets, Buckets, counts, sums) {}
+
+   private:
+    std::atomic<uint32_t> counts[Series * (Buckets + 1)] = {};
+    std::atomic<uint64_t> sums[Series] = {};
+};
+
+// Walks the registry a line at a time and picks up where it left off, so the text can be copied
+// into one response chunk after another, whatever their size
+class MetricsRenderer {
+   public:
+    // Returns 0 once everything, including the closing # EOF, has been written
+    size_t read(char *buffer, size_t max);
+
+   private:
+    const Metric *metric = Metric::first();
+    size_t line = 0;
+    bool eof = false;
+    char pending[160];
+    size_t pendingLen = 0, pendingSent = 0;
+
+    bool nextLine();
+};
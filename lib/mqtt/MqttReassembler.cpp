@@ -0,0 +1,78 @@
+#include "MqttReassembler.h"
+
+MqttReassembler::MqttReassembler(size_t count, size_t maxPayload, THandler handler) : slots(count), maxPayload(maxPayload), handler(handler) {
+}
+
+MqttReassembler::Slot *MqttReassembler::find(const char *topic, size_t total) {
+    for (auto &slot : slots)
+        if (slot.active && slot.total == total && slot.topic == topic) return &slot;
+    return nullptr;
+}
+
+// A free slot, or else the one that has been waiting longest for its next fragment
+MqttReassembler::Slot *MqttReassembler::claim() {
+    Slot *oldest = nullptr;
+    for (auto &slot : slots) {
+        if (!slot.active) return &slot;
+        if (!oldest || (long)(slot.touched - oldest->touched) < 0) oldest = &slot;
+    }
+    if (oldest) {
+        log_e("Dropped incomplete mqtt message on %s", oldest->topic.c_str());
+        droppedCount++;
+        oldest->active = false;
+    }
+    return oldest;
+}
+
+void MqttReassembler::onFragment(const char *topic, const char *payload, size_t len, size_t index, size_t total) {
+    // A new message on a topic replaces whatever half received one it had
+    if (index == 0)
+        for (auto &slot : slots)
+            if (slot.active && slot.topic == topic) slot.active = false;
+
+    if (index == 0 && len == total) {
+        handler(topic, payload, len);  // Not fragmented, nothing to copy
+        return;
+    }
+
+    if (total > maxPayload) {
+        if (index == 0) {
+            log_e("Dropped %u byte mqtt message on %s (max %u)", (unsigned)total, topic, (unsigned)maxPayload);
+            droppedCount++;
+        }
+        return;
+    }
+
+    Slot *slot;
+    if (index == 0) {
+        slot = claim();
+        if (!slot) return;
+        slot->topic = topic;
+        slot->total = total;
+        slot->active = true;
+        slot->buffer.clear();
+        slot->buffer.reserve(total + 1);
+    } else if (!(slot = find(topic, total)) || slot->buffer.size() != index) {
+        // Missed the start or a fragment in between; whatever we have is useless
+        if (slot) {
+            log_e("Dropped out of order mqtt message on %s", topic);
+            droppedCount++;
+            slot->active = false;
+        }
+        return;
+    }
+
+    if (index + len > total) {
+        slot->active = false;
+        droppedCount++;
+        return;
+    }
+
+    slot->touched = millis();
+    slot->buffer.insert(slot->buffer.end(), payload, payload + len);
+    if (slot->buffer.size() < total) return;
+
+    slot->active = false;
+    slot->buffer.push_back(0);
+    handler(slot->topic.c_str(), slot->buffer.data(), total);
+}
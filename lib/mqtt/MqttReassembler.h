@@ -0,0 +1,38 @@
+#pragma once
+#include <Arduino.h>
+
+#include <functional>
+#include <vector>
+
+// Puts fragmented mqtt payloads back together. Every topic being received gets its own slot,
+// so fragments of messages on different topics can arrive interleaved without mixing. A message
+// larger than the cap is dropped instead of reserving whatever size the broker announces, and
+// slot buffers keep their capacity so steady traffic doesn't allocate.
+class MqttReassembler {
+   public:
+    // payload is only valid during the call; it is NUL terminated unless it came in one fragment
+    typedef std::function<void(const char *topic, const char *payload, size_t length)> THandler;
+
+    MqttReassembler(size_t slots, size_t maxPayload, THandler handler);
+
+    void onFragment(const char *topic, const char *payload, size_t len, size_t index, size_t total);
+
+    unsigned int dropped() const { return droppedCount; }
+
+   private:
+    struct Slot {
+        String topic;
+        size_t total = 0;
+        bool active = false;
+        unsigned long touched = 0;
+        std::vector<char> buffer;
+    };
+
+    std::vector<Slot> slots;
+    size_t maxPayload;
+    THandler handler;
+    unsigned int droppedCount = 0;
+
+    Slot *find(const char *topic, size_t total);
+    Slot *claim();
+};
@@ -0,0 +1,34 @@
+#pragma once
+#include <rom/crc.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed size entries kept in memory that survives a software reset but holds garbage after power on
+// (RTC_NOINIT_ATTR). The magic, the entry size and a crc over the entries tell whether it was sealed
+// by a firmware with the same layout; the magic is written last, so a table cut off halfway is never taken.
+template <typename T, size_t N>
+struct RetainedTable {
+    uint32_t magic;
+    uint16_t count;
+    uint16_t entrySize;  // A firmware with a different layout ignores the table
+    uint32_t crc;
+    T entries[N];
+
+    // count is checked before the crc reads that many entries
+    bool valid(uint32_t expected) const {
+        return magic == expected && entrySize == sizeof(T) && count <= N && crc == checksum();
+    }
+
+    // Call before changing the entries
+    void open() { magic = 0; }
+
+    void seal(uint32_t sealMagic, uint16_t entries) {
+        count = entries;
+        entrySize = sizeof(T);
+        crc = checksum();
+        magic = sealMagic;
+    }
+
+   private:
+    uint32_t checksum() const { return crc32_le(0, (const uint8_t *)entries, count * sizeof(T)); }
+};
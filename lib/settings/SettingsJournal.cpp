@@ -0,0 +1,88 @@
+#include "SettingsJournal.h"
+
+#include <rom/crc.h>
+#include <string.h>
+
+void SettingsJournal::encode(const TChanges &changes, std::vector<uint8_t> &out) {
+    uint16_t count = changes.size();
+    out.insert(out.end(), (const uint8_t *)&count, (const uint8_t *)&count + 2);
+    for (auto &c : changes) {
+        out.push_back(c.first.length());
+        out.insert(out.end(), c.first.c_str(), c.first.c_str() + c.first.length());
+        uint16_t length = c.second.length();
+        out.insert(out.end(), (const uint8_t *)&length, (const uint8_t *)&length + 2);
+        out.insert(out.end(), c.second.c_str(), c.second.c_str() + length);
+    }
+    uint32_t crc = crc32_le(0, out.data(), out.size());
+    out.insert(out.end(), (const uint8_t *)&crc, (const uint8_t *)&crc + 4);
+}
+
+bool SettingsJournal::decode(const std::vector<uint8_t> &in, TChanges &changes) {
+    if (in.size() < 6) return false;
+    uint32_t crc;
+    memcpy(&crc, in.data() + in.size() - 4, 4);
+    if (crc != crc32_le(0, in.data(), in.size() - 4)) return false;
+
+    const uint8_t *p = in.data(), *end = in.data() + in.size() - 4;
+    uint16_t count;
+    memcpy(&count, p, 2);
+    p += 2;
+    for (uint16_t i = 0; i < count; i++) {
+        if (end - p < 1 || end - p < 1 + *p + 2) return false;
+        String fn;
+        for (size_t n = *p++; n > 0; n--) fn += (char)*p++;
+        uint16_t length;
+        memcpy(&length, p, 2);
+        p += 2;
+        if (end - p < length) return false;
+        String value;
+        value.reserve(length);
+        for (; length > 0; length--) value += (char)*p++;
+        changes[fn] = value;
+    }
+    return p == end;
+}
+
+bool SettingsJournal::unchanged(const String &fn, const String &value) {
+    std::vector<uint8_t> data;
+    return flash.read(fn, data) && data.size() == value.length() && memcmp(data.data(), value.c_str(), data.size()) == 0;
+}
+
+void SettingsJournal::apply(const TChanges &changes) {
+    for (auto &c : changes)
+        if (!flash.write(c.first, (const uint8_t *)c.second.c_str(), c.second.length())) log_e("Couldn't write setting %s", c.first.c_str());
+}
+
+size_t SettingsJournal::commit(TChanges &changes) {
+    for (auto it = changes.begin(); it != changes.end();) {
+        if (unchanged(it->first, it->second)) {
+            skippedCount++;
+            it = changes.erase(it);
+        } else
+            ++it;
+    }
+    if (changes.empty()) return 0;
+
+    // Even a single change goes through the journal: writing a file truncates it first, so a reset
+    // partway would leave neither the old value nor the new one
+    std::vector<uint8_t> record;
+    encode(changes, record);
+    if (!flash.write(path, record.data(), record.size())) log_e("Couldn't write settings journal");
+    apply(changes);
+    flash.remove(path);
+    return changes.size();
+}
+
+size_t SettingsJournal::recover() {
+    std::vector<uint8_t> record;
+    if (!flash.read(path, record)) return 0;
+
+    // A journal that didn't make it to flash whole was never committed, the files still hold the old values
+    TChanges changes;
+    if (decode(record, changes))
+        apply(changes);
+    else
+        changes.clear();
+    flash.remove(path);
+    return changes.size();
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <Arduino.h>
+
+#include <map>
+#include <vector>
+
+// The files settings and the journal live in: SPIFFS on the device, memory in the host tests
+class SettingsFlash {
+   public:
+    virtual ~SettingsFlash() {}
+    // False if there is no such file
+    virtual bool read(const String &fn, std::vector<uint8_t> &data) = 0;
+    // Replaces the file; false if it couldn't be written whole
+    virtual bool write(const String &fn, const uint8_t *data, size_t length) = 0;
+    virtual void remove(const String &fn) = 0;
+};
+
+// Writes settings so that a reset partway leaves either all of them or none changed, and none torn. They
+// go to one journal record with a crc first, then to their own files, then the journal is removed; recover()
+// finishes the files from a journal left behind, and ignores one that didn't make it to flash whole.
+class SettingsJournal {
+   public:
+    typedef std::map<String, String> TChanges;  // path, eg. "/skip_ms", and value
+
+    SettingsJournal(SettingsFlash &flash, const char *path) : flash(flash), path(path) {}
+
+    // Drops the changes flash already has and writes the rest, returns how many that were
+    size_t commit(TChanges &changes);
+    // Call before anything reads settings, returns how many were replayed
+    size_t recover();
+    unsigned int skipped() const { return skippedCount; }
+
+    // Record: u16 count, then per change a u8 path length, path, u16 value length, value; then a crc32
+    static void encode(const TChanges &changes, std::vector<uint8_t> &out);
+    static bool decode(const std::vector<uint8_t> &in, TChanges &changes);
+
+   private:
+    SettingsFlash &flash;
+    const char *path;
+    unsigned int skippedCount = 0;
+
+    bool unchanged(const String &fn, const String &value);
+    void apply(const TChanges &changes);
+};
@@ -0,0 +1,45 @@
+#include "PrefixMatcher.h"
+
+#include <algorithm>
+#include <string>
+
+PrefixMatcher::PrefixMatcher(const char *prefixes) {
+    std::vector<std::string> tokens;
+    for (const char *p = prefixes; *p;) {
+        const char *space = strchr(p, ' ');
+        size_t length = space ? space - p : strlen(p);
+        if (length) tokens.emplace_back(p, length);
+        p += length;
+        if (*p) p++;
+    }
+    std::sort(tokens.begin(), tokens.end());
+
+    // Sorted, a prefix comes right before everything it covers
+    size_t size = 0;
+    const std::string *last = nullptr;
+    std::vector<const std::string *> kept;
+    for (auto &t : tokens) {
+        if (last && t.compare(0, last->size(), *last) == 0) continue;
+        kept.push_back(&t);
+        size += t.size() + 1;
+        last = &t;
+    }
+
+    text.reserve(size);
+    entries.reserve(kept.size());
+    for (auto t : kept) {
+        entries.push_back({(uint16_t)text.size(), (uint16_t)t->size()});
+        text.insert(text.end(), t->begin(), t->end());
+        text.push_back(0);
+    }
+}
+
+bool PrefixMatcher::matches(const char *s) const {
+    if (entries.empty()) return false;
+    auto it = std::upper_bound(entries.begin(), entries.end(), s, [this](const char *s, const Entry &e) {
+        return strcmp(s, text.data() + e.offset) < 0;
+    });
+    if (it == entries.begin()) return false;
+    --it;
+    return strncmp(s, text.data() + it->offset, it->length) == 0;
+}
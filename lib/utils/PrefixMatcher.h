@@ -0,0 +1,24 @@
+#pragma once
+#include <Arduino.h>
+
+#include <vector>
+
+// A space separated list of prefixes compiled once for matching many times. Prefixes that another
+// prefix in the list already covers are dropped and the rest sorted, so the only candidate for a
+// string is the last prefix that sorts at or before it: one binary search and one comparison.
+class PrefixMatcher {
+   public:
+    PrefixMatcher() {}
+    explicit PrefixMatcher(const char *prefixes);
+
+    bool matches(const char *s) const;
+    bool matches(const String &s) const { return matches(s.c_str()); }
+    bool empty() const { return entries.empty(); }
+
+   private:
+    struct Entry {
+        uint16_t offset, length;
+    };
+    std::vector<char> text;  // Prefixes back to back, each nul terminated
+    std::vector<Entry> entries;
+};
@@ -0,0 +1,23 @@
+#pragma once
+#include <memory>
+
+// A read-mostly value that is replaced as a whole. get() hands out a shared_ptr, so a reader keeps
+// the value it got alive for as long as it holds on to it, however slow it is; the last one to let go
+// frees it. Both sides go through std::atomic_load/atomic_store, which only hold a lock for the time
+// it takes to copy the pointer, so any task can publish() and readers never wait on a writer.
+template <typename T>
+class Published {
+   public:
+    typedef std::shared_ptr<const T> Ptr;
+
+    explicit Published(const T *initial = nullptr) : current(initial) {}
+
+    Ptr get() const { return std::atomic_load(&current); }
+    // For one call: the temporary keeps the value alive until the end of the expression
+    Ptr operator->() const { return get(); }
+
+    void publish(const T *next) { std::atomic_store(&current, Ptr(next)); }
+
+   private:
+    Ptr current;
+};
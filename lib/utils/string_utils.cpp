@@ -115,24 +115,6 @@ bool hextostr(const String &hexStr, uint8_t* output, size_t len)
     return true;
 }
 
-bool prefixExists(const String &prefixes, const String &s)
-{
-    unsigned int start = 0;
-    unsigned int space;
-
-    while ((space = prefixes.indexOf(" ", start)) != -1)
-    {
-        if (space > start)
-        {
-            auto sub = prefixes.substring(start, space);
-            if (s.indexOf(sub) == 0) return true;
-        }
-        start = space + 1;
-    }
-    auto sub = prefixes.substring(start);
-    return !sub.isEmpty() && s.indexOf(sub) == 0;
-}
-
 bool spurt(const String &fn, const String &content)
 {
     File f = SPIFFS.open(fn, "w");
@@ -20,5 +20,4 @@ std::string hexStrRev(const uint8_t *data, int len);
 std::string hexStrRev(const char *data, int len);
 std::string hexStrRev(const std::string &s);
 bool hextostr(const String &hexStr, uint8_t* output, size_t len);
-bool prefixExists(const String &prefixes, const String &s);
 bool spurt(const String &fn, const String &content);
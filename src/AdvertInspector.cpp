@@ -0,0 +1,167 @@
+#include "AdvertInspector.h"
+
+#include <ArduinoJson.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "BleFingerprint.h"
+#include "BleFingerprintCollection.h"
+#include "JsonWriter.h"
+#include "defaults.h"
+
+namespace AdvertInspector {
+
+const TickType_t MAX_WAIT = portTICK_PERIOD_MS * 100;
+
+struct Watcher {
+    uint32_t client;
+    bool active;  // Has sent a filter
+    char filter[INSPECT_FILTER_SIZE];
+    uint16_t sample, skipped;
+};
+
+struct Line {
+    uint32_t client;
+    uint16_t length;
+    char data[INSPECT_LINE_SIZE];
+};
+
+AsyncWebSocket socket("/ws/adverts");
+Watcher watchers[INSPECT_MAX_CLIENTS];
+size_t watching = 0;
+std::atomic<bool> active{false};
+SemaphoreHandle_t inspectMutex;
+Line *queue = nullptr;
+size_t head = 0, count = 0;
+
+static void updateActive() {
+    bool any = false;
+    for (size_t i = 0; i < watching; i++) any |= watchers[i].active;
+    active = any;
+}
+
+static bool matches(const Watcher &w, const char *mac, const String &id) {
+    auto length = strlen(w.filter);
+    return !length || !strncasecmp(mac, w.filter, length) || !strncasecmp(id.c_str(), w.filter, length);
+}
+
+static size_t format(char *buffer, size_t size, BLEAdvertisedDevice *advert, const char *mac, const String &id) {
+    char hex[2 * 62 + 1];  // Advert plus scan response
+    auto payload = advert->getPayload();
+    size_t length = std::min(advert->getPayloadLength(), (size_t)62);
+    for (size_t i = 0; i < length; i++) snprintf(hex + 2 * i, 3, "%02x", payload[i]);
+    hex[2 * length] = 0;
+
+    JsonWriter doc(buffer, size);
+    doc.beginObject();
+    doc.add("mac", mac);
+    doc.add("rssi", advert->getRSSI());
+    doc.add("id", id);
+    doc.add("data", hex);
+    doc.endObject();
+    return doc.overflowed() ? 0 : doc.length();
+}
+
+static void capture(BLEAdvertisedDevice *advert, BleFingerprint *f) {
+    if (!active) return;
+    if (xSemaphoreTake(inspectMutex, 0) != pdTRUE) return;  // Never hold up the scan task
+
+    auto address = advert->getAddress();
+    auto native = address.getNative();
+    char mac[18];
+    snprintf(mac, sizeof(mac), "%02x:%02x:%02x:%02x:%02x:%02x", native[5], native[4], native[3], native[2], native[1], native[0]);
+    auto id = f->getId();
+
+    const Line *formatted = nullptr;
+    for (size_t i = 0; i < watching; i++) {
+        auto &w = watchers[i];
+        if (!w.active || !matches(w, mac, id)) continue;
+        if (++w.skipped < w.sample) continue;
+        w.skipped = 0;
+        if (count == INSPECT_QUEUE_DEPTH) break;  // Client isn't keeping up, skip this one
+
+        auto &line = queue[(head + count) % INSPECT_QUEUE_DEPTH];
+        if (formatted) {  // Same advert for another client
+            memcpy(line.data, formatted->data, formatted->length);
+            line.length = formatted->length;
+        } else {
+            line.length = format(line.data, sizeof(line.data), advert, mac, id);
+            if (!line.length) break;
+        }
+        line.client = w.client;
+        formatted = &line;
+        count++;
+    }
+    xSemaphoreGive(inspectMutex);
+}
+
+static Watcher *find(uint32_t client) {
+    for (size_t i = 0; i < watching; i++)
+        if (watchers[i].client == client) return &watchers[i];
+    return nullptr;
+}
+
+static void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len) {
+    if (type == WS_EVT_CONNECT) {
+        if (xSemaphoreTake(inspectMutex, MAX_WAIT) != pdTRUE) return;
+        bool full = watching == INSPECT_MAX_CLIENTS;
+        if (!full) watchers[watching++] = Watcher{client->id(), false, {0}, 1, 0};
+        xSemaphoreGive(inspectMutex);
+        if (full) client->close();
+    } else if (type == WS_EVT_DISCONNECT) {
+        if (xSemaphoreTake(inspectMutex, MAX_WAIT) != pdTRUE) return;
+        auto w = find(client->id());
+        if (w) *w = watchers[--watching];
+        updateActive();
+        xSemaphoreGive(inspectMutex);
+    } else if (type == WS_EVT_DATA) {
+        auto *info = static_cast<AwsFrameInfo *>(arg);
+        if (!info->final || info->index != 0 || info->len != len || info->opcode != WS_TEXT) return;
+        auto doc = DynamicJsonDocument(128);
+        auto error = deserializeJson(doc, data, len);
+        auto root = doc.as<JsonObject>();
+        if (error || root.isNull()) return;
+
+        if (xSemaphoreTake(inspectMutex, MAX_WAIT) != pdTRUE) return;
+        if (!queue) queue = new Line[INSPECT_QUEUE_DEPTH];
+        auto w = find(client->id());
+        if (w) {
+            strlcpy(w->filter, root["filter"] | "", sizeof(w->filter));
+            w->sample = std::max(1, std::min((int)(root["sample"] | 1), 65535));
+            w->skipped = 0;
+            w->active = !root["stop"].as<bool>();
+        }
+        updateActive();
+        xSemaphoreGive(inspectMutex);
+    }
+}
+
+void Setup() {
+    inspectMutex = xSemaphoreCreateMutex();
+    BleFingerprintCollection::onAdvert = capture;
+}
+
+void Init(AsyncWebServer *server) {
+    socket.onEvent(onEvent);
+    server->addHandler(&socket);
+}
+
+void Loop() {
+    socket.cleanupClients(INSPECT_MAX_CLIENTS);
+    if (!count) return;
+    if (xSemaphoreTake(inspectMutex, 0) != pdTRUE) return;
+    while (count) {
+        auto &line = queue[head];
+        auto client = socket.client(line.client);
+        if (client && client->status() == WS_CONNECTED) {
+            if (!client->canSend()) break;  // Try again next loop
+            client->text(line.data, line.length);
+        }
+        head = (head + 1) % INSPECT_QUEUE_DEPTH;
+        count--;
+    }
+    xSemaphoreGive(inspectMutex);
+}
+
+}  // namespace AdvertInspector
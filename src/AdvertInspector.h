@@ -0,0 +1,12 @@
+#pragma once
+#include <ESPAsyncWebServer.h>
+
+// Raw adverts at /ws/adverts for debugging a device without a VERBOSE build. A client sends
+// {"filter":"<mac or id prefix>","sample":N} and gets every Nth matching advert as
+// {"mac","rssi","id","data":"<hex payload>"}. Matching happens in the scan task before anything is
+// formatted, and the hook returns straight away while no client has set a filter.
+namespace AdvertInspector {
+void Setup();
+void Init(AsyncWebServer *server);
+void Loop();
+}  // namespace AdvertInspector
@@ -0,0 +1,40 @@
+#include "AssetHandler.h"
+
+const Asset *AssetHandler::find(const char *path) const {
+    size_t low = 0, high = count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        int c = strcmp(path, assets[mid].path);
+        if (c == 0) return &assets[mid];
+        if (c < 0)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+    return nullptr;
+}
+
+bool AssetHandler::canHandle(AsyncWebServerRequest *request) const {
+    return request->method() == HTTP_GET && find(request->url().c_str());
+}
+
+void AssetHandler::handleRequest(AsyncWebServerRequest *request) {
+    auto asset = find(request->url().c_str());
+    if (!asset) {
+        request->send(404);
+        return;
+    }
+
+    // The ETag is the same whether or not it came with a W/ prefix, so a substring match is enough
+    auto match = request->getHeader("If-None-Match");
+    AsyncWebServerResponse *response;
+    if (match && (match->value() == "*" || strstr(match->value().c_str(), asset->etag)))
+        response = request->beginResponse(304);
+    else {
+        response = request->beginResponse_P(200, asset->contentType, asset->data, asset->length);
+        if (asset->gzip) response->addHeader(F("Content-Encoding"), "gzip");
+    }
+    response->addHeader(F("ETag"), asset->etag);
+    response->addHeader(F("Cache-Control"), asset->immutable ? F("public, max-age=31536000, immutable") : F("no-cache"));
+    request->send(response);
+}
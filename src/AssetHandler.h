@@ -0,0 +1,30 @@
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// One entry of the generated web UI asset table (ui_routes.h), which is sorted by path
+struct Asset {
+    const char *path;
+    const char *contentType;
+    const uint8_t *data;
+    uint32_t length;
+    bool gzip;
+    bool immutable;    // Content-hashed file name, safe to cache forever
+    const char *etag;  // Quoted, derived from a hash of data
+};
+
+// Serves every web UI asset from one handler: binary search on the path, strong ETag with 304 on
+// If-None-Match, and Cache-Control immutable for hashed files.
+class AssetHandler : public AsyncWebHandler {
+   public:
+    AssetHandler(const Asset *assets, size_t count) : assets(assets), count(count) {}
+
+    bool canHandle(AsyncWebServerRequest *request) const override;
+    void handleRequest(AsyncWebServerRequest *request) override;
+
+   private:
+    const Asset *assets;
+    size_t count;
+
+    const Asset *find(const char *path) const;
+};
@@ -1,5 +1,7 @@
+#include "JsonWriter.h"
+
 namespace Battery {
 void Setup();
 bool SendDiscovery();
-void SendTelemetry();
+void SendTelemetry(JsonWriter &doc);
 }  // namespace Battery
@@ -7,6 +7,7 @@
 #include "rssi.h"
 #include "string_utils.h"
 #include "util.h"
+#include "WarmRestart.h"
 
 class ClientCallbacks : public BLEClientCallbacks {
     bool onConnParamsUpdateRequest(NimBLEClient *pClient, const ble_gap_upd_params *params) {
@@ -16,7 +17,11 @@ class ClientCallbacks : public BLEClientCallbacks {
 
 static ClientCallbacks clientCB;
 
+uint32_t BleFingerprint::lastSerial = 0;
+
 BleFingerprint::BleFingerprint(BLEAdvertisedDevice *advertisedDevice, float fcmin, float beta, float dcutoff) : filteredDistance{FilteredDistance(fcmin, beta, dcutoff)} {
+    serial = ++lastSerial;
+    version = BleFingerprintCollection::NextChangeGeneration();
     firstSeenMillis = millis();
     address = NimBLEAddress(advertisedDevice->getAddress());
     addressType = advertisedDevice->getAddressType();
@@ -34,9 +39,32 @@ void BleFingerprint::setInitial(const BleFingerprint &other) {
     filteredDistance = other.filteredDistance;
 }
 
+void BleFingerprint::saveWarm(WarmState &state) const {
+    memcpy(state.address, address.getNative(), 6);
+    state.addressType = addressType;
+    state.calRssi = calRssi;
+    state.idType = idType;
+    state.rssi = rssi;
+    strlcpy(state.id, id.c_str(), sizeof(state.id));
+    state.raw = raw;
+    state.dist = dist;
+    state.filter = filteredDistance.save();
+}
+
+void BleFingerprint::restoreWarm(const WarmState &state) {
+    rssi = state.rssi;
+    raw = state.raw;
+    dist = state.dist;
+    filteredDistance.restore(state.filter);
+    if (state.calRssi != NO_RSSI) calRssi = state.calRssi;
+    // Ids from configs and irks come back on their own; this keeps the ones a query found
+    if (state.idType < ID_TYPE_KNOWN_IRK) setId(state.id, state.idType);
+}
+
 bool BleFingerprint::shouldHide(const String &s) {
-    if (BleFingerprintCollection::include.length() > 0 && !prefixExists(BleFingerprintCollection::include, s)) return true;
-    return (BleFingerprintCollection::exclude.length() > 0 && prefixExists(BleFingerprintCollection::exclude, s));
+    auto include = BleFingerprintCollection::includeMatcher.get();
+    if (!include->empty() && !include->matches(s)) return true;
+    return BleFingerprintCollection::excludeMatcher->matches(s);
 }
 
 bool BleFingerprint::setId(const String &newId, short newIdType, const String &newName) {
@@ -47,21 +75,21 @@ bool BleFingerprint::setId(const String &newId, short newIdType, const String &n
     ignore = newIdType < 0;
     idType = newIdType;
 
-    DeviceConfig dc;
-    if (BleFingerprintCollection::FindDeviceConfig(newId, dc)) {
-        if (dc.calRssi != NO_RSSI)
-            calRssi = dc.calRssi;
-        if (!dc.alias.isEmpty())
-            return setId(dc.alias, ID_TYPE_ALIAS, dc.name);
-        if (!dc.name.isEmpty())
-            name = dc.name;
+    auto dc = BleFingerprintCollection::FindDeviceConfig(newId);
+    if (dc) {
+        if (dc->calRssi != NO_RSSI)
+            calRssi = dc->calRssi;
+        if (!dc->alias.isEmpty())
+            return setId(dc->alias, ID_TYPE_ALIAS, dc->name);
+        if (!dc->name.isEmpty())
+            name = dc->name;
     } else if (!newName.isEmpty() && name != newName)
         name = newName;
 
     if (id != newId) {
         bool newHidden = shouldHide(newId);
-        countable = !ignore && !hidden && !BleFingerprintCollection::countIds.isEmpty() && prefixExists(BleFingerprintCollection::countIds, newId);
-        bool newQuery = !ignore && !BleFingerprintCollection::query.isEmpty() && prefixExists(BleFingerprintCollection::query, newId);
+        countable = !ignore && !hidden && BleFingerprintCollection::countIdsMatcher->matches(newId);
+        bool newQuery = !ignore && BleFingerprintCollection::queryMatcher->matches(newId);
         if (newQuery != allowQuery) {
             allowQuery = newQuery;
             if (allowQuery) {
@@ -80,6 +108,7 @@ bool BleFingerprint::setId(const String &newId, short newIdType, const String &n
         added = false;
     }
 
+    version = BleFingerprintCollection::NextChangeGeneration();
     return true;
 }
 
@@ -171,7 +200,7 @@ bool ble_ll_resolv_rpa(const uint8_t *rpa, const uint8_t *irk) {
 
 void BleFingerprint::fingerprintAddress() {
     auto mac = getMac();
-    if (!BleFingerprintCollection::knownMacs.isEmpty() && prefixExists(BleFingerprintCollection::knownMacs, mac))
+    if (BleFingerprintCollection::knownMacsMatcher->matches(mac))
         setId("known:" + mac, ID_TYPE_KNOWN_MAC);
     else {
         switch (addressType) {
@@ -416,13 +445,17 @@ bool BleFingerprint::seen(BLEAdvertisedDevice *advertisedDevice) {
 
     fingerprint(advertisedDevice);
 
-    if (ignore || hidden) return false;
+    if (!ignore && !hidden) {
+        rssi = advertisedDevice->getRSSI();
+        raw = pow(10, float(get1mRssi() - rssi) / (10.0f * BleFingerprintCollection::absorption));
+        filteredDistance.addMeasurement(raw);
+        dist = filteredDistance.getDistance();
+        vari = filteredDistance.getVariance();
+    }
+    // Only once the fields changed, so a poller whose generation covers this change also got the new values
+    version = BleFingerprintCollection::NextChangeGeneration();
 
-    rssi = advertisedDevice->getRSSI();
-    raw = pow(10, float(get1mRssi() - rssi) / (10.0f * BleFingerprintCollection::absorption));
-    filteredDistance.addMeasurement(raw);
-    dist = filteredDistance.getDistance();
-    vari = filteredDistance.getVariance();
+    if (ignore || hidden) return false;
 
     if (!added) {
         added = true;
@@ -432,30 +465,30 @@ bool BleFingerprint::seen(BLEAdvertisedDevice *advertisedDevice) {
     return false;
 }
 
-bool BleFingerprint::fill(JsonObject *doc) {
-    (*doc)[F("mac")] = getMac();
-    (*doc)[F("id")] = id;
-    if (!name.isEmpty()) (*doc)[F("name")] = name;
-    if (idType) (*doc)[F("idType")] = idType;
+bool BleFingerprint::fill(JsonWriter *doc) {
+    doc->add("mac", getMac());
+    doc->add("id", id);
+    if (!name.isEmpty()) doc->add("name", name);
+    if (idType) doc->add("idType", idType);
 
-    (*doc)[F("rssi@1m")] = get1mRssi();
-    (*doc)[F("rssi")] = rssi;
+    doc->add("rssi@1m", get1mRssi());
+    doc->add("rssi", rssi);
 
-    if (isnormal(raw)) (*doc)[F("raw")] = serialized(String(raw, 2));
-    if (isnormal(dist)) (*doc)[F("distance")] = serialized(String(dist, 2));
-    if (isnormal(vari)) (*doc)[F("var")] = serialized(String(vari, 2));
-    if (close) (*doc)[F("close")] = true;
+    if (isnormal(raw)) doc->addFixed("raw", raw);
+    if (isnormal(dist)) doc->addFixed("distance", dist);
+    if (isnormal(vari)) doc->addFixed("var", vari);
+    if (close) doc->add("close", true);
 
-    (*doc)[F("int")] = (millis() - firstSeenMillis) / seenCount;
+    doc->add("int", (millis() - firstSeenMillis) / seenCount);
 
-    if (mv) (*doc)[F("mV")] = mv;
-    if (battery != 0xFF) (*doc)[F("batt")] = battery;
-    if (temp) (*doc)[F("temp")] = serialized(String(temp, 2));
-    if (humidity) (*doc)[F("rh")] = serialized(String(humidity, 2));
-    return true;
+    if (mv) doc->add("mV", mv);
+    if (battery != 0xFF) doc->add("batt", battery);
+    if (temp) doc->addFixed("temp", temp);
+    if (humidity) doc->addFixed("rh", humidity);
+    return !doc->overflowed();
 }
 
-bool BleFingerprint::report(JsonObject *doc) {
+bool BleFingerprint::report(JsonWriter *doc) {
     if (ignore || idType <= ID_TYPE_RAND_MAC || hidden) return false;
     if (reported) return false;
 
@@ -526,9 +559,11 @@ bool BleFingerprint::shouldCount() {
     if (!close && rssi > CLOSE_RSSI + BleFingerprintCollection::rxAdjRssi) {
         BleFingerprintCollection::Close(this, true);
         close = true;
+        version = BleFingerprintCollection::NextChangeGeneration();
     } else if (close && rssi < LEFT_RSSI + BleFingerprintCollection::rxAdjRssi) {
         BleFingerprintCollection::Close(this, false);
         close = false;
+        version = BleFingerprintCollection::NextChangeGeneration();
     }
 
     bool prevCounting = counting;
@@ -13,9 +13,12 @@
 #include "rssi.h"
 #include "string_utils.h"
 #include "FilteredDistance.h"
+#include "JsonWriter.h"
 
 #define NO_RSSI int8_t(-128)
 
+struct WarmState;
+
 #define ID_TYPE_TX_POW short(1)
 
 #define NO_ID_TYPE short(0)
@@ -66,14 +69,20 @@ class BleFingerprint {
 
     bool seen(BLEAdvertisedDevice *advertisedDevice);
 
-    bool fill(JsonObject *doc);
+    bool fill(JsonWriter *doc);
 
-    bool report(JsonObject *doc);
+    bool report(JsonWriter *doc);
 
     bool query();
 
     const String getId() const { return id; }
 
+    // Increases with every fingerprint created, so the collection is ordered by it
+    const uint32_t getSerial() const { return serial; }
+
+    // Collection change generation of the last time something fill() reports may have changed
+    const uint32_t getVersion() const { return version; }
+
     const String getName() const { return name; }
 
     void setName(const String &name) { this->name = name; }
@@ -82,6 +91,10 @@ class BleFingerprint {
 
     void setInitial(const BleFingerprint &other);
 
+    // Across a software restart, see WarmRestart
+    void saveWarm(WarmState &state) const;
+    void restoreWarm(const WarmState &state);
+
     const String getMac() const;
 
     const short getIdType() const { return idType; }
@@ -127,6 +140,7 @@ class BleFingerprint {
 
     bool added = false, close = false, reported = false, ignore = false, allowQuery = false, isQuerying = false, hidden = false, connectable = false, countable = false, counting = false;
     NimBLEAddress address;
+    uint32_t serial, version = 0;
     String id, name;
     short int idType = NO_ID_TYPE;
     int rssi = NO_RSSI;
@@ -140,6 +154,7 @@ class BleFingerprint {
     FilteredDistance filteredDistance;
     std::unique_ptr<QueryReport> queryReport = nullptr;
 
+    static uint32_t lastSerial;
     static bool shouldHide(const String &s);
     void fingerprint(NimBLEAdvertisedDevice *advertisedDevice);
     void fingerprintServiceAdvertisements(NimBLEAdvertisedDevice *advertisedDevice, size_t serviceAdvCount, bool haveTxPower, int8_t txPower);
@@ -1,9 +1,19 @@
 #include "BleFingerprintCollection.h"
 
+#include "CommandRouter.h"
+#include "Metrics.h"
+#include "SettingsStore.h"
+#include "WarmRestart.h"
 #include "defaults.h"
 #include <Arduino.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <set>
 #include <sstream>
 #include <HeadlessWiFiSettings.h>
+#include <SPIFFS.h>
+#include <rom/crc.h>
 
 namespace BleFingerprintCollection {
 // Public (externed)
@@ -13,6 +23,11 @@ String include{DEFAULT_INCLUDE},
        knownMacs{DEFAULT_KNOWN_MACS},
        knownIrks{DEFAULT_KNOWN_IRKS},
        countIds{DEFAULT_COUNT_IDS};
+Published<PrefixMatcher> includeMatcher{new PrefixMatcher(DEFAULT_INCLUDE)},
+    excludeMatcher{new PrefixMatcher(DEFAULT_EXCLUDE)},
+    queryMatcher{new PrefixMatcher(DEFAULT_QUERY)},
+    knownMacsMatcher{new PrefixMatcher(DEFAULT_KNOWN_MACS)},
+    countIdsMatcher{new PrefixMatcher(DEFAULT_COUNT_IDS)};
 float skipDistance = DEFAULT_SKIP_DISTANCE,
       maxDistance = DEFAULT_MAX_DISTANCE,
       absorption = DEFAULT_ABSORPTION,
@@ -25,7 +40,7 @@ int forgetMs = DEFAULT_FORGET_MS,
     skipMs = DEFAULT_SKIP_MS,
     countMs = DEFAULT_COUNT_MS,
     requeryMs = DEFAULT_REQUERY_MS;
-std::vector<DeviceConfig> deviceConfigs;
+Published<ConfigSnapshot> deviceConfigs{new ConfigSnapshot()};
 std::vector<uint8_t *> irks;
 std::vector<BleFingerprint *> fingerprints;
 TCallbackBool onSeen = nullptr;
@@ -35,17 +50,48 @@ TCallbackFingerprint onClose = nullptr;
 TCallbackFingerprint onLeft = nullptr;
 TCallbackFingerprint onCountAdd = nullptr;
 TCallbackFingerprint onCountDel = nullptr;
+TCallbackAdvert onAdvert = nullptr;
 
 // Private
 const TickType_t MAX_WAIT = portTICK_PERIOD_MS * 100;
 
 unsigned long lastCleanup = 0;
+std::atomic<uint32_t> generation{0};
+ChangeLog changes(DEVICE_TOMBSTONES);  // Tombstones are guarded by fingerprintMutex
+std::atomic<int> pins{0};
+std::vector<BleFingerprint *> retired;  // Forgotten while pinned, freed once no Pin is left
 SemaphoreHandle_t fingerprintMutex;
-SemaphoreHandle_t deviceConfigMutex;
+SemaphoreHandle_t deviceConfigMutex;  // Serializes writers, readers go through the snapshot
+
+// Configs arrive from mqtt one message at a time, hundreds of retained ones right after connecting;
+// they are held here and applied in batches from the scan task
+struct StagedConfig {
+    DeviceConfig config;
+    bool remove = false;
+};
+std::vector<StagedConfig> stagedConfigs;
+SemaphoreHandle_t stagedMutex;
+unsigned long firstStaged = 0, lastStaged = 0;
+unsigned long settledMillis = 0;
+volatile unsigned long subscribedMillis = 0;  // When the broker last acknowledged the config subscription
+unsigned long snapshotDirty = 0;  // When configs changed after the flash snapshot was saved, 0 = saved
+std::set<String> unconfirmed;     // Loaded from flash and not yet sent again by the broker
+
+// Sizes are read without the mutexes; a scrape can be a change behind
+Gauge fingerprintsMetric("espresense_fingerprints", "Fingerprints in the table", [] { return (int64_t)fingerprints.size(); });
+Gauge configsMetric("espresense_device_configs", "Device configs", [] { return (int64_t)deviceConfigs->size(); });
+Gauge irksMetric("espresense_irks", "Known identity resolving keys", [] { return (int64_t)irks.size(); });
+Gauge tombstonesMetric("espresense_fingerprint_tombstones", "Removed fingerprints remembered for delta requests", [] { return (int64_t)changes.size(); });
+Gauge configsSettledMetric("espresense_device_configs_settled_ms", "Milliseconds from boot until retained device configs stopped arriving, 0 until then", [] { return (int64_t)settledMillis; });
+Counter changesMetric("espresense_fingerprint_changes", "Fingerprint additions, updates and removals", [] { return (uint64_t)changes.current(); });
+
+static void loadSnapshot();
 
 void Setup() {
     fingerprintMutex = xSemaphoreCreateMutex();
     deviceConfigMutex = xSemaphoreCreateMutex();
+    stagedMutex = xSemaphoreCreateMutex();
+    loadSnapshot();
 }
 
 void Count(BleFingerprint *f, bool counting) {
@@ -71,86 +117,326 @@ void Seen(BLEAdvertisedDevice *advertisedDevice) {
     BleFingerprint *f = GetFingerprint(&copy);
     if (f->seen(&copy) && onAdd)
         onAdd(f);
+    if (onAdvert) onAdvert(&copy, f);
     if (onSeen) onSeen(false);
 }
 
-bool addOrReplace(DeviceConfig config) {
-    if (xSemaphoreTake(deviceConfigMutex, MAX_WAIT) != pdTRUE)
-        log_e("Couldn't take deviceConfigMutex in addOrReplace!");
+static uint32_t hashId(const char *s) {
+    uint32_t h = 2166136261u;
+    while (*s) h = (h ^ (uint8_t)*s++) * 16777619u;
+    return h;
+}
 
-    for (auto &it : deviceConfigs) {
-        if (it.id == config.id) {
-            it = config;
-            xSemaphoreGive(deviceConfigMutex);
-            return false;
-        }
+ConfigSnapshot::ConfigSnapshot(std::vector<DeviceConfig> &&list) : configs(std::move(list)) {
+    size_t size = 4;
+    while (size < 2 * configs.size()) size <<= 1;
+    mask = size - 1;
+    slots.assign(size, 0);
+    hashes.reserve(configs.size());
+    for (size_t i = 0; i < configs.size(); i++) {
+        auto h = hashId(configs[i].id.c_str());
+        hashes.push_back(h);
+        auto slot = h & mask;
+        while (slots[slot]) slot = (slot + 1) & mask;
+        slots[slot] = i + 1;
     }
-    deviceConfigs.push_back(config);
-    xSemaphoreGive(deviceConfigMutex);
+}
+
+const DeviceConfig *ConfigSnapshot::find(const String &id) const {
+    if (configs.empty()) return nullptr;
+    auto h = hashId(id.c_str());
+    for (auto slot = h & mask; slots[slot]; slot = (slot + 1) & mask) {
+        auto i = slots[slot] - 1;
+        if (hashes[i] == h && configs[i].id == id) return &configs[i];
+    }
+    return nullptr;
+}
+
+static bool addIrk(const char *hex) {
+    uint8_t irk[16];
+    if (!hextostr(hex, irk, 16)) return false;
+    for (auto existing : irks)
+        if (!memcmp(existing, irk, 16)) return false;
+    auto *copy = new uint8_t[16];
+    memcpy(copy, irk, 16);
+    irks.push_back(copy);
     return true;
 }
 
-bool removeConfig(const String &id) {
+// Folds a batch into one new snapshot, the last message for an id wins
+static void publishBatch(const std::vector<StagedConfig> &batch) {
     if (xSemaphoreTake(deviceConfigMutex, MAX_WAIT) != pdTRUE) {
-        log_e("Couldn't take deviceConfigMutex in removeConfig!");
-        return false;
+        log_e("Couldn't take deviceConfigMutex in publishBatch!");
+        return;
     }
 
-    auto it = std::remove_if(deviceConfigs.begin(), deviceConfigs.end(),
-        [&id](const DeviceConfig &config) { return config.id == id; });
+    auto configs = deviceConfigs->all();
+    std::vector<bool> keep(configs.size(), true);
+    std::map<String, size_t> index;
+    for (size_t i = 0; i < configs.size(); i++) index[configs[i].id] = i;
+
+    for (auto &s : batch) {
+        auto it = index.find(s.config.id);
+        if (it == index.end()) {
+            if (s.remove) continue;
+            index[s.config.id] = configs.size();
+            configs.push_back(s.config);
+            keep.push_back(true);
+        } else {
+            keep[it->second] = !s.remove;
+            if (!s.remove) configs[it->second] = s.config;
+        }
+        if (!s.remove && s.config.id.startsWith("irk:")) addIrk(s.config.id.c_str() + 4);
+    }
 
-    bool removed = it != deviceConfigs.end();
-    deviceConfigs.erase(it, deviceConfigs.end());
+    size_t kept = 0;
+    for (size_t i = 0; i < configs.size(); i++)
+        if (keep[i]) configs[kept++] = std::move(configs[i]);
+    configs.resize(kept);
+    deviceConfigs.publish(new ConfigSnapshot(std::move(configs)));
+    generation++;
 
     xSemaphoreGive(deviceConfigMutex);
-    return removed;
 }
 
-bool Config(String &id, String &json) {
-    if (json.isEmpty()) {
-        return removeConfig(id);
+// One pass over the table for the whole batch: fingerprints a config in it names take that config,
+// the rest are fingerprinted again in case a new irk now resolves them
+static size_t resolveBatch(const std::vector<StagedConfig> &batch) {
+    auto snapshot = deviceConfigs.get();
+    std::map<String, const DeviceConfig *> named;
+    for (auto &s : batch) {
+        auto config = s.remove ? nullptr : snapshot->find(s.config.id);
+        if (!config) continue;
+        named[config->id] = config;
+        if (!config->alias.isEmpty()) named[config->alias] = config;
     }
+    if (named.empty()) return 0;
 
-    DynamicJsonDocument doc(1024);
-    deserializeJson(doc, json);
+    if (xSemaphoreTake(fingerprintMutex, MAX_WAIT) != pdTRUE) {
+        log_e("Couldn't take fingerprintMutex in resolveBatch!");
+        return 0;
+    }
+    for (auto &f : fingerprints) {
+        auto it = named.find(f->getId());
+        if (it != named.end()) {
+            auto config = it->second;
+            f->setName(config->name);
+            f->setId(config->alias.length() > 0 ? config->alias : config->id, ID_TYPE_ALIAS, config->name);
+            if (config->calRssi != NO_RSSI)
+                f->set1mRssi(config->calRssi);
+        } else
+            f->fingerprintAddress();
+    }
+    auto count = fingerprints.size();
+    xSemaphoreGive(fingerprintMutex);
+    return count;
+}
+
+// Configs and irks as they were last applied, so a reboot can resolve aliases before mqtt is back:
+// magic, count, then per config id/alias/name (length prefixed) and calRssi, then the irks and a crc32
+static const char *snapshotFile = "/configs";
+static const uint32_t SNAPSHOT_MAGIC = 0x31474643;  // "CFG1"
 
-    DeviceConfig config = {};
-    config.id = id;
-    if (doc.containsKey("id")) {
-        auto alias = doc["id"].as<String>();
-        if (alias != id) config.alias = alias;
+static void putString(std::vector<uint8_t> &out, const String &s) {
+    auto len = std::min(s.length(), (unsigned int)255);
+    out.push_back(len);
+    out.insert(out.end(), s.c_str(), s.c_str() + len);
+}
+
+static bool getString(const uint8_t *&p, const uint8_t *end, String &s) {
+    if (p >= end || end - p < 1 + *p) return false;
+    size_t len = *p++;
+    s = String();
+    s.reserve(len);
+    for (size_t i = 0; i < len; i++) s += (char)p[i];
+    p += len;
+    return true;
+}
+
+static void saveSnapshot() {
+    auto snapshot = deviceConfigs.get();
+    std::vector<uint8_t> out;
+    out.reserve(8 + snapshot->size() * 48 + irks.size() * 16);
+    out.insert(out.end(), (const uint8_t *)&SNAPSHOT_MAGIC, (const uint8_t *)&SNAPSHOT_MAGIC + 4);
+    uint16_t count = snapshot->size();
+    out.insert(out.end(), (const uint8_t *)&count, (const uint8_t *)&count + 2);
+    for (auto &c : snapshot->all()) {
+        putString(out, c.id);
+        putString(out, c.alias);
+        putString(out, c.name);
+        out.push_back((uint8_t)c.calRssi);
     }
-    if (doc.containsKey("rssi@1m"))
-        config.calRssi = doc["rssi@1m"].as<int8_t>();
-    if (doc.containsKey("name"))
-        config.name = doc["name"].as<String>();
-    auto isNew = addOrReplace(config);
-
-    if (isNew) {
-        auto p = id.indexOf("irk:");
-        if (p == 0) {
-            auto irk_hex = id.substring(4);
-            auto *irk = new uint8_t[16];
-            if (!hextostr(irk_hex, irk, 16))
-                return false;
-            irks.push_back(irk);
-        }
+    uint16_t irkCount = irks.size();
+    out.insert(out.end(), (const uint8_t *)&irkCount, (const uint8_t *)&irkCount + 2);
+    for (auto irk : irks) out.insert(out.end(), irk, irk + 16);
+    uint32_t crc = crc32_le(0, out.data(), out.size());
+    out.insert(out.end(), (const uint8_t *)&crc, (const uint8_t *)&crc + 4);
+
+    // Written aside and renamed over. SPIFFS can't rename onto an existing file, so the old one goes first;
+    // a reset right then leaves only the new one under the temporary name, which loadSnapshot falls back to.
+    String temp = String(snapshotFile) + ".tmp";
+    auto file = SPIFFS.open(temp, FILE_WRITE);
+    bool ok = file && file.write(out.data(), out.size()) == out.size();
+    if (file) file.close();
+    if (!ok) {
+        log_e("Couldn't save device config snapshot");
+        SPIFFS.remove(temp);
+        return;
+    }
+    if (SPIFFS.exists(snapshotFile)) SPIFFS.remove(snapshotFile);
+    if (!SPIFFS.rename(temp, snapshotFile)) {
+        log_e("Couldn't rename device config snapshot, kept as %s", temp.c_str());
+        return;
     }
+    Serial.printf("Saved %u device configs and %u irks (%u bytes)\r\n", count, irkCount, out.size());
+}
 
-    for (auto &it : fingerprints) {
-        auto it_id = it->getId();
-        if (it_id == id || it_id == config.alias) {
-            it->setName(config.name);
-            it->setId(config.alias.length() > 0 ? config.alias : config.id, ID_TYPE_ALIAS, config.name);
-            if (config.calRssi != NO_RSSI)
-                it->set1mRssi(config.calRssi);
-        } else
-            it->fingerprintAddress();
+// Applies the snapshot in path if it is complete, nothing is changed otherwise
+static bool loadSnapshot(const String &path) {
+    if (!SPIFFS.exists(path)) return false;
+    auto file = SPIFFS.open(path, FILE_READ);
+    if (!file) return false;
+    std::vector<uint8_t> in(file.size());
+    bool read = file.read(in.data(), in.size()) == in.size();
+    file.close();
+
+    uint32_t magic, crc;
+    if (!read || in.size() < 10) return false;
+    memcpy(&magic, in.data(), 4);
+    memcpy(&crc, in.data() + in.size() - 4, 4);
+    if (magic != SNAPSHOT_MAGIC || crc != crc32_le(0, in.data(), in.size() - 4)) {
+        log_e("Ignoring corrupt device config snapshot %s", path.c_str());
+        return false;
     }
 
+    const uint8_t *p = in.data() + 4, *end = in.data() + in.size() - 4;
+    uint16_t count;
+    memcpy(&count, p, 2);
+    p += 2;
+    std::vector<DeviceConfig> configs(count);
+    for (auto &c : configs) {
+        if (!getString(p, end, c.id) || !getString(p, end, c.alias) || !getString(p, end, c.name) || p >= end) return false;
+        c.calRssi = (int8_t)*p++;
+    }
+    uint16_t irkCount;
+    if (end - p < 2) return false;
+    memcpy(&irkCount, p, 2);
+    p += 2;
+    if (end - p != irkCount * 16) return false;
+
+    for (auto &c : configs) unconfirmed.insert(c.id);
+    for (; p < end; p += 16) {
+        auto *irk = new uint8_t[16];
+        memcpy(irk, p, 16);
+        irks.push_back(irk);
+    }
+    deviceConfigs.publish(new ConfigSnapshot(std::move(configs)));
+    generation++;
+    Serial.printf("Loaded %u device configs and %u irks from flash\r\n", count, irkCount);
     return true;
 }
 
+static void loadSnapshot() {
+    String temp = String(snapshotFile) + ".tmp";
+    if (loadSnapshot(snapshotFile)) {
+        if (SPIFFS.exists(temp)) SPIFFS.remove(temp);  // From a save that didn't get to write it all
+        return;
+    }
+    // The previous save was reset between removing the old snapshot and the rename
+    if (!loadSnapshot(temp)) return;
+    if (SPIFFS.exists(snapshotFile)) SPIFFS.remove(snapshotFile);
+    if (SPIFFS.rename(temp, snapshotFile)) Serial.println("Recovered device config snapshot");
+}
+
+bool Config(String &id, String &json) {
+    StagedConfig staged;
+    staged.config.id = id;
+    staged.remove = json.isEmpty();
+    if (!staged.remove) {
+        StaticJsonDocument<384> doc;
+        if (deserializeJson(doc, json)) return false;
+        if (doc.containsKey("id")) {
+            auto alias = doc["id"].as<String>();
+            if (alias != id) staged.config.alias = alias;
+        }
+        if (doc.containsKey("rssi@1m"))
+            staged.config.calRssi = doc["rssi@1m"].as<int8_t>();
+        if (doc.containsKey("name"))
+            staged.config.name = doc["name"].as<String>();
+    }
+
+    if (xSemaphoreTake(stagedMutex, MAX_WAIT) != pdTRUE) {
+        log_e("Couldn't take stagedMutex in Config!");
+        return false;
+    }
+    if (stagedConfigs.empty()) firstStaged = millis();
+    lastStaged = millis();
+    stagedConfigs.push_back(staged);
+    xSemaphoreGive(stagedMutex);
+    return true;
+}
+
+// Retained configs stopped arriving: whatever came from flash but not from the broker was deleted while we were away
+static void settle() {
+    settledMillis = millis();
+    Serial.printf("Device configs settled %lums after boot\r\n", settledMillis);
+    if (unconfirmed.empty()) return;
+
+    std::vector<StagedConfig> removals(unconfirmed.size());
+    auto it = unconfirmed.begin();
+    for (auto &r : removals) {
+        r.config.id = *it++;
+        r.remove = true;
+    }
+    unconfirmed.clear();
+    publishBatch(removals);
+    Serial.printf("Dropped %u device configs no longer retained\r\n", removals.size());
+    snapshotDirty = millis();
+}
+
+void Loop() {
+    if (snapshotDirty && millis() - snapshotDirty >= CONFIG_SNAPSHOT_DELAY_MS) {
+        snapshotDirty = 0;
+        saveSnapshot();
+    }
+
+    if (xSemaphoreTake(stagedMutex, 0) != pdTRUE) return;
+    auto now = millis();
+    bool quiet = now - lastStaged >= CONFIG_BATCH_QUIET_MS;
+    bool due = !stagedConfigs.empty() && (quiet || now - firstStaged >= CONFIG_BATCH_MAX_WAIT_MS || stagedConfigs.size() >= CONFIG_BATCH_MAX);
+    // Subscribed a while ago and nothing is left to apply: the broker retains no configs, or the last
+    // batch was cut by size and no quiet batch followed
+    auto subscribed = subscribedMillis;
+    bool replayed = !settledMillis && subscribed && stagedConfigs.empty() && now - subscribed >= CONFIG_REPLAY_WAIT_MS && now - lastStaged >= CONFIG_REPLAY_WAIT_MS;
+    std::vector<StagedConfig> batch;
+    if (due) batch.swap(stagedConfigs);
+    xSemaphoreGive(stagedMutex);
+    if (replayed) settle();
+    if (!due) return;
+
+    auto started = millis();
+    for (auto &s : batch) unconfirmed.erase(s.config.id);
+    publishBatch(batch);
+    auto resolved = resolveBatch(batch);
+    Serial.printf("Applied %u device configs, %u fingerprints resolved again in %lums\r\n", batch.size(), resolved, millis() - started);
+
+    // The first quiet gap is when the broker has finished replaying retained configs
+    if (quiet && !settledMillis) settle();
+    snapshotDirty = millis();
+}
+
+void ConfigsSubscribed() {
+    subscribedMillis = millis();
+}
+
+unsigned long ConfigsSettledMillis() {
+    return settledMillis;
+}
+
+static void compile(Published<PrefixMatcher> &matcher, const String &prefixes) {
+    matcher.publish(new PrefixMatcher(prefixes.c_str()));
+}
+
 void ConnectToWifi() {
     knownMacs = HeadlessWiFiSettings.string("known_macs", DEFAULT_KNOWN_MACS, "Known BLE mac addresses (no colons, space seperated)");
     knownIrks = HeadlessWiFiSettings.string("known_irks", DEFAULT_KNOWN_IRKS, "Known BLE identity resolving keys, should be 32 hex chars space seperated");
@@ -175,59 +461,92 @@ void ConnectToWifi() {
     forgetMs = HeadlessWiFiSettings.integer("forget_ms", 0, 3000000, DEFAULT_FORGET_MS, "Forget beacon if not seen for (in milliseconds)");
     txRefRssi = HeadlessWiFiSettings.integer("tx_ref_rssi", -100, 100, DEFAULT_TX_REF_RSSI, "Rssi expected from this tx power at 1m (used for node iBeacon)");
 
+    compile(knownMacsMatcher, knownMacs);
+    compile(queryMatcher, query);
+    compile(countIdsMatcher, countIds);
+    compile(includeMatcher, include);
+    compile(excludeMatcher, exclude);
+
     std::istringstream iss(knownIrks.c_str());
     std::string irk_hex;
-    while (iss >> irk_hex) {
-        auto *irk = new uint8_t[16];
-        if (!hextostr(irk_hex.c_str(), irk, 16))
-            continue;
-        irks.push_back(irk);
-    }
-}
-
-bool Command(String &command, String &pay) {
-    if (command == "skip_ms") {
-        BleFingerprintCollection::skipMs = pay.isEmpty() ? DEFAULT_SKIP_MS : pay.toInt();
-        spurt("/skip_ms", String(skipMs));
-    } else if (command == "skip_distance") {
-        BleFingerprintCollection::skipDistance = pay.isEmpty() ? DEFAULT_SKIP_DISTANCE : pay.toFloat();
-        spurt("/skip_dist", String(skipDistance));
-    } else if (command == "max_distance") {
+    while (iss >> irk_hex) addIrk(irk_hex.c_str());
+
+    // Irks are read by the scan task without a lock, so known_irks still needs a restart
+    SettingsStore::Watch("known_macs", [](const String &v) { compile(knownMacsMatcher, knownMacs = v.isEmpty() ? DEFAULT_KNOWN_MACS : v); });
+    SettingsStore::Watch("query", [](const String &v) { compile(queryMatcher, query = v.isEmpty() ? DEFAULT_QUERY : v); });
+    SettingsStore::Watch("requery_ms", [](const String &v) { requeryMs = (v.isEmpty() ? DEFAULT_REQUERY_MS / 1000 : v.toInt()) * 1000; });
+    SettingsStore::Watch("count_ids", [](const String &v) { compile(countIdsMatcher, countIds = v.isEmpty() ? DEFAULT_COUNT_IDS : v); });
+    SettingsStore::Watch("count_enter", [](const String &v) { countEnter = v.isEmpty() ? DEFAULT_COUNT_ENTER : v.toFloat(); });
+    SettingsStore::Watch("count_exit", [](const String &v) { countExit = v.isEmpty() ? DEFAULT_COUNT_EXIT : v.toFloat(); });
+    SettingsStore::Watch("count_ms", [](const String &v) { countMs = v.isEmpty() ? DEFAULT_COUNT_MS : v.toInt(); });
+    SettingsStore::Watch("include", [](const String &v) { compile(includeMatcher, include = v.isEmpty() ? DEFAULT_INCLUDE : v); });
+    SettingsStore::Watch("exclude", [](const String &v) { compile(excludeMatcher, exclude = v.isEmpty() ? DEFAULT_EXCLUDE : v); });
+    SettingsStore::Watch("max_dist", [](const String &v) { maxDistance = v.isEmpty() ? DEFAULT_MAX_DISTANCE : v.toFloat(); });
+    SettingsStore::Watch("skip_dist", [](const String &v) { skipDistance = v.isEmpty() ? DEFAULT_SKIP_DISTANCE : v.toFloat(); });
+    SettingsStore::Watch("skip_ms", [](const String &v) { skipMs = v.isEmpty() ? DEFAULT_SKIP_MS : v.toInt(); });
+    SettingsStore::Watch("ref_rssi", [](const String &v) { rxRefRssi = v.isEmpty() ? DEFAULT_RX_REF_RSSI : (int8_t)v.toInt(); });
+    SettingsStore::Watch("rx_adj_rssi", [](const String &v) { rxAdjRssi = v.isEmpty() ? DEFAULT_RX_ADJ_RSSI : (int8_t)v.toInt(); });
+    SettingsStore::Watch("absorption", [](const String &v) { absorption = v.isEmpty() ? DEFAULT_ABSORPTION : v.toFloat(); });
+    SettingsStore::Watch("forget_ms", [](const String &v) { forgetMs = v.isEmpty() ? DEFAULT_FORGET_MS : v.toInt(); });
+    SettingsStore::Watch("tx_ref_rssi", [](const String &v) { txRefRssi = v.isEmpty() ? DEFAULT_TX_REF_RSSI : (int8_t)v.toInt(); });
+
+    CommandRouter::Register("skip_ms", [](String &pay) {
+        skipMs = pay.isEmpty() ? DEFAULT_SKIP_MS : pay.toInt();
+        SettingsStore::Put("/skip_ms", String(skipMs));
+    });
+    CommandRouter::Register("skip_distance", [](String &pay) {
+        skipDistance = pay.isEmpty() ? DEFAULT_SKIP_DISTANCE : pay.toFloat();
+        SettingsStore::Put("/skip_dist", String(skipDistance));
+    });
+    CommandRouter::Register("max_distance", [](String &pay) {
         maxDistance = pay.isEmpty() ? DEFAULT_MAX_DISTANCE : pay.toFloat();
-        spurt("/max_dist", String(maxDistance));
-    } else if (command == "absorption") {
+        SettingsStore::Put("/max_dist", String(maxDistance));
+    });
+    CommandRouter::Register("absorption", [](String &pay) {
         absorption = pay.isEmpty() ? DEFAULT_ABSORPTION : pay.toFloat();
-        spurt("/absorption", String(absorption));
-    } else if (command == "rx_adj_rssi") {
+        SettingsStore::Put("/absorption", String(absorption));
+    });
+    CommandRouter::Register("rx_adj_rssi", [](String &pay) {
         rxAdjRssi = pay.isEmpty() ? DEFAULT_RX_ADJ_RSSI : (int8_t)pay.toInt();
-        spurt("/rx_adj_rssi", String(rxAdjRssi));
-    } else if (command == "ref_rssi") {
+        SettingsStore::Put("/rx_adj_rssi", String(rxAdjRssi));
+    });
+    CommandRouter::Register("ref_rssi", [](String &pay) {
         rxRefRssi = pay.isEmpty() ? DEFAULT_RX_REF_RSSI : (int8_t)pay.toInt();
-        spurt("/ref_rssi", String(rxRefRssi));
-    } else if (command == "tx_ref_rssi") {
+        SettingsStore::Put("/ref_rssi", String(rxRefRssi));
+    });
+    CommandRouter::Register("tx_ref_rssi", [](String &pay) {
         txRefRssi = pay.isEmpty() ? DEFAULT_TX_REF_RSSI : (int8_t)pay.toInt();
-        spurt("/tx_ref_rssi", String(txRefRssi));
-    } else if (command == "query") {
+        SettingsStore::Put("/tx_ref_rssi", String(txRefRssi));
+    });
+    CommandRouter::Register("query", [](String &pay) {
         query = pay.isEmpty() ? DEFAULT_QUERY : pay;
-        spurt("/query", query);
-    } else if (command == "include") {
+        SettingsStore::Put("/query", query);
+        compile(queryMatcher, query);
+    });
+    CommandRouter::Register("include", [](String &pay) {
         include = pay.isEmpty() ? DEFAULT_INCLUDE : pay;
-        spurt("/include", include);
-    } else if (command == "exclude") {
+        SettingsStore::Put("/include", include);
+        compile(includeMatcher, include);
+    });
+    CommandRouter::Register("exclude", [](String &pay) {
         exclude = pay.isEmpty() ? DEFAULT_EXCLUDE : pay;
-        spurt("/exclude", exclude);
-    } else if (command == "known_macs") {
+        SettingsStore::Put("/exclude", exclude);
+        compile(excludeMatcher, exclude);
+    });
+    CommandRouter::Register("known_macs", [](String &pay) {
         knownMacs = pay.isEmpty() ? DEFAULT_KNOWN_MACS : pay;
-        spurt("/known_macs", knownMacs);
-    } else if (command == "known_irks") {
+        SettingsStore::Put("/known_macs", knownMacs);
+        compile(knownMacsMatcher, knownMacs);
+    });
+    CommandRouter::Register("known_irks", [](String &pay) {
         knownIrks = pay.isEmpty() ? DEFAULT_KNOWN_IRKS : pay;
-        spurt("/known_irks", knownIrks);
-    } else if (command == "count_ids") {
+        SettingsStore::Put("/known_irks", knownIrks);
+    });
+    CommandRouter::Register("count_ids", [](String &pay) {
         countIds = pay.isEmpty() ? DEFAULT_COUNT_IDS : pay;
-        spurt("/count_ids", countIds);
-    } else
-        return false;
-    return true;
+        SettingsStore::Put("/count_ids", countIds);
+        compile(countIdsMatcher, countIds);
+    });
 }
 
 void CleanupOldFingerprints() {
@@ -235,25 +554,35 @@ void CleanupOldFingerprints() {
     if (now - lastCleanup < 5000) return;
     lastCleanup = now;
     auto it = fingerprints.begin();
-    bool any = false;
     while (it != fingerprints.end()) {
         auto age = (*it)->getMsSinceLastSeen();
         if (age > forgetMs) {
             if (onDel) onDel((*it));
-            delete *it;
+            changes.remove((*it)->getId(), (*it)->getMac());
+            retired.push_back(*it);
             it = fingerprints.erase(it);
-        } else {
-            any = true;
+            generation++;
+        } else
             ++it;
-        }
-    }
-    if (!any) {
-        auto uptime = (unsigned long)(esp_timer_get_time() / 1000000ULL);
-        if (uptime > ALLOW_BLE_CONTROLLER_RESTART_AFTER_SECS) {
-            Serial.println("Bluetooth controller seems stuck, restarting");
-            ESP.restart();
-        }
     }
+    // Under the lock, so a reader pinning now can't have found any of them yet
+    if (pins || retired.empty()) return;
+    for (auto f : retired) delete f;
+    retired.clear();
+}
+
+Pin::Pin() {
+    pins++;
+}
+
+Pin::~Pin() {
+    pins--;
+}
+
+void Cleanup() {
+    if (xSemaphoreTake(fingerprintMutex, MAX_WAIT) != pdTRUE) return;
+    CleanupOldFingerprints();
+    xSemaphoreGive(fingerprintMutex);
 }
 
 BleFingerprint *getFingerprintInternal(BLEAdvertisedDevice *advertisedDevice) {
@@ -271,9 +600,11 @@ BleFingerprint *getFingerprintInternal(BLEAdvertisedDevice *advertisedDevice) {
         created->setInitial(*found);
         if (found->getIdType() > ID_TYPE_UNIQUE)
             found->expire();
-    }
+    } else
+        WarmRestart::Apply(created);
 
     fingerprints.push_back(created);
+    generation++;
     return created;
 }
 
@@ -294,19 +625,51 @@ const std::vector<BleFingerprint *> GetCopy() {
     return std::move(copy);
 }
 
-bool FindDeviceConfig(const String &id, DeviceConfig &config) {
-    if (xSemaphoreTake(deviceConfigMutex, MAX_WAIT) == pdTRUE) {
-        auto it = std::find_if(deviceConfigs.begin(), deviceConfigs.end(), [id](DeviceConfig dc) { return dc.id == id; });
-        if (it != deviceConfigs.end()) {
-            config = *it;
-            xSemaphoreGive(deviceConfigMutex);
-            return true;
-        }
-        xSemaphoreGive(deviceConfigMutex);
+uint32_t Generation() {
+    return generation;
+}
+
+uint32_t ChangeGeneration() {
+    return changes.current();
+}
+
+uint32_t NextChangeGeneration() {
+    return changes.next();
+}
+
+bool RemovedSince(uint32_t since) {
+    return changes.removedSince(since);
+}
+
+bool NextRemoved(uint32_t after, Removed &removed) {
+    if (xSemaphoreTake(fingerprintMutex, MAX_WAIT) != pdTRUE) {
+        log_e("Couldn't take fingerprintMutex in NextRemoved!");
+        return false;
+    }
+    bool found = changes.nextRemoved(after, removed);
+    xSemaphoreGive(fingerprintMutex);
+    return found;
+}
+
+// Calls fn, oldest first, for the fingerprints created after afterSerial until it returns false. The lock is
+// held throughout so none of them can be freed meanwhile; keep fn short, the scan task waits on it. To do
+// more with one, hold a Pin, find it here and use it afterwards.
+bool Walk(uint32_t afterSerial, TWalkFingerprint fn) {
+    if (xSemaphoreTake(fingerprintMutex, MAX_WAIT) != pdTRUE) {
+        log_e("Couldn't take fingerprintMutex in Walk!");
         return false;
     }
-    log_e("Couldn't take deviceConfigMutex!");
-    return false;
+    auto it = std::upper_bound(fingerprints.begin(), fingerprints.end(), afterSerial, [](uint32_t serial, BleFingerprint *f) { return serial < f->getSerial(); });
+    for (; it != fingerprints.end(); ++it)
+        if (!fn(*it)) break;
+    xSemaphoreGive(fingerprintMutex);
+    return true;
+}
+
+std::shared_ptr<const DeviceConfig> FindDeviceConfig(const String &id) {
+    auto snapshot = deviceConfigs.get();
+    auto config = snapshot->find(id);
+    return config ? std::shared_ptr<const DeviceConfig>(snapshot, config) : nullptr;
 }
 
 }  // namespace BleFingerprintCollection
@@ -2,15 +2,14 @@
 #include <ArduinoJson.h>
 
 #include "BleFingerprint.h"
+#include "ChangeLog.h"
+#include "PrefixMatcher.h"
+#include "Published.h"
 
 #define ONE_EURO_FCMIN 1e-1f
 #define ONE_EURO_BETA 1e-3f
 #define ONE_EURO_DCUTOFF 5e-3f
 
-#ifndef ALLOW_BLE_CONTROLLER_RESTART_AFTER_SECS
-#define ALLOW_BLE_CONTROLLER_RESTART_AFTER_SECS 1800
-#endif
-
 struct DeviceConfig {
     String id;
     String alias;
@@ -18,23 +17,74 @@ struct DeviceConfig {
     int8_t calRssi = NO_RSSI;
 };
 
+// Every device config, immutable once built and indexed by a hash of the id, so the advert path
+// can look one up without taking a lock or copying it
+class ConfigSnapshot {
+   public:
+    ConfigSnapshot() {}
+    explicit ConfigSnapshot(std::vector<DeviceConfig> &&configs);
+
+    const DeviceConfig *find(const String &id) const;
+    const std::vector<DeviceConfig> &all() const { return configs; }
+    size_t size() const { return configs.size(); }
+
+   private:
+    std::vector<DeviceConfig> configs;
+    std::vector<uint32_t> hashes;  // Of each config's id
+    std::vector<uint16_t> slots;   // Open addressing: index into configs + 1, 0 = empty
+    uint32_t mask = 0;
+};
+
 namespace BleFingerprintCollection {
 
+// What is left of a fingerprint after it is forgotten, so pollers can drop it too
+typedef ChangeLog::Removed Removed;
+
 typedef std::function<void(bool)> TCallbackBool;
 typedef std::function<void(BleFingerprint *)> TCallbackFingerprint;
+typedef std::function<void(BLEAdvertisedDevice *, BleFingerprint *)> TCallbackAdvert;
+typedef std::function<bool(BleFingerprint *)> TWalkFingerprint;
 
 void Setup();
 void ConnectToWifi();
-bool Command(String &command, String &pay);
+// Stages a device config from mqtt, an empty json removes it; Loop applies them in batches
 bool Config(String &id, String &json);
+void Loop();
+// When the first batch was applied after configs stopped arriving, 0 until then
+unsigned long ConfigsSettledMillis();
+// The broker acknowledged the config subscription. If no config arrives within CONFIG_REPLAY_WAIT_MS
+// it retains none, and the ones loaded from flash are dropped.
+void ConfigsSubscribed();
 
 void Close(BleFingerprint *f, bool close);
 void Count(BleFingerprint *f, bool counting);
 void Seen(BLEAdvertisedDevice *advertisedDevice);
 BleFingerprint *GetFingerprint(BLEAdvertisedDevice *advertisedDevice);
 void CleanupOldFingerprints();
+// Takes the mutex; GetCopy already cleans up, this is for while nothing calls it
+void Cleanup();
 const std::vector<BleFingerprint *> GetCopy();
-bool FindDeviceConfig(const String &id, DeviceConfig &config);
+// False if the lock couldn't be taken and fn wasn't called
+bool Walk(uint32_t afterSerial, TWalkFingerprint fn);
+// While one exists, fingerprints forgotten by cleanup are kept rather than freed, so ones found with
+// Walk can still be read after the lock was released
+class Pin {
+   public:
+    Pin();
+    ~Pin();
+    Pin(const Pin &) = delete;
+    Pin &operator=(const Pin &) = delete;
+};
+// Changes whenever a fingerprint or device config is added or removed
+uint32_t Generation();
+// Increases with every change to any fingerprint and every one removed; getVersion() is taken from it
+uint32_t ChangeGeneration();
+uint32_t NextChangeGeneration();
+// False if removals after `since` were already forgotten, or `since` is from before a reboot
+bool RemovedSince(uint32_t since);
+bool NextRemoved(uint32_t after, Removed &removed);
+// Shares ownership of the snapshot it was found in, so it stays valid after a new one is published
+std::shared_ptr<const DeviceConfig> FindDeviceConfig(const String &id);
 
 extern TCallbackBool onSeen;
 extern TCallbackFingerprint onAdd;
@@ -43,12 +93,15 @@ extern TCallbackFingerprint onClose;
 extern TCallbackFingerprint onLeft;
 extern TCallbackFingerprint onCountAdd;
 extern TCallbackFingerprint onCountDel;
+extern TCallbackAdvert onAdvert;  // Every advert, with the fingerprint it was matched to
 
 extern String include, exclude, query, knownMacs, knownIrks, countIds;
+// The prefix lists above compiled, republished whenever one of them changes
+extern Published<PrefixMatcher> includeMatcher, excludeMatcher, queryMatcher, knownMacsMatcher, countIdsMatcher;
 extern float skipDistance, maxDistance, absorption, countEnter, countExit;
 extern int8_t rxRefRssi, rxAdjRssi, txRefRssi;
 extern int forgetMs, skipMs, countMs, requeryMs;
-extern std::vector<DeviceConfig> deviceConfigs;
+extern Published<ConfigSnapshot> deviceConfigs;  // Replaced as a whole on every change
 extern std::vector<uint8_t *> irks;
 extern std::vector<BleFingerprint *> fingerprints;
 }  // namespace BleFingerprintCollection
@@ -0,0 +1,37 @@
+#include "BootProfile.h"
+
+#include "defaults.h"
+
+namespace BootProfile {
+
+struct Phase {
+    const char *name;
+    int64_t started;
+    uint32_t duration;
+};
+
+Phase phases[BOOT_PROFILE_PHASES];
+size_t count = 0;
+portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+void Record(const char *name, int64_t started, int64_t ended) {
+    portENTER_CRITICAL(&mux);
+    if (count < BOOT_PROFILE_PHASES) phases[count++] = {name, started, (uint32_t)(ended - started)};
+    portEXIT_CRITICAL(&mux);
+}
+
+void Serialize(JsonWriter &doc, const char *key) {
+    portENTER_CRITICAL(&mux);
+    auto n = count;
+    portEXIT_CRITICAL(&mux);
+    doc.beginObject(key);
+    for (size_t i = 0; i < n; i++) {
+        doc.beginObject(phases[i].name);
+        doc.add("at", phases[i].started);
+        doc.add("us", phases[i].duration);
+        doc.endObject();
+    }
+    doc.endObject();
+}
+
+}  // namespace BootProfile
@@ -0,0 +1,23 @@
+#pragma once
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include "JsonWriter.h"
+
+// Where startup time goes: named phases of setup() with when each started and how long it took, in
+// microseconds since boot. Fixed storage and no allocation, so it can time the earliest phases.
+namespace BootProfile {
+// A phase timed by hand, eg. on another task or around a call that can restart
+void Record(const char *name, int64_t started, int64_t ended);
+
+// Runs fn as phase `name`
+template <typename F>
+void Time(const char *name, F fn) {
+    auto started = esp_timer_get_time();
+    fn();
+    Record(name, started, esp_timer_get_time());
+}
+
+// {"<phase>":{"at":us,"us":us},...}, as a member `key` or on its own
+void Serialize(JsonWriter &doc, const char *key = nullptr);
+}  // namespace BootProfile
@@ -3,7 +3,9 @@
 #include <AsyncMqttClient.h>
 #include <HeadlessWiFiSettings.h>
 
+#include "CommandRouter.h"
 #include "GUI.h"
+#include "SettingsStore.h"
 #include "defaults.h"
 #include "globals.h"
 #include "mqtt.h"
@@ -29,6 +31,14 @@ void Setup() {
     if (button_2Pin >= 0) pinMode(button_2Pin, pinTypes[button_2Type]);
 }
 
+// After a pin or its type changed from the web UI
+static void reapply() {
+    button_1Detected = button_1Type & 0x01 ? LOW : HIGH;
+    button_2Detected = button_2Type & 0x01 ? LOW : HIGH;
+    online = false;
+    Setup();
+}
+
 void ConnectToWifi() {
     std::vector<String> pinTypes = {"Pullup", "Pullup Inverted", "Pulldown", "Pulldown Inverted", "Floating", "Floating Inverted"};
     button_1Type = HeadlessWiFiSettings.dropdown("button_1_type", pinTypes, 0, "Button One pin type");
@@ -40,6 +50,22 @@ void ConnectToWifi() {
     button_2Pin = HeadlessWiFiSettings.integer("button_2_pin", -1, "Button Two pin (-1 for disable)");
     button_2Timeout = HeadlessWiFiSettings.floating("button_2_timeout", 0, 300, DEFAULT_DEBOUNCE_TIMEOUT, "Button Two timeout (in seconds)");
     button_2Detected = button_2Type & 0x01 ? LOW : HIGH;
+
+    CommandRouter::Register("button_1_timeout", [](String& pay) {
+        button_1Timeout = pay.toInt();
+        SettingsStore::Put("/button_1_timeout", pay);
+    });
+    CommandRouter::Register("button_2_timeout", [](String& pay) {
+        button_2Timeout = pay.toInt();
+        SettingsStore::Put("/button_2_timeout", pay);
+    });
+
+    SettingsStore::Watch("button_1_type", [](const String &v) { button_1Type = v.toInt(); reapply(); });
+    SettingsStore::Watch("button_1_pin", [](const String &v) { button_1Pin = v.isEmpty() ? -1 : v.toInt(); reapply(); });
+    SettingsStore::Watch("button_1_timeout", [](const String &v) { button_1Timeout = v.isEmpty() ? DEFAULT_DEBOUNCE_TIMEOUT : v.toFloat(); online = false; });
+    SettingsStore::Watch("button_2_type", [](const String &v) { button_2Type = v.toInt(); reapply(); });
+    SettingsStore::Watch("button_2_pin", [](const String &v) { button_2Pin = v.isEmpty() ? -1 : v.toInt(); reapply(); });
+    SettingsStore::Watch("button_2_timeout", [](const String &v) { button_2Timeout = v.isEmpty() ? DEFAULT_DEBOUNCE_TIMEOUT : v.toFloat(); online = false; });
 }
 
 void SerialReport() {
@@ -97,18 +123,6 @@ bool SendDiscovery() {
     return sendSensorDiscovery("button", EC_NONE);
 }
 
-bool Command(String& command, String& pay) {
-    if (command == "button_1_timeout") {
-        button_1Timeout = pay.toInt();
-        spurt("/button_1_timeout", pay);
-    } else if (command == "button_2_timeout") {
-        button_2Timeout = pay.toInt();
-        spurt("/button_2_timeout", pay);
-    } else
-        return false;
-    return true;
-}
-
 bool SendOnline() {
     if (online) return true;
     if (!pub((roomsTopic + "/button_1_timeout").c_str(), 0, true, String(button_1Timeout).c_str())) return false;
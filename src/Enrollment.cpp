@@ -6,6 +6,7 @@
 #include <NimBLEDevice.h>
 #include <NimBLEService.h>
 
+#include "CommandRouter.h"
 #include "HttpWebServer.h"
 #include "globals.h"
 #include "mqtt.h"
@@ -21,6 +22,16 @@ static NimBLEServer *pServer;
 static NimBLEAdvertisementData *oAdvertisementData;
 static NimBLEService *heartRate;
 static NimBLEService *deviceInfo;
+static bool lastEnrolling = true;
+
+// Enroll commands come from the mqtt and web tasks. They only leave a request that Loop picks up, so
+// the scan task, which also reinitializes the BLE stack, is the only one changing enrollment or BLE state.
+struct Request {
+    bool pending = false, enroll = false;
+    String id, name;
+};
+static Request request;
+static SemaphoreHandle_t requestMutex;
 
 class ServerCallbacks : public NimBLEServerCallbacks {
     void onConnect(NimBLEServer *pServer) {
@@ -190,15 +201,37 @@ void Setup() {
     oBeacon.setMajor(major);
     oBeacon.setMinor(minor);
     oBeacon.setSignalPower(BleFingerprintCollection::txRefRssi);
+    delete oAdvertisementData;  // Setup runs again after the BLE stack was reinitialized
     oAdvertisementData = new NimBLEAdvertisementData();
     oAdvertisementData->setFlags(BLE_HS_ADV_F_BREDR_UNSUP);
     oAdvertisementData->setManufacturerData(oBeacon.getData());
 
     pServer->start();
+    connectionToEnroll = -1;     // Connections didn't survive a reinit
+    lastEnrolling = !enrolling;  // So Loop starts advertising
+}
+
+static void takeRequest() {
+    if (!requestMutex || xSemaphoreTake(requestMutex, 0) != pdTRUE) return;
+    Request r;
+    if (request.pending) std::swap(r, request);
+    xSemaphoreGive(requestMutex);
+    if (!r.pending) return;
+
+    if (r.enroll) {
+        newId = r.id;
+        newName = r.name;
+        enrolling = true;
+        enrollingEndMillis = millis() + 120000;
+    } else {
+        enrolledId = newId = newName = "";
+        enrolling = false;
+    }
+    HttpWebServer::SendState();
 }
 
 bool Loop() {
-    static bool lastEnrolling = true;
+    takeRequest();
     if (enrolling != lastEnrolling) {
         auto pAdvertising = NimBLEDevice::getAdvertising();
         if (enrolling) {
@@ -260,32 +293,31 @@ bool Loop() {
     return true;
 }
 
-bool Command(String &command, String &pay) {
-    if (command == "enroll") {
+static void requestEnroll(bool enroll, const String &id, const String &name) {
+    if (xSemaphoreTake(requestMutex, portMAX_DELAY) != pdTRUE) return;
+    request.pending = true;
+    request.enroll = enroll;
+    request.id = id;
+    request.name = name;
+    xSemaphoreGive(requestMutex);
+}
+
+void ConnectToWifi() {
+    if (!requestMutex) requestMutex = xSemaphoreCreateMutex();
+    CommandRouter::Register("enroll", [](String &pay) {
         const int separatorIndex = pay.indexOf('|');
-        if (separatorIndex != -1) {
-            newId = pay.substring(0, separatorIndex);
-            newName = pay.substring(separatorIndex + 1);
-        } else {
-            newId = "";
-            newName = pay.equals("PRESS") ? "" : pay;
-        }
-        enrolling = true;
-        enrollingEndMillis = millis() + 120000;
-        HttpWebServer::SendState();
-        return true;
-    }
-    if (command == "cancelEnroll") {
-        enrolledId = newId = newName = "";
-        enrolling = false;
-        HttpWebServer::SendState();
-        return true;
-    }
-    return false;
+        if (separatorIndex != -1)
+            requestEnroll(true, pay.substring(0, separatorIndex), pay.substring(separatorIndex + 1));
+        else
+            requestEnroll(true, "", pay.equals("PRESS") ? "" : pay);
+    });
+    CommandRouter::Register("cancelEnroll", [](String &pay) {
+        requestEnroll(false, "", "");
+    });
 }
 
 bool SendDiscovery() {
-    return sendConfig(Sprintf("iBeacon:e5ca1ade-f007-ba11-0000-000000000000-%hu-%hu", major, minor), "node:" + id, room) &&
-           sendButtonDiscovery("Enroll", EC_CONFIG);
+    return sendButtonDiscovery("Enroll", EC_CONFIG) &&
+           sendConfig(Sprintf("iBeacon:e5ca1ade-f007-ba11-0000-000000000000-%hu-%hu", major, minor), "node:" + id, room);
 }
 }  // namespace Enrollment
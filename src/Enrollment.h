@@ -6,6 +6,6 @@ namespace Enrollment
 {
     bool Loop();
     void Setup();
-    bool Command(String& command, String& pay);
+    void ConnectToWifi();
     bool SendDiscovery();
 }
@@ -0,0 +1,136 @@
+#include "Events.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "BleFingerprint.h"
+#include "BleFingerprintCollection.h"
+#include "JsonWriter.h"
+#include "defaults.h"
+
+namespace Events {
+
+const TickType_t MAX_WAIT = portTICK_PERIOD_MS * 100;
+
+struct Event {
+    uint32_t id;
+    const char *name;
+    uint16_t length;
+    char data[EVENTS_PAYLOAD_SIZE + 1];
+};
+
+struct Client {
+    explicit Client(AsyncEventSourceClient *client) : client(client) {}
+
+    AsyncEventSourceClient *client;
+    Event queue[EVENTS_QUEUE_DEPTH];
+    size_t head = 0, count = 0;
+    unsigned int dropped = 0;
+};
+
+AsyncEventSource source("/events");
+std::vector<Client *> clients;
+std::atomic<int> clientCount{0};
+SemaphoreHandle_t clientsMutex;
+uint32_t lastId = 0;
+
+static void push(BleFingerprint *f, const char *name) {
+    if (!clientCount) return;  // Costs nothing with nobody listening
+
+    Event e;
+    JsonWriter doc(e.data, sizeof(e.data));
+    doc.beginObject();
+    doc.add("id", f->getId());
+    if (!f->getName().isEmpty()) doc.add("name", f->getName());
+    doc.addFixed("distance", f->getDistance());
+    doc.add("rssi", f->getRssi());
+    doc.endObject();
+    if (doc.overflowed()) return;
+    e.name = name;
+    e.length = doc.length();
+    e.data[e.length] = 0;
+
+    if (xSemaphoreTake(clientsMutex, MAX_WAIT) != pdTRUE) return;
+    e.id = ++lastId;
+    for (auto c : clients) {
+        if (c->count == EVENTS_QUEUE_DEPTH) {
+            c->head = (c->head + 1) % EVENTS_QUEUE_DEPTH;
+            c->count--;
+            c->dropped++;
+        }
+        c->queue[(c->head + c->count) % EVENTS_QUEUE_DEPTH] = e;
+        c->count++;
+    }
+    xSemaphoreGive(clientsMutex);
+}
+
+// Wraps a collection callback so whoever set it before still gets called
+static void chain(TCallbackFingerprint &callback, const char *name) {
+    auto previous = callback;
+    callback = [previous, name](BleFingerprint *f) {
+        if (previous) previous(f);
+        push(f, name);
+    };
+}
+
+void Setup() {
+    clientsMutex = xSemaphoreCreateMutex();
+
+    chain(BleFingerprintCollection::onAdd, "add");
+    chain(BleFingerprintCollection::onDel, "del");
+    chain(BleFingerprintCollection::onClose, "close");
+    chain(BleFingerprintCollection::onLeft, "left");
+    chain(BleFingerprintCollection::onCountAdd, "countAdd");
+    chain(BleFingerprintCollection::onCountDel, "countDel");
+}
+
+void Init(AsyncWebServer *server) {
+    source.onConnect([](AsyncEventSourceClient *client) {
+        if (xSemaphoreTake(clientsMutex, MAX_WAIT) != pdTRUE) {
+            client->close();
+            return;
+        }
+        bool full = clients.size() >= EVENTS_MAX_CLIENTS;
+        if (!full) {
+            clients.push_back(new Client(client));
+            clientCount = clients.size();
+        }
+        xSemaphoreGive(clientsMutex);
+        if (full) client->close();
+    });
+    source.onDisconnect([](AsyncEventSourceClient *client) {
+        if (xSemaphoreTake(clientsMutex, portMAX_DELAY) != pdTRUE) return;
+        auto it = std::find_if(clients.begin(), clients.end(), [client](Client *c) { return c->client == client; });
+        if (it != clients.end()) {
+            delete *it;
+            clients.erase(it);
+            clientCount = clients.size();
+        }
+        xSemaphoreGive(clientsMutex);
+    });
+    server->addHandler(&source);
+}
+
+// Hands queued events to the clients' sockets, as many as each has room for
+void Loop() {
+    if (!clientCount) return;
+    if (xSemaphoreTake(clientsMutex, MAX_WAIT) != pdTRUE) return;
+    for (auto c : clients) {
+        if (c->dropped && c->client->packetsWaiting() < EVENTS_MAX_IN_FLIGHT) {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "{\"count\":%u}", c->dropped);
+            c->client->send(buffer, "dropped", 0);
+            c->dropped = 0;
+        }
+        while (c->count && c->client->packetsWaiting() < EVENTS_MAX_IN_FLIGHT) {
+            auto &e = c->queue[c->head];
+            c->client->send(e.data, e.name, e.id);
+            c->head = (c->head + 1) % EVENTS_QUEUE_DEPTH;
+            c->count--;
+        }
+    }
+    xSemaphoreGive(clientsMutex);
+}
+
+}  // namespace Events
@@ -0,0 +1,11 @@
+#pragma once
+#include <ESPAsyncWebServer.h>
+
+// Server-sent events for the collection's add/del/close/left/countAdd/countDel callbacks at /events.
+// Every client has a bounded queue; when a client falls behind its oldest events are dropped and it is
+// sent a "dropped" event with how many before the rest.
+namespace Events {
+void Setup();
+void Init(AsyncWebServer *server);
+void Loop();
+}  // namespace Events
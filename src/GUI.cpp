@@ -130,10 +130,6 @@ void Status(const char *format, ...) {
     free(message);
 }
 
-bool Command(String &command, String &pay) {
-    return LEDs::Command(command, pay);
-}
-
 bool SendDiscovery() {
     return LEDs::SendDiscovery();
 }
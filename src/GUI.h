@@ -27,5 +27,4 @@ void Connected(bool wifi, bool mqtt);
 void Wifi(unsigned int percent);
 void Portal(unsigned int percent);
 void Count(unsigned int count);
-bool Command(String &command, String &pay);
 }  // namespace GUI
@@ -3,6 +3,7 @@
 
 #include "globals.h"
 #include "mqtt.h"
+#include "SettingsStore.h"
 #include "defaults.h"
 #include <HeadlessWiFiSettings.h>
 #include <AsyncMqttClient.h>
@@ -28,6 +29,9 @@ namespace HX711
     {
         sckPin = HeadlessWiFiSettings.integer("HX711_sckPin", 0, "HX711 SCK (Clock) pin");
         doutPin = HeadlessWiFiSettings.integer("HX711_doutPin", 0, "HX711 DOUT (Data) pin");
+
+        SettingsStore::Watch("HX711_sckPin", [](const String &v) { sckPin = v.toInt(); Setup(); });
+        SettingsStore::Watch("HX711_doutPin", [](const String &v) { doutPin = v.toInt(); Setup(); });
     }
 
     void SerialReport()
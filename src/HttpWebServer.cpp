@@ -1,8 +1,23 @@
 #include "HttpWebServer.h"
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "AdvertInspector.h"
 #include "ArduinoJson.h"
 #include "AsyncJson.h"
+#include "BootProfile.h"
+#include "CommandRouter.h"
 #include "Enrollment.h"
+#include "Events.h"
+#include "GzipStream.h"
+#include "JsonStream.h"
+#include "JsonWriter.h"
+#include "Metrics.h"
+#include "SettingsStore.h"
 #include "defaults.h"
 #include "globals.h"
 #include "mqtt.h"
@@ -14,6 +29,13 @@ void serializeInfo(JsonObject &root) {
     root["room"] = room;
 }
 
+void serializeBoot(JsonObject &root) {
+    std::unique_ptr<char[]> buffer(new char[BOOT_PROFILE_BUFFER_SIZE]);
+    JsonWriter doc(buffer.get(), BOOT_PROFILE_BUFFER_SIZE);
+    BootProfile::Serialize(doc);
+    if (!doc.overflowed()) root["boot"] = serialized(String(doc.c_str()));
+}
+
 void serializeState(JsonObject &root) {
     JsonObject node = root.createNestedObject("state");
     node["enrolling"] = enrolling;
@@ -24,7 +46,8 @@ void serializeState(JsonObject &root) {
 void serializeConfigs(JsonObject &root) {
     JsonArray configs = root.createNestedArray("configs");
 
-    auto deviceConfigs = BleFingerprintCollection::deviceConfigs;
+    auto snapshot = BleFingerprintCollection::deviceConfigs.get();  // Held while serializing, a publish meanwhile can't free it
+    auto &deviceConfigs = snapshot->all();
     for (auto it = deviceConfigs.begin(); it != deviceConfigs.end(); ++it) {
         const JsonObject &node = configs.createNestedObject();
         node["id"] = it->id;
@@ -34,28 +57,375 @@ void serializeConfigs(JsonObject &root) {
     }
 }
 
-void serializeDevices(JsonObject &root, bool showAll) {
-    JsonArray devices = root.createNestedArray("devices");
+// Filters, sort and page for /json/devices, applied while walking the collection
+struct DeviceQuery {
+    enum Sort : uint8_t { NONE, DISTANCE, RSSI, LAST_SEEN };
+
+    String prefix;
+    float minDistance = -INFINITY, maxDistance = INFINITY;
+    short idType = 0;  // 0 = any
+    size_t offset = 0, limit = SIZE_MAX;
+    Sort sort = NONE;
+    bool active = false;  // any of the above was given
+
+    bool matches(BleFingerprint *f) const {
+        if (!prefix.isEmpty() && !f->getId().startsWith(prefix)) return false;
+        if (idType && f->getIdType() != idType) return false;
+        if (minDistance == -INFINITY && maxDistance == INFINITY) return true;
+        auto distance = f->getDistance();
+        return distance >= minDistance && distance <= maxDistance;  // A device without a distance (NaN) is in no range
+    }
+
+    // Smaller is listed first: nearest, strongest, most recently seen. Never NaN, the ranking heap needs
+    // an order, so a device without a distance comes last.
+    float key(BleFingerprint *f) const {
+        float k;
+        switch (sort) {
+            case DISTANCE:
+                k = f->getDistance();
+                break;
+            case RSSI:
+                k = -f->getRssi();
+                break;
+            default:
+                k = f->getMsSinceLastSeen();
+        }
+        return isnan(k) ? INFINITY : k;
+    }
+};
+
+// One chunked /json/devices response. Fingerprints are serialized one at a time, in creation order, so
+// memory use doesn't depend on how many there are and ones removed between chunks are simply skipped.
+// With since, only fingerprints changed after that generation are sent, preceded by the removed ones.
+// When sorted, one pass over the collection keeps the best offset + limit in a bounded heap and only
+// that page is serialized.
+class DevicesStream : public JsonStream {
+   public:
+    enum Stage : uint8_t { HEADER, REMOVED, DEVICES, FOOTER, DONE };
+
+    bool showAll = false;
+    bool delta = false;  // since was given and the removals after it are all still known
+    bool full = false;   // since was given but is too old, everything is sent
+    DeviceQuery query;
+    uint32_t since = 0;
+
+    DevicesStream() : JsonStream(REPORT_BUFFER_SIZE) {}
+
+   protected:
+    bool next() override;
+
+   private:
+    Stage stage = HEADER;
+    bool ranked = false;
+    uint32_t after = 0;         // serial of the last fingerprint looked at
+    uint32_t afterRemoved = 0;  // generation of the last removal sent
+    bool lost = false;          // a delta that turned full partway through
+    size_t matched = 0, emitted = 0;
+    std::vector<uint32_t> page;  // serials, in order, when sorted
+    size_t pagePos = 0;
+
+    bool matches(BleFingerprint *f) const {
+        if (!showAll && !f->getVisible()) return false;
+        if (f->getVersion() <= since) return false;
+        return query.matches(f);
+    }
+
+    bool serializeDevice(BleFingerprint *f);
+    void rank();
+    bool nextRanked();
+    bool nextDevice();
+    bool nextRemoved();
+};
+
+bool DevicesStream::serializeDevice(BleFingerprint *f) {
+    return element([this, f](JsonWriter &doc) {
+        doc.beginObject();
+        f->fill(&doc);
+        if (showAll && f->getVisible()) doc.add("vis", true);
+        doc.endObject();
+    });
+}
+
+void DevicesStream::rank() {
+    ranked = true;
+    size_t k = std::min(query.offset + std::min(query.limit, (size_t)DEVICES_MAX_RANKED), (size_t)DEVICES_MAX_RANKED);
+    std::vector<std::pair<float, uint32_t>> heap;  // max-heap of the best k so far
+    heap.reserve(k);
+    BleFingerprintCollection::Walk(0, [this, &heap, k](BleFingerprint *f) {
+        if (!matches(f)) return true;
+        matched++;
+        std::pair<float, uint32_t> entry(query.key(f), f->getSerial());
+        if (heap.size() < k) {
+            heap.push_back(entry);
+            std::push_heap(heap.begin(), heap.end());
+        } else if (k && entry < heap.front()) {
+            std::pop_heap(heap.begin(), heap.end());
+            heap.back() = entry;
+            std::push_heap(heap.begin(), heap.end());
+        }
+        return true;
+    });
+    std::sort_heap(heap.begin(), heap.end());
+    for (size_t i = query.offset; i < heap.size(); i++) page.push_back(heap[i].second);
+}
+
+// The fingerprint is only looked up under the lock and serialized once it was released, pinned meanwhile
+bool DevicesStream::nextRanked() {
+    if (!ranked) rank();
+    BleFingerprintCollection::Pin pin;
+    while (pagePos < page.size()) {
+        auto serial = page[pagePos++];
+        BleFingerprint *found = nullptr;
+        BleFingerprintCollection::Walk(serial - 1, [&found, serial](BleFingerprint *f) {
+            if (f->getSerial() == serial) found = f;  // Gone if the serial doesn't match
+            return false;
+        });
+        if (found && serializeDevice(found)) return true;
+    }
+    return false;
+}
 
-    auto f = BleFingerprintCollection::GetCopy();
-    for (auto it = f.begin(); it != f.end(); ++it) {
-        bool visible = (*it)->getVisible();
-        if (showAll || visible) {
-            JsonObject node = devices.createNestedObject();
-            if ((*it)->fill(&node)) {
-                if (showAll && visible) node[F("vis")] = true;
-            } else
-                devices.remove(devices.size() - 1);
+bool DevicesStream::nextDevice() {
+    if (query.sort != DeviceQuery::NONE) return nextRanked();
+
+    BleFingerprintCollection::Pin pin;
+    while (true) {
+        BleFingerprint *found = nullptr;
+        BleFingerprintCollection::Walk(after, [this, &found](BleFingerprint *f) {
+            after = f->getSerial();
+            if (!matches(f)) return true;
+            if (matched++ < query.offset || emitted >= query.limit) return true;  // Still counted for total
+            found = f;
+            return false;
+        });
+        if (!found) return false;
+        if (serializeDevice(found)) {
+            emitted++;
+            return true;
         }
     }
 }
 
-bool servingJson = false;
+bool DevicesStream::nextRemoved() {
+    BleFingerprintCollection::Removed removed;
+    if (!BleFingerprintCollection::NextRemoved(afterRemoved, removed)) return false;
+    afterRemoved = removed.generation;
+    element([&removed](JsonWriter &doc) {
+        doc.beginObject();
+        doc.add("id", removed.id);
+        doc.add("mac", removed.mac);
+        doc.endObject();
+    });
+    return true;
+}
+
+bool DevicesStream::next() {
+    switch (stage) {
+        case HEADER:
+            stage = delta ? REMOVED : DEVICES;
+            if (delta) afterRemoved = since;
+            beginElements();
+            return piece([this](JsonWriter &doc) {
+                doc.beginObject();
+                doc.add("room", room);
+                doc.add("generation", BleFingerprintCollection::ChangeGeneration());
+                if (full) doc.add("full", true);  // Too far behind, the poller has to start over
+                doc.beginArray(delta ? "removed" : "devices");
+            });
+        case REMOVED:
+            if (nextRemoved()) return true;
+            stage = DEVICES;
+            if (!BleFingerprintCollection::RemovedSince(since)) {  // Some were forgotten while they were read
+                lost = true;
+                since = 0;
+            }
+            beginElements();
+            return piece([](JsonWriter &doc) { doc.addRaw(nullptr, "],\"devices\":["); });
+        case DEVICES:
+            if (nextDevice()) return true;
+            stage = FOOTER;
+            // fall through
+        case FOOTER:
+            stage = DONE;
+            return piece([this](JsonWriter &doc) {
+                doc.endArray();
+                if (query.active) doc.add("total", matched);
+                if (lost) doc.add("full", true);  // Too late for the header, everything was sent after all
+                doc.endObject();
+            });
+        default:
+            return false;
+    }
+}
+
+typedef std::shared_ptr<const std::vector<char>> TBody;
+
+// An encoded response shared by every request for the same endpoint until it is stale
+struct Snapshot {
+    bool valid = false;  // body is null when the response was too big to cache
+    uint32_t generation = 0;
+    unsigned long created = 0;
+    TBody body;
+};
+
+static Snapshot snapshots[3][2];  // [subJson][showAll]
+static std::atomic<int> servingJson{0};
+
+// Held by a response until it is destroyed, so the concurrency limit covers the whole transfer
+struct JsonSlot {
+    ~JsonSlot() { servingJson--; }
+};
+
+static TBody encodeDevices(bool showAll) {
+    auto body = std::make_shared<std::vector<char>>();
+    DevicesStream stream;
+    stream.showAll = showAll;
+    uint8_t chunk[256];
+    while (auto n = stream.read(chunk, sizeof(chunk))) {
+        if (body->size() + n > JSON_CACHE_MAX_SIZE) return nullptr;  // Too big to hold, stream it instead
+        body->insert(body->end(), chunk, chunk + n);
+    }
+    return body;
+}
+
+static TBody encode(short subJson, bool showAll) {
+    if (subJson == 1) return encodeDevices(showAll);
+
+    DynamicJsonDocument doc(JSON_BUFFER_SIZE);
+    JsonObject root = doc.to<JsonObject>();
+    serializeInfo(root);
+    if (subJson == 0) serializeBoot(root);
+    if (subJson == 2) serializeConfigs(root);
+    auto body = std::make_shared<std::vector<char>>(measureJson(doc) + 1);
+    body->resize(serializeJson(doc, body->data(), body->size()));
+    return body;
+}
+
+// Produces the next bytes of a response body, 0 once it is complete
+typedef std::function<size_t(uint8_t *buffer, size_t maxLen)> TSource;
+
+// A source compressed on the fly, memory is the GzipStream and the input buffer whatever the size
+struct GzipSource {
+    GzipStream gz;
+    TSource source;
+    uint8_t in[256];
+    size_t inPos = 0, inLen = 0;
+};
+
+static bool acceptsGzip(AsyncWebServerRequest *request) {
+    return request->hasHeader("Accept-Encoding") && request->header("Accept-Encoding").indexOf("gzip") >= 0;
+}
+
+// length is 0 when not known up front
+static void sendSource(AsyncWebServerRequest *request, TSource source, size_t length, std::shared_ptr<JsonSlot> slot, const char *contentType = "application/json") {
+    AsyncWebServerResponse *response;
+    if (acceptsGzip(request) && (!length || length >= GZIP_MIN_SIZE)) {
+        auto state = std::make_shared<GzipSource>();
+        state->source = source;
+        response = request->beginChunkedResponse(contentType, [state, slot](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            size_t written = 0;
+            while (written < maxLen && !state->gz.done()) {
+                auto n = state->gz.read(buffer + written, maxLen - written);
+                written += n;
+                if (n) continue;
+                if (state->inPos == state->inLen) {  // Compressor wants more input
+                    state->inLen = state->source(state->in, sizeof(state->in));
+                    state->inPos = 0;
+                    if (!state->inLen) {
+                        state->gz.finish();
+                        continue;
+                    }
+                }
+                state->inPos += state->gz.write(state->in + state->inPos, state->inLen - state->inPos);
+            }
+            return written;
+        });
+        response->addHeader("Content-Encoding", "gzip");
+    } else if (length) {
+        response = request->beginResponse(contentType, length, [source, slot](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            return source(buffer, maxLen);
+        });
+    } else {
+        response = request->beginChunkedResponse(contentType, [source, slot](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            return source(buffer, maxLen);
+        });
+    }
+    request->send(response);
+}
+
+static void sendBody(AsyncWebServerRequest *request, TBody body, std::shared_ptr<JsonSlot> slot) {
+    auto offset = std::make_shared<size_t>(0);
+    sendSource(
+        request, [body, offset](uint8_t *buffer, size_t maxLen) -> size_t {
+            auto n = std::min(maxLen, body->size() - *offset);
+            memcpy(buffer, body->data() + *offset, n);
+            *offset += n;
+            return n;
+        },
+        body->size(), slot);
+}
+
+void serveDevices(AsyncWebServerRequest *request, bool showAll, uint32_t since, const DeviceQuery &query, std::shared_ptr<JsonSlot> slot) {
+    auto stream = std::make_shared<DevicesStream>();
+    stream->showAll = showAll;
+    stream->query = query;
+    stream->delta = since && BleFingerprintCollection::RemovedSince(since);
+    stream->full = since && !stream->delta;
+    stream->since = stream->delta ? since : 0;
+    sendSource(
+        request, [stream](uint8_t *buffer, size_t maxLen) -> size_t {
+            return stream->read(buffer, maxLen);
+        },
+        0, slot);
+}
+
+void serveMetrics(AsyncWebServerRequest *request) {
+    auto renderer = std::make_shared<MetricsRenderer>();
+    sendSource(
+        request, [renderer](uint8_t *buffer, size_t maxLen) -> size_t {
+            return renderer->read((char *)buffer, maxLen);
+        },
+        0, nullptr, "application/openmetrics-text; version=1.0.0; charset=utf-8");
+}
+
+static bool parseQuery(AsyncWebParameter *p, DeviceQuery &query) {
+    const String &name = p->name();
+    const String &value = p->value();
+    if (name == "prefix")
+        query.prefix = value;
+    else if (name == "minDistance")
+        query.minDistance = value.toFloat();
+    else if (name == "maxDistance")
+        query.maxDistance = value.toFloat();
+    else if (name == "idType")
+        query.idType = value.toInt();
+    else if (name == "offset")
+        query.offset = strtoul(value.c_str(), nullptr, 10);
+    else if (name == "limit")
+        query.limit = strtoul(value.c_str(), nullptr, 10);
+    else if (name == "sort") {
+        if (value == "distance")
+            query.sort = DeviceQuery::DISTANCE;
+        else if (value == "rssi")
+            query.sort = DeviceQuery::RSSI;
+        else if (value == "lastSeen")
+            query.sort = DeviceQuery::LAST_SEEN;
+    } else
+        return false;
+    return true;
+}
 
 void serveJson(AsyncWebServerRequest *request) {
-    if (servingJson) request->send(429, "Too Many Requests", "Too Many Requests");
-    servingJson = true;
+    if (servingJson.fetch_add(1) >= JSON_MAX_CONCURRENT) {
+        servingJson--;
+        request->send(429, "Too Many Requests", "Too Many Requests");
+        return;
+    }
+    auto slot = std::make_shared<JsonSlot>();
+
     bool showAll = false;
+    uint32_t since = 0;
+    DeviceQuery query;
     const String &url = request->url();
     short subJson = 0;
     if (url.indexOf("devices") > 0) subJson = 1;
@@ -65,22 +435,28 @@ void serveJson(AsyncWebServerRequest *request) {
     for (int i = 0; i < paramsNr; i++) {
         AsyncWebParameter *p = request->getParam(i);
         if (p->name() == "showAll") showAll = true;
+        if (p->name() == "since") since = strtoul(p->value().c_str(), nullptr, 10);
+        if (parseQuery(p, query)) query.active = true;
     }
 
-    auto *response = new AsyncJsonResponse(false, JSON_BUFFER_SIZE);
-    JsonObject root = response->getRoot();
-    serializeInfo(root);
-    switch (subJson) {
-        case 1:
-            serializeDevices(root, showAll);
-            break;
-        case 2:
-            serializeConfigs(root);
-            break;
-    }
-    response->setLength();
-    request->send(response);
-    servingJson = false;
+    if (subJson == 1 && (since || query.active)) {  // Depends on the request, nothing to share
+        serveDevices(request, showAll, since, query, slot);
+        return;
+    }
+
+    auto &snapshot = snapshots[subJson][showAll];
+    auto generation = BleFingerprintCollection::Generation();
+    if (!snapshot.valid || snapshot.generation != generation || millis() - snapshot.created > JSON_CACHE_TTL_MS) {
+        snapshot.valid = true;
+        snapshot.body = encode(subJson, showAll);
+        snapshot.generation = generation;
+        snapshot.created = millis();
+    }
+
+    if (snapshot.body)
+        sendBody(request, snapshot.body, slot);
+    else
+        serveDevices(request, showAll, 0, DeviceQuery(), slot);
 }
 
 void sendDataWs(AsyncWebSocketClient *client) {
@@ -110,9 +486,132 @@ void sendDataWs(AsyncWebSocketClient *client) {
     }
 }
 
+// Web socket clients following the device table. Each remembers the version of every fingerprint it was last
+// sent, in serial order like the collection, so working out a batch is a single merge of the two.
+struct Subscriber {
+    uint32_t client;
+    bool showAll;
+    bool snapshot = true;  // Next batch starts the client's table over
+    std::vector<std::pair<uint32_t, uint32_t>> sent;  // serial, version
+};
+
+static std::vector<Subscriber> subscribers;
+static SemaphoreHandle_t subscribersMutex;
+static unsigned long lastDeltas = 0;
+
+static void subscribe(uint32_t client, bool showAll) {
+    if (xSemaphoreTake(subscribersMutex, portMAX_DELAY) != pdTRUE) return;
+    auto it = std::find_if(subscribers.begin(), subscribers.end(), [client](const Subscriber &s) { return s.client == client; });
+    if (it == subscribers.end() && subscribers.size() < WS_MAX_SUBSCRIBERS)
+        it = subscribers.insert(subscribers.end(), Subscriber{client, showAll});
+    if (it != subscribers.end()) {
+        it->showAll = showAll;
+        it->snapshot = true;
+        it->sent.clear();
+    }
+    xSemaphoreGive(subscribersMutex);
+}
+
+static void unsubscribe(uint32_t client) {
+    if (xSemaphoreTake(subscribersMutex, portMAX_DELAY) != pdTRUE) return;
+    subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(), [client](const Subscriber &s) { return s.client == client; }), subscribers.end());
+    xSemaphoreGive(subscribersMutex);
+}
+
+// Devices added or changed since the last batch go out whole, removed ones by serial. What doesn't fit
+// in the buffer is left for the next batch.
+static void sendDeltas(Subscriber &s, AsyncWebSocketClient *client) {
+    static char buffer[WS_DELTA_BUFFER_SIZE];
+    static char device[REPORT_BUFFER_SIZE];
+    static const size_t reserve = 64;  // for closing the message
+
+    struct Changed {
+        BleFingerprint *f;
+        size_t index;  // Into next
+        uint32_t version;
+        bool visible;
+    };
+
+    if (s.snapshot) s.sent.clear();
+    std::vector<std::pair<uint32_t, uint32_t>> next;
+    next.reserve(s.sent.size() + 8);
+    std::vector<uint32_t> removed;
+    std::vector<Changed> changed;
+    auto old = s.sent.cbegin();
+
+    // Only the comparison happens under the lock, the devices are serialized after it was released
+    BleFingerprintCollection::Pin pin;
+    BleFingerprintCollection::Walk(0, [&](BleFingerprint *f) {
+        auto serial = f->getSerial();
+        while (old != s.sent.cend() && old->first < serial) removed.push_back((old++)->first);
+        bool known = old != s.sent.cend() && old->first == serial;
+        auto sentVersion = known ? (old++)->second : 0;
+
+        bool visible = f->getVisible();
+        if (!s.showAll && !visible) {
+            if (known) removed.push_back(serial);
+            return true;
+        }
+        if (!known || sentVersion != f->getVersion())
+            changed.push_back({f, next.size(), f->getVersion(), visible});
+        next.emplace_back(serial, sentVersion);  // Versions start at 1, so 0 is a device the client hasn't got
+        return true;
+    });
+    while (old != s.sent.cend()) removed.push_back((old++)->first);
+
+    size_t changes = 0;
+    JsonWriter doc(buffer, sizeof(buffer));
+    doc.beginObject();
+    doc.add("type", s.snapshot ? "snapshot" : "delta");
+    if (s.snapshot) doc.add("room", room);
+    doc.beginArray("devices");
+    for (auto &c : changed) {
+        JsonWriter d(device, sizeof(device));
+        d.beginObject();
+        d.add("serial", c.f->getSerial());
+        c.f->fill(&d);
+        if (s.showAll && c.visible) d.add("vis", true);
+        d.endObject();
+        if (d.overflowed()) continue;
+        if (doc.length() + d.length() + 1 + removed.size() * 11 + reserve >= sizeof(buffer)) break;
+        doc.addRaw(nullptr, d.c_str(), d.length());
+        next[c.index].second = c.version;
+        changes++;
+    }
+    next.erase(std::remove_if(next.begin(), next.end(), [](const std::pair<uint32_t, uint32_t> &e) { return e.second == 0; }), next.end());
+    doc.endArray();
+    doc.beginArray("removed");
+    for (auto serial : removed) doc.add(nullptr, serial);
+    doc.endArray();
+    doc.endObject();
+
+    if (doc.overflowed()) {  // Too much went away at once, start the client over
+        s.snapshot = true;
+        return;
+    }
+    if (!s.snapshot && !changes && removed.empty()) return;
+    client->text(doc.c_str(), doc.length());
+    s.sent.swap(next);
+    s.snapshot = false;
+}
+
+static void sendSubscribers() {
+    if (!subscribersMutex || millis() - lastDeltas < WS_DELTA_INTERVAL_MS) return;
+    lastDeltas = millis();
+
+    if (xSemaphoreTake(subscribersMutex, 0) != pdTRUE) return;
+    for (auto &s : subscribers) {
+        auto client = ws.client(s.client);
+        if (client && client->status() == WS_CONNECTED && client->canSend()) sendDeltas(s, client);
+    }
+    xSemaphoreGive(subscribersMutex);
+}
+
 void onWsEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len) {
     if (type == WS_EVT_CONNECT) {
         sendDataWs(nullptr);
+    } else if (type == WS_EVT_DISCONNECT) {
+        unsubscribe(client->id());
     } else if (type == WS_EVT_DATA) {
         auto *info = static_cast<AwsFrameInfo *>(arg);
         if (info->final && info->index == 0 && info->len == len) {
@@ -124,10 +623,19 @@ void onWsEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventTyp
                     return;
                 }
 
+                if (root.containsKey("subscribe")) {
+                    if (root["subscribe"] == "devices")
+                        subscribe(client->id(), root["showAll"] | false);
+                    else
+                        unsubscribe(client->id());
+                }
+
                 if (root.containsKey("command")) {
                     auto command = root["command"].as<String>();
                     auto payload = root.containsKey("payload") ? root["payload"].as<String>() : "";
-                    Enrollment::Command(command, payload);
+                    // The socket has no auth, so it only gets what the UI's enroll page needs
+                    if (command == "enroll" || command == "cancelEnroll")
+                        CommandRouter::Dispatch(command.c_str(), command.length(), payload);
                 }
             }
         }
@@ -139,6 +647,17 @@ void onRestart(AsyncWebServerRequest *request) {
     ESP.restart();
 }
 
+// After the UI saved settings: applies the ones that can be applied live, restarts only if one can't
+void onApplySettings(AsyncWebServerRequest *request) {
+    auto names = request->hasParam("names", true) ? request->getParam("names", true)->value() : String();
+    if (SettingsStore::Reload(names)) {
+        request->send(200, "application/json", F("{\"restart\":false}"));
+        return;
+    }
+    request->send(200, "application/json", F("{\"restart\":true}"));
+    ESP.restart();
+}
+
 void Init(AsyncWebServer *server) {
     DefaultHeaders::Instance().addHeader(F("Access-Control-Allow-Origin"), "*");
     DefaultHeaders::Instance().addHeader(F("Access-Control-Allow-Methods"), "*");
@@ -153,7 +672,9 @@ void Init(AsyncWebServer *server) {
     setupRoutes(server); // from ui_routes.h
 
     server->on("/restart", HTTP_POST, onRestart);
+    server->on("/settings/apply", HTTP_POST, onApplySettings);
     server->on("/json", HTTP_GET, serveJson);
+    server->on("/metrics", HTTP_GET, serveMetrics);
 
     server->on("/json/configs", HTTP_DELETE, [](AsyncWebServerRequest *request) {
         if (!request->hasParam("id")) {
@@ -210,11 +731,19 @@ void Init(AsyncWebServer *server) {
         });
     server->addHandler(handler);
     server->addHandler(&ws);
+    Events::Init(server);
+    AdvertInspector::Init(server);
 
+    subscribersMutex = xSemaphoreCreateMutex();
     ws.onEvent(onWsEvent);
 }
 
-void Loop() { ws.cleanupClients(); }
+void Loop() {
+    ws.cleanupClients();
+    sendSubscribers();
+    Events::Loop();
+    AdvertInspector::Loop();
+}
 
 void UpdateStart() {
     ws.enable(false);
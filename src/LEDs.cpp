@@ -4,7 +4,10 @@
 #include <HeadlessWiFiSettings.h>
 #include <WS2812FX.h>
 
+#include "CommandRouter.h"
 #include "Motion.h"
+#include "Published.h"
+#include "SettingsStore.h"
 #include "defaults.h"
 #include "globals.h"
 #include "led/Addressable.h"
@@ -19,9 +22,18 @@ int led_1_type = DEFAULT_LED1_TYPE, led_2_type, led_3_type;
 int led_1_pin = DEFAULT_LED1_PIN, led_2_pin, led_3_pin;
 int led_1_cnt = DEFAULT_LED1_CNT, led_2_cnt, led_3_cnt;
 ControlType led_1_cntrl = DEFAULT_LED1_CNTRL, led_2_cntrl, led_3_cntrl;
-std::vector<LED*> leds, statusLeds, countLeds, motionLeds;
 bool online;
 
+// The configured LEDs, replaced as a whole when one of their settings is saved from the web UI. The scan
+// and mqtt tasks may still be walking the old set; its LEDs are ended first and freed once they let go.
+struct Set {
+    std::vector<std::shared_ptr<LED>> leds;
+    std::vector<LED*> statusLeds, countLeds, motionLeds;
+};
+Published<Set> current{new Set()};
+
+void command(LED* bulb, String& pay);
+
 LED* newLed(uint8_t index, ControlType cntrl, int type, int pin, int cnt) {
     if (pin == -1) return new LED(index, Control_Type_None);
     if (type >= 2)
@@ -30,6 +42,30 @@ LED* newLed(uint8_t index, ControlType cntrl, int type, int pin, int cnt) {
         return new SinglePWM(index, cntrl, type == 1, pin);
 }
 
+static Set* build() {
+    auto set = new Set();
+    set->leds.emplace_back(newLed(1, led_1_cntrl, led_1_type, led_1_pin, led_1_cnt));
+    set->leds.emplace_back(newLed(2, led_2_cntrl, led_2_type, led_2_pin, led_2_cnt));
+    set->leds.emplace_back(newLed(3, led_3_cntrl, led_3_type, led_3_pin, led_3_cnt));
+    for (auto& led : set->leds) {
+        if (led->getControlType() == Control_Type_Status) set->statusLeds.push_back(led.get());
+        if (led->getControlType() == Control_Type_Count) set->countLeds.push_back(led.get());
+        if (led->getControlType() == Control_Type_Motion) set->motionLeds.push_back(led.get());
+    }
+    return set;
+}
+
+// After a type, pin, count or control changed from the web UI. The new LEDs may use the same pins and
+// LEDC channels, so the old ones let go of them first.
+static void reapply() {
+    auto old = current.get();
+    for (auto& led : old->leds) led->end();
+    auto set = build();
+    for (auto& led : set->leds) led->begin();
+    current.publish(set);
+    online = false;
+}
+
 void ConnectToWifi() {
     std::vector<String> ledTypes = {"PWM", "PWM Inverted", "Addressable GRB", "Addressable GRBW", "Addressable RGB", "Addressable RGBW"};
     std::vector<String> ledControlTypes = {"MQTT", "Status", "Motion", "Count"};
@@ -49,12 +85,25 @@ void ConnectToWifi() {
     led_3_cnt = HeadlessWiFiSettings.integer("led_3_cnt", -1, 39, 1, "Count (only applies to Addressable LEDs)");
     led_3_cntrl = (ControlType)HeadlessWiFiSettings.dropdown("led_3_cntrl", ledControlTypes, 0, "LED Control");
 
-    leds.push_back(newLed(1, led_1_cntrl, led_1_type, led_1_pin, led_1_cnt));
-    leds.push_back(newLed(2, led_2_cntrl, led_2_type, led_2_pin, led_2_cnt));
-    leds.push_back(newLed(3, led_3_cntrl, led_3_type, led_3_pin, led_3_cnt));
-    std::copy_if(leds.begin(), leds.end(), std::back_inserter(statusLeds), [](LED* a) { return a->getControlType() == Control_Type_Status; });
-    std::copy_if(leds.begin(), leds.end(), std::back_inserter(countLeds), [](LED* a) { return a->getControlType() == Control_Type_Count; });
-    std::copy_if(leds.begin(), leds.end(), std::back_inserter(motionLeds), [](LED* a) { return a->getControlType() == Control_Type_Motion; });
+    auto set = build();
+    current.publish(set);
+
+    // By position, so the command reaches whichever LED is there now
+    for (size_t i = 0; i < set->leds.size(); i++)
+        CommandRouter::Register(set->leds[i]->getId(), [i](String& pay) { command(current->leds[i].get(), pay); }, false);
+
+    SettingsStore::Watch("led_1_type", [](const String& v) { led_1_type = v.isEmpty() ? DEFAULT_LED1_TYPE : v.toInt(); reapply(); });
+    SettingsStore::Watch("led_1_pin", [](const String& v) { led_1_pin = v.isEmpty() ? DEFAULT_LED1_PIN : v.toInt(); reapply(); });
+    SettingsStore::Watch("led_1_cnt", [](const String& v) { led_1_cnt = v.isEmpty() ? DEFAULT_LED1_CNT : v.toInt(); reapply(); });
+    SettingsStore::Watch("led_1_cntrl", [](const String& v) { led_1_cntrl = v.isEmpty() ? DEFAULT_LED1_CNTRL : (ControlType)v.toInt(); reapply(); });
+    SettingsStore::Watch("led_2_type", [](const String& v) { led_2_type = v.toInt(); reapply(); });
+    SettingsStore::Watch("led_2_pin", [](const String& v) { led_2_pin = v.isEmpty() ? -1 : v.toInt(); reapply(); });
+    SettingsStore::Watch("led_2_cnt", [](const String& v) { led_2_cnt = v.isEmpty() ? 1 : v.toInt(); reapply(); });
+    SettingsStore::Watch("led_2_cntrl", [](const String& v) { led_2_cntrl = (ControlType)v.toInt(); reapply(); });
+    SettingsStore::Watch("led_3_type", [](const String& v) { led_3_type = v.toInt(); reapply(); });
+    SettingsStore::Watch("led_3_pin", [](const String& v) { led_3_pin = v.isEmpty() ? -1 : v.toInt(); reapply(); });
+    SettingsStore::Watch("led_3_cnt", [](const String& v) { led_3_cnt = v.isEmpty() ? 1 : v.toInt(); reapply(); });
+    SettingsStore::Watch("led_3_cntrl", [](const String& v) { led_3_cntrl = (ControlType)v.toInt(); reapply(); });
 }
 
 void SerialReport() {
@@ -82,17 +131,20 @@ bool sendState(LED* bulb) {
 }
 
 void Setup() {
-    for (auto& led : leds)
+    auto set = current.get();
+    for (auto& led : set->leds)
         led->begin();
 }
 
 void Loop() {
-    for (auto& led : leds)
+    auto set = current.get();
+    for (auto& led : set->leds)
         led->service();
 }
 
 bool SendDiscovery() {
-    for (auto& led : leds)
+    auto set = current.get();
+    for (auto& led : set->leds)
         if (led->getControlType() == Control_Type_MQTT && !sendLightDiscovery(led->getName(), EC_NONE, led->hasRgb()))
             return false;
     return true;
@@ -100,19 +152,22 @@ bool SendDiscovery() {
 
 bool SendOnline() {
     if (online) return true;
-    for (auto& led : leds)
-        if (led->getControlType() > Control_Type_None && !sendState(led)) return false;
+    auto set = current.get();
+    for (auto& led : set->leds)
+        if (led->getControlType() > Control_Type_None && !sendState(led.get())) return false;
     online = true;
     return true;
 }
 
 void Connected(bool wifi, bool mqtt) {
-    for (auto& led : statusLeds)
+    auto set = current.get();
+    for (auto& led : set->statusLeds)
         led->setColor(wifi ? 128 : 0, 128, mqtt ? 128 : 0);
 }
 
 void Seen(bool inprogress) {
-    for (auto& led : statusLeds)
+    auto set = current.get();
+    for (auto& led : set->statusLeds)
         if (led->hasRgb()) {
             led->setState(true);
             led->setColor(inprogress ? PURPLE : ORANGE);
@@ -121,7 +176,8 @@ void Seen(bool inprogress) {
 }
 
 void Wifi(unsigned int percent) {
-    for (auto& led : statusLeds) {
+    auto set = current.get();
+    for (auto& led : set->statusLeds) {
         {
             led->setColor(RED);
             led->setState(percent % 2 == 0);
@@ -130,42 +186,33 @@ void Wifi(unsigned int percent) {
 }
 
 void Portal(unsigned int percent) {
-    for (auto& led : statusLeds) {
+    auto set = current.get();
+    for (auto& led : set->statusLeds) {
         led->setColor(PINK);
         led->setState(percent % 2 == 0);
     }
 }
 
 void Update(unsigned int percent) {
+    auto set = current.get();
     if (percent == UPDATE_STARTED) {
-        for (auto& led : statusLeds)
+        for (auto& led : set->statusLeds)
             led->setColor(0, 128, 0);
     } else if (percent == UPDATE_COMPLETE) {
-        for (auto& led : statusLeds)
+        for (auto& led : set->statusLeds)
             led->setColor(0, 128, 0);
     } else {
-        for (auto& led : statusLeds)
+        for (auto& led : set->statusLeds)
             led->setState(percent % 2 == 0);
     }
 }
 
-LED* findBulb(String& command) {
-    for (auto& led : leds) {
-        if (led->getId() == command) {
-            return led;
-        }
-    }
-    return NULL;
-}
-
-bool Command(String& command, String& pay) {
-    auto bulb = findBulb(command);
-    if (bulb == NULL) return false;
+void command(LED* bulb, String& pay) {
     DynamicJsonDocument root(pay.length() + 100);
     auto err = deserializeJson(root, pay);
     if (err) {
         Serial.printf("LEDs::Command: deserializeJson: %s\r\n", err.c_str());
-        return true;
+        return;
     }
     bool sendNewState = false;
     if (root.containsKey("color")) {
@@ -195,7 +242,6 @@ bool Command(String& command, String& pay) {
         sendNewState = sendNewState || bulb->setState(root["state"] == MQTT_STATE_ON_PAYLOAD);
 
     if (sendNewState) sendState(bulb);
-    return true;
 }
 
     int count = 0, lastCount = 0;
@@ -208,21 +254,24 @@ bool Command(String& command, String& pay) {
         }
         if (count != lastCount) {
             lastCount = count;
-            for (auto& led : countLeds)
+            auto set = current.get();
+            for (auto& led : set->countLeds)
                 led->setState(count > 0);
         }
     }
 
     void Count(unsigned int countVal)
     {
+        auto set = current.get();
         count = countVal;
-        for (auto& led: countLeds)
+        for (auto& led: set->countLeds)
             led->setState(count > 0);
     }
 
     void Motion(bool pir, bool radar)
     {
-        for (auto& led: motionLeds)
+        auto set = current.get();
+        for (auto& led: set->motionLeds)
             led->setState(pir || radar);
     }
 }  // namespace LEDs
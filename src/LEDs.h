@@ -11,14 +11,12 @@ void SerialReport();
 void Loop();
 bool SendDiscovery();
 bool SendOnline();
-bool Command(String& command, String& pay);
 
 void Wifi(unsigned int progress);
 void Portal(unsigned int progress);
 void Connected(bool wifi, bool mqtt);
 void Seen(bool inprogress);
 void Update(unsigned int progress);
-bool Command(String& command, String& pay);
 void Counting(bool added);
 void Motion(bool pir, bool radar);
 void Count(unsigned int count);
@@ -3,7 +3,9 @@
 #include <AsyncMqttClient.h>
 #include <HeadlessWiFiSettings.h>
 
+#include "CommandRouter.h"
 #include "GUI.h"
+#include "SettingsStore.h"
 #include "defaults.h"
 #include "globals.h"
 #include "mqtt.h"
@@ -29,6 +31,14 @@ void Setup() {
     if (radarPin >= 0) pinMode(radarPin, pinTypes[radarType]);
 }
 
+// After a pin or its type changed from the web UI
+static void reapply() {
+    pirDetected = pirType & 0x01 ? LOW : HIGH;
+    radarDetected = radarType & 0x01 ? LOW : HIGH;
+    online = false;
+    Setup();
+}
+
 void ConnectToWifi() {
     std::vector<String> pinTypes = {"Pullup", "Pullup Inverted", "Pulldown", "Pulldown Inverted", "Floating", "Floating Inverted"};
     pirType = HeadlessWiFiSettings.dropdown("pir_type", pinTypes, 0, "PIR motion pin type");
@@ -40,6 +50,22 @@ void ConnectToWifi() {
     radarPin = HeadlessWiFiSettings.integer("radar_pin", -1, "Radar motion pin (-1 for disable)");
     radarTimeout = HeadlessWiFiSettings.floating("radar_timeout", 0, 300, DEFAULT_DEBOUNCE_TIMEOUT, "Radar motion timeout (in seconds)");
     radarDetected = radarType & 0x01 ? LOW : HIGH;
+
+    CommandRouter::Register("pir_timeout", [](String& pay) {
+        pirTimeout = pay.toInt();
+        SettingsStore::Put("/pir_timeout", pay);
+    }, false);
+    CommandRouter::Register("radar_timeout", [](String& pay) {
+        radarTimeout = pay.toInt();
+        SettingsStore::Put("/radar_timeout", pay);
+    }, false);
+
+    SettingsStore::Watch("pir_type", [](const String &v) { pirType = v.toInt(); reapply(); });
+    SettingsStore::Watch("pir_pin", [](const String &v) { pirPin = v.isEmpty() ? -1 : v.toInt(); reapply(); });
+    SettingsStore::Watch("pir_timeout", [](const String &v) { pirTimeout = v.isEmpty() ? DEFAULT_DEBOUNCE_TIMEOUT : v.toFloat(); online = false; });
+    SettingsStore::Watch("radar_type", [](const String &v) { radarType = v.toInt(); reapply(); });
+    SettingsStore::Watch("radar_pin", [](const String &v) { radarPin = v.isEmpty() ? -1 : v.toInt(); reapply(); });
+    SettingsStore::Watch("radar_timeout", [](const String &v) { radarTimeout = v.isEmpty() ? DEFAULT_DEBOUNCE_TIMEOUT : v.toFloat(); online = false; });
 }
 
 void SerialReport() {
@@ -93,18 +119,6 @@ bool SendDiscovery() {
     return sendBinarySensorDiscovery("Motion", EC_NONE, "motion");
 }
 
-bool Command(String& command, String& pay) {
-    if (command == "pir_timeout") {
-        pirTimeout = pay.toInt();
-        spurt("/pir_timeout", pay);
-    } else if (command == "radar_timeout") {
-        radarTimeout = pay.toInt();
-        spurt("/radar_timeout", pay);
-    } else
-        return false;
-    return true;
-}
-
 bool SendOnline() {
     if (online) return true;
     if (!pub((roomsTopic + "/pir_timeout").c_str(), 0, true, String(pirTimeout).c_str())) return false;
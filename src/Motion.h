@@ -8,5 +8,4 @@ void SerialReport();
 void Loop();
 bool SendDiscovery();
 bool SendOnline();
-bool Command(String& command, String& pay);
 }  // namespace Motion
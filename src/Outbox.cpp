@@ -0,0 +1,281 @@
+#include "Outbox.h"
+
+#include <HeadlessWiFiSettings.h>
+#include <SPIFFS.h>
+
+#include <map>
+#include <set>
+
+#include "BleFingerprint.h"
+#include "BleFingerprintCollection.h"
+#include "defaults.h"
+#include "globals.h"
+
+namespace Outbox {
+
+static const char *spillFile = "/outbox";
+const TickType_t MAX_WAIT = portTICK_PERIOD_MS * 100;
+
+struct Entry {
+    uint32_t seq;  // New for every push, so Loop can tell whether the entry it published is still the head
+    bool event;
+    uint16_t length;
+    char id[OUTBOX_ID_SIZE];
+    char payload[OUTBOX_PAYLOAD_SIZE];
+};
+
+bool enabled = false;
+unsigned int replayed = 0, dropped = 0, superseded = 0;
+unsigned long lastReplay = 0;
+
+// The RAM ring; outboxMutex is never held across flash I/O or a publish
+Entry *ring = nullptr;
+size_t head = 0, count = 0;
+uint32_t nextSeq = 0;
+size_t pendingSpills = 0;  // entries taken off the ring that aren't in the spill file yet, older than anything in the ring
+SemaphoreHandle_t outboxMutex;
+
+// The spill file and what is known about it, under spillMutex. Taken while outboxMutex is held
+// (never the other way round) so entries reach the file in the order they left the ring.
+// spilled only grows before pendingSpills drops, so under outboxMutex the two say whether the ring is oldest
+size_t spilled = 0, replayOffset = 0;  // records in the spill file, and where replay is in it
+bool replayRewritten = false;          // the record being replayed was overwritten with a newer state meanwhile
+std::map<String, size_t> spilledStates;  // device id -> offset of its state record in the spill file
+std::set<String> reportedLive;           // devices reported live since mqtt came back, their held states are stale
+SemaphoreHandle_t spillMutex;
+
+static void stamp(JsonWriter &doc) {
+    auto now = time(nullptr);
+    if (now > 1600000000)
+        doc.add("ts", (uint32_t)now);
+    else
+        doc.add("uptime", esp_timer_get_time() / 1000000);
+}
+
+// A device's state already in the file is overwritten in place, so the file holds one state per device.
+// Call with spillMutex held
+static void spill(const Entry &e) {
+    auto existing = e.event ? spilledStates.end() : spilledStates.find(e.id);
+    if (existing != spilledStates.end()) {
+        auto file = SPIFFS.open(spillFile, "r+");
+        bool ok = file && file.seek(existing->second) && file.write((const uint8_t *)&e, sizeof(Entry)) == sizeof(Entry);
+        if (file) file.close();
+        if (!ok) dropped++;
+        else if (existing->second == replayOffset) replayRewritten = true;
+        return;
+    }
+
+    auto file = SPIFFS.open(spillFile, FILE_APPEND);
+    if (!file) {
+        dropped++;
+        return;
+    }
+    auto offset = file.size();
+    if (offset + sizeof(Entry) > OUTBOX_FILE_MAX || file.write((const uint8_t *)&e, sizeof(Entry)) != sizeof(Entry))
+        dropped++;
+    else {
+        spilled++;
+        if (!e.event) spilledStates[e.id] = offset;
+    }
+    file.close();
+}
+
+static void push(bool event, const String &id, JsonWriter &doc) {
+    if (doc.overflowed() || id.length() >= OUTBOX_ID_SIZE) {
+        dropped++;
+        return;
+    }
+    if (xSemaphoreTake(outboxMutex, MAX_WAIT) != pdTRUE) {
+        dropped++;
+        return;
+    }
+
+    static Entry evicted;  // Only touched with spillMutex held
+    bool evict = false;
+    Entry *e = nullptr;
+    if (!event)  // Only the newest state of a device is worth replaying
+        for (size_t i = 0; i < count && !e; i++) {
+            auto &candidate = ring[(head + i) % OUTBOX_RAM_ENTRIES];
+            if (!candidate.event && id == candidate.id) e = &candidate;
+        }
+    if (!e && count == OUTBOX_RAM_ENTRIES) {
+        if (xSemaphoreTake(spillMutex, MAX_WAIT) != pdTRUE) {
+            xSemaphoreGive(outboxMutex);
+            dropped++;
+            return;
+        }
+        evicted = ring[head];
+        head = (head + 1) % OUTBOX_RAM_ENTRIES;
+        count--;
+        pendingSpills++;
+        evict = true;
+    }
+    if (!e) {
+        e = &ring[(head + count) % OUTBOX_RAM_ENTRIES];
+        count++;
+    }
+    e->seq = ++nextSeq;
+    e->event = event;
+    strlcpy(e->id, id.c_str(), sizeof(e->id));
+    memcpy(e->payload, doc.c_str(), doc.length());
+    e->length = doc.length();
+    xSemaphoreGive(outboxMutex);
+
+    if (!evict) return;
+    spill(evicted);
+    xSemaphoreGive(spillMutex);
+    if (xSemaphoreTake(outboxMutex, portMAX_DELAY) != pdTRUE) return;
+    pendingSpills--;
+    xSemaphoreGive(outboxMutex);
+}
+
+static void event(BleFingerprint *f, const char *name) {
+    if (!ring || mqttClient.connected()) return;
+    char buffer[OUTBOX_PAYLOAD_SIZE];
+    JsonWriter doc(buffer, sizeof(buffer));
+    doc.beginObject();
+    doc.add("id", f->getId());
+    doc.add("event", name);
+    stamp(doc);
+    doc.endObject();
+    push(true, f->getId(), doc);
+}
+
+// Wraps a collection callback so whoever set it before still gets called
+static void chain(TCallbackFingerprint &callback, const char *name) {
+    auto previous = callback;
+    callback = [previous, name](BleFingerprint *f) {
+        if (previous) previous(f);
+        event(f, name);
+    };
+}
+
+void Setup() {
+    outboxMutex = xSemaphoreCreateMutex();
+    spillMutex = xSemaphoreCreateMutex();
+    SPIFFS.remove(spillFile);  // Whatever was left from before a reboot is too old to be useful
+
+    chain(BleFingerprintCollection::onClose, "close");
+    chain(BleFingerprintCollection::onLeft, "left");
+    chain(BleFingerprintCollection::onCountAdd, "countAdd");
+    chain(BleFingerprintCollection::onCountDel, "countDel");
+}
+
+void ConnectToWifi() {
+    enabled = HeadlessWiFiSettings.checkbox("outbox", false, "Hold reports while mqtt is disconnected and replay them after");
+    if (enabled && !ring) ring = new Entry[OUTBOX_RAM_ENTRIES];
+}
+
+bool Enabled() {
+    return ring != nullptr;
+}
+
+bool State(BleFingerprint *f) {
+    if (!ring) return false;
+    char buffer[OUTBOX_PAYLOAD_SIZE];
+    JsonWriter doc(buffer, sizeof(buffer));
+    doc.beginObject();
+    if (!f->report(&doc)) return false;
+    stamp(doc);
+    doc.endObject();
+    push(false, f->getId(), doc);
+    return true;
+}
+
+void Supersede(const String &id) {
+    if (!ring || (!spilled && !count)) return;
+    if (xSemaphoreTake(outboxMutex, MAX_WAIT) != pdTRUE) return;
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        auto &e = ring[(head + i) % OUTBOX_RAM_ENTRIES];
+        if (!e.event && id == e.id) {
+            superseded++;
+            continue;
+        }
+        if (kept != i) ring[(head + kept) % OUTBOX_RAM_ENTRIES] = e;
+        kept++;
+    }
+    count = kept;
+    xSemaphoreGive(outboxMutex);
+
+    if (!spilled || xSemaphoreTake(spillMutex, MAX_WAIT) != pdTRUE) return;
+    if (spilledStates.count(id)) reportedLive.insert(id);
+    xSemaphoreGive(spillMutex);
+}
+
+// The spill file holds the oldest entries, then whatever is being moved there, then the ring
+static void replaySpilled(TPublish publish) {
+    static Entry e;
+    if (xSemaphoreTake(spillMutex, MAX_WAIT) != pdTRUE) return;
+    auto file = SPIFFS.open(spillFile, FILE_READ);
+    bool ok = file && file.seek(replayOffset) && file.read((uint8_t *)&e, sizeof(Entry)) == sizeof(Entry);
+    if (file) file.close();
+    bool stale = ok && !e.event && reportedLive.count(e.id);
+    replayRewritten = false;
+    xSemaphoreGive(spillMutex);
+
+    bool published = ok && !stale && publish(e.event, e.id, e.payload, e.length);
+
+    if (xSemaphoreTake(spillMutex, portMAX_DELAY) != pdTRUE) return;
+    if (!ok) {
+        dropped += spilled;
+        spilled = 0;
+    } else if (stale || (published && !replayRewritten)) {
+        if (stale)
+            superseded++;
+        else
+            replayed++;
+        if (!e.event) spilledStates.erase(e.id);
+        replayOffset += sizeof(Entry);
+        spilled--;
+    }
+    if (!spilled) {
+        SPIFFS.remove(spillFile);
+        replayOffset = 0;
+        spilledStates.clear();
+        reportedLive.clear();
+    }
+    xSemaphoreGive(spillMutex);
+}
+
+void Loop(TPublish publish) {
+    if (!ring || (!spilled && !count)) return;
+    if (millis() - lastReplay < OUTBOX_REPLAY_INTERVAL_MS) return;
+    lastReplay = millis();
+
+    if (spilled) {
+        replaySpilled(publish);
+        return;
+    }
+
+    static Entry e;
+    if (xSemaphoreTake(outboxMutex, MAX_WAIT) != pdTRUE) return;
+    if (!count || pendingSpills || spilled) {  // Something older is in, or on its way to, the file
+        xSemaphoreGive(outboxMutex);
+        return;
+    }
+    e = ring[head];
+    xSemaphoreGive(outboxMutex);
+
+    if (!publish(e.event, e.id, e.payload, e.length)) return;
+    replayed++;
+
+    // Pop only what was published: meanwhile the head may have been superseded, replaced by a newer
+    // state of the device, or moved to the spill file (which then replays it again)
+    if (xSemaphoreTake(outboxMutex, portMAX_DELAY) != pdTRUE) return;
+    if (count && ring[head].seq == e.seq) {
+        head = (head + 1) % OUTBOX_RAM_ENTRIES;
+        count--;
+    }
+    xSemaphoreGive(outboxMutex);
+}
+
+void SendTelemetry(JsonWriter &doc) {
+    if (!ring) return;
+    doc.add("outbox", count + spilled);
+    if (replayed > 0) doc.add("outboxReplayed", replayed);
+    if (superseded > 0) doc.add("outboxSuperseded", superseded);
+    if (dropped > 0) doc.add("outboxDropped", dropped);
+}
+
+}  // namespace Outbox
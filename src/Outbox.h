@@ -0,0 +1,29 @@
+#pragma once
+#include <Arduino.h>
+
+#include <functional>
+
+#include "JsonWriter.h"
+
+class BleFingerprint;
+
+// Holds device reports and close/left/count events while mqtt is down and replays them, with the
+// time they happened, once it is back. Newest state per device is kept in RAM; when the RAM ring
+// is full the oldest entries spill to a file in SPIFFS. States a live report made obsolete are not
+// replayed, so consumers never get an older state after a newer one.
+namespace Outbox {
+typedef std::function<bool(bool event, const char *id, const char *payload, size_t length)> TPublish;
+
+void Setup();
+void ConnectToWifi();
+bool Enabled();
+
+// Called instead of publishing while disconnected
+bool State(BleFingerprint *f);
+// A live report of the device went out, so any state of it still held is older and is dropped
+void Supersede(const String &id);
+// Replays at most one entry per OUTBOX_REPLAY_INTERVAL_MS, call while connected
+void Loop(TPublish publish);
+
+void SendTelemetry(JsonWriter &doc);
+}  // namespace Outbox
@@ -0,0 +1,168 @@
+#include "SettingsStore.h"
+
+#include <SPIFFS.h>
+#include <esp_system.h>
+
+#include <map>
+#include <vector>
+
+#include "SettingsJournal.h"
+#include "defaults.h"
+#include "string_utils.h"
+
+namespace SettingsStore {
+
+static const char *journalFile = "/settings.journal";
+const TickType_t MAX_WAIT = portTICK_PERIOD_MS * 100;
+
+struct Watcher {
+    String name;
+    String last;  // As last applied or Put, to skip the ones the save didn't change; guarded by storeMutex
+    TApply apply;
+};
+
+std::function<void()> onReloaded = nullptr;
+std::map<String, String> pending;
+std::vector<Watcher> watchers;
+std::vector<String> reloads;
+unsigned long firstPut = 0, lastPut = 0;
+unsigned int flushes = 0;
+SemaphoreHandle_t storeMutex;
+
+static String read(const String &fn) {
+    auto f = SPIFFS.open(fn, FILE_READ);
+    if (!f) return String();
+    auto value = f.readString();
+    f.close();
+    return value;
+}
+
+class SpiffsFlash : public SettingsFlash {
+   public:
+    bool read(const String &fn, std::vector<uint8_t> &data) override {
+        if (!SPIFFS.exists(fn)) return false;
+        auto f = SPIFFS.open(fn, FILE_READ);
+        if (!f) return false;
+        data.resize(f.size());
+        bool whole = f.read(data.data(), data.size()) == data.size();
+        f.close();
+        return whole;
+    }
+
+    bool write(const String &fn, const uint8_t *data, size_t length) override {
+        auto f = SPIFFS.open(fn, FILE_WRITE);
+        if (!f) return false;
+        bool whole = f.write(data, length) == length;
+        f.close();
+        return whole;
+    }
+
+    void remove(const String &fn) override {
+        if (SPIFFS.exists(fn)) SPIFFS.remove(fn);
+    }
+};
+
+static SpiffsFlash flash;
+static SettingsJournal journal(flash, journalFile);
+
+static void commit(std::map<String, String> &changes) {
+    auto written = journal.commit(changes);
+    if (!written) return;
+    flushes++;
+    Serial.printf("Saved %u settings\r\n", written);
+}
+
+void Setup() {
+    storeMutex = xSemaphoreCreateMutex();
+    esp_register_shutdown_handler(Flush);
+
+    auto replayed = journal.recover();
+    if (replayed) Serial.printf("Replayed %u settings from journal\r\n", replayed);
+}
+
+void Put(const String &fn, const String &value) {
+    if (xSemaphoreTake(storeMutex, MAX_WAIT) != pdTRUE) {
+        log_e("Couldn't take storeMutex, writing %s directly", fn.c_str());
+        spurt(fn, value);
+        return;
+    }
+    if (pending.empty()) firstPut = millis();
+    lastPut = millis();
+    pending[fn] = value;
+    // A command changed it live, so the UI saving the old value back is a change again
+    for (auto &w : watchers)
+        if (fn == "/" + w.name) w.last = value;
+    xSemaphoreGive(storeMutex);
+}
+
+void Flush() {
+    if (!storeMutex || xSemaphoreTake(storeMutex, MAX_WAIT) != pdTRUE) return;
+    std::map<String, String> changes;
+    changes.swap(pending);
+    xSemaphoreGive(storeMutex);
+    commit(changes);
+}
+
+void Watch(const char *name, TApply apply) {
+    watchers.push_back({name, read(String("/") + name), apply});
+}
+
+bool Reload(const String &names) {
+    if (xSemaphoreTake(storeMutex, MAX_WAIT) != pdTRUE) return false;
+    bool live = true;
+    int start = 0;
+    while (start < (int)names.length()) {
+        int end = names.indexOf(',', start);
+        if (end < 0) end = names.length();
+        auto name = names.substring(start, end);
+        name.trim();
+        start = end + 1;
+        if (name.isEmpty()) continue;
+
+        bool watched = false;
+        for (auto &w : watchers)
+            if (w.name == name) watched = true;
+        if (!watched) {
+            Serial.printf("Setting %s needs a restart\r\n", name.c_str());
+            live = false;
+        }
+        reloads.push_back(name);
+        pending.erase("/" + name);  // What was just saved wins over a command still waiting to be written
+    }
+    xSemaphoreGive(storeMutex);
+    return live;
+}
+
+static void reload() {
+    std::vector<String> names;
+    if (xSemaphoreTake(storeMutex, 0) != pdTRUE) return;
+    names.swap(reloads);
+    xSemaphoreGive(storeMutex);
+
+    unsigned int applied = 0;
+    for (auto &name : names)
+        for (auto &w : watchers) {
+            if (w.name != name) continue;
+            auto value = read("/" + name);
+            if (xSemaphoreTake(storeMutex, MAX_WAIT) != pdTRUE) continue;
+            bool same = value == w.last;
+            w.last = value;
+            xSemaphoreGive(storeMutex);
+            if (same) continue;
+            w.apply(value);
+            applied++;
+        }
+    if (!applied) return;
+    Serial.printf("Applied %u settings without restart\r\n", applied);
+    if (onReloaded) onReloaded();
+}
+
+void Loop() {
+    if (!reloads.empty()) reload();
+    if (pending.empty()) return;
+    auto now = millis();
+    if (now - lastPut < SETTINGS_FLUSH_DELAY_MS && now - firstPut < SETTINGS_FLUSH_MAX_WAIT_MS) return;
+    Flush();
+}
+
+}  // namespace SettingsStore
@@ -0,0 +1,32 @@
+#pragma once
+#include <Arduino.h>
+
+#include <functional>
+
+// Write-behind cache for settings changed by commands. Changes are held in RAM and written
+// together once they stop coming (a slider in HA can send dozens a second), so the mqtt callback
+// never waits on flash and a setting that ends where it started isn't written at all. Each key
+// still lands in its own SPIFFS file, which is what HeadlessWiFiSettings reads at boot.
+//
+// A flush first writes every pending change to one journal record with a crc, then the files,
+// then removes the journal; Setup replays a journal left behind by a reset in between (SettingsJournal).
+namespace SettingsStore {
+// Call after SPIFFS.begin and before anything reads settings
+void Setup();
+void Loop();
+
+// Replaces spurt() for settings; `fn` is the SPIFFS path, eg. "/skip_ms"
+void Put(const String &fn, const String &value);
+// Writes whatever is pending right away; also runs on restart
+void Flush();
+
+// Settings saved from the web UI are re-applied by whoever watches them, on the loop task, instead of
+// after a restart. The value is what HeadlessWiFiSettings stored; empty means the default.
+typedef std::function<void(const String &value)> TApply;
+void Watch(const char *name, TApply apply);
+// Names (comma separated) the web UI just saved. False if any of them isn't watched and so only
+// takes effect after a restart.
+bool Reload(const String &names);
+// Once per Loop that applied a change, eg. to send discovery again
+extern std::function<void()> onReloaded;
+}  // namespace SettingsStore
@@ -3,7 +3,9 @@
 #include <AsyncMqttClient.h>
 #include <HeadlessWiFiSettings.h>
 
+#include "CommandRouter.h"
 #include "GUI.h"
+#include "SettingsStore.h"
 #include "defaults.h"
 #include "globals.h"
 #include "mqtt.h"
@@ -29,6 +31,14 @@ void Setup() {
     if (switch_2Pin >= 0) pinMode(switch_2Pin, pinTypes[switch_2Type]);
 }
 
+// After a pin or its type changed from the web UI
+static void reapply() {
+    switch_1Detected = switch_1Type & 0x01 ? LOW : HIGH;
+    switch_2Detected = switch_2Type & 0x01 ? LOW : HIGH;
+    online = false;
+    Setup();
+}
+
 void ConnectToWifi() {
     std::vector<String> pinTypes = {"Pullup", "Pullup Inverted", "Pulldown", "Pulldown Inverted", "Floating", "Floating Inverted"};
     switch_1Type = HeadlessWiFiSettings.dropdown("switch_1_type", pinTypes, 0, "Switch One pin type");
@@ -40,6 +50,22 @@ void ConnectToWifi() {
     switch_2Pin = HeadlessWiFiSettings.integer("switch_2_pin", -1, "Switch Two pin (-1 for disable)");
     switch_2Timeout = HeadlessWiFiSettings.floating("switch_2_timeout", 0, 300, DEFAULT_DEBOUNCE_TIMEOUT, "Switch Two timeout (in seconds)");
     switch_2Detected = switch_2Type & 0x01 ? LOW : HIGH;
+
+    CommandRouter::Register("switch_1_timeout", [](String& pay) {
+        switch_1Timeout = pay.toInt();
+        SettingsStore::Put("/switch_1_timeout", pay);
+    });
+    CommandRouter::Register("switch_2_timeout", [](String& pay) {
+        switch_2Timeout = pay.toInt();
+        SettingsStore::Put("/switch_2_timeout", pay);
+    });
+
+    SettingsStore::Watch("switch_1_type", [](const String &v) { switch_1Type = v.toInt(); reapply(); });
+    SettingsStore::Watch("switch_1_pin", [](const String &v) { switch_1Pin = v.isEmpty() ? -1 : v.toInt(); reapply(); });
+    SettingsStore::Watch("switch_1_timeout", [](const String &v) { switch_1Timeout = v.isEmpty() ? DEFAULT_DEBOUNCE_TIMEOUT : v.toFloat(); online = false; });
+    SettingsStore::Watch("switch_2_type", [](const String &v) { switch_2Type = v.toInt(); reapply(); });
+    SettingsStore::Watch("switch_2_pin", [](const String &v) { switch_2Pin = v.isEmpty() ? -1 : v.toInt(); reapply(); });
+    SettingsStore::Watch("switch_2_timeout", [](const String &v) { switch_2Timeout = v.isEmpty() ? DEFAULT_DEBOUNCE_TIMEOUT : v.toFloat(); online = false; });
 }
 
 void SerialReport() {
@@ -97,18 +123,6 @@ bool SendDiscovery() {
     return sendSensorDiscovery("switch", EC_NONE);
 }
 
-bool Command(String& command, String& pay) {
-    if (command == "switch_1_timeout") {
-        switch_1Timeout = pay.toInt();
-        spurt("/switch_1_timeout", pay);
-    } else if (command == "switch_2_timeout") {
-        switch_2Timeout = pay.toInt();
-        spurt("/switch_2_timeout", pay);
-    } else
-        return false;
-    return true;
-}
-
 bool SendOnline() {
     if (online) return true;
     if (!pub((roomsTopic + "/switch_1_timeout").c_str(), 0, true, String(switch_1Timeout).c_str())) return false;
@@ -6,9 +6,11 @@
 #include <esp_ota_ops.h>
 
 #include "HeadlessWiFiSettings.h"
+#include "CommandRouter.h"
 #include "GUI.h"
 #include "HttpReleaseUpdate.h"
 #include "HttpWebServer.h"
+#include "SettingsStore.h"
 #include "defaults.h"
 #include "globals.h"
 #include "mqtt.h"
@@ -190,6 +192,23 @@ void ConnectToWifi() {
     prerelease = HeadlessWiFiSettings.checkbox("prerelease", false, "Include pre-released versions in auto-update");
     arduinoOtaEnabled = HeadlessWiFiSettings.checkbox("arduino_ota", DEFAULT_ARDUINO_OTA, "Arduino OTA Update");
     updateUrl = HeadlessWiFiSettings.string("update", "", "If set will update from this url on next boot");
+
+    CommandRouter::Register("arduino_ota", [](String& pay) {
+        arduinoOtaEnabled = pay == "ON";
+        SettingsStore::Put("/arduino_ota", String(arduinoOtaEnabled));
+    });
+    CommandRouter::Register("auto_update", [](String& pay) {
+        autoUpdateEnabled = pay == "ON";
+        SettingsStore::Put("/auto_update", String(autoUpdateEnabled));
+    });
+    CommandRouter::Register("prerelease", [](String& pay) {
+        prerelease = pay == "ON";
+        SettingsStore::Put("/prerelease", String(prerelease));
+    });
+    CommandRouter::Register("update", [](String& pay) {
+        spurt("/update", pay);
+        ESP.restart();
+    });
 }
 
 void MarkOtaSuccess() {
@@ -202,21 +221,4 @@ void MarkOtaSuccess() {
     }
 }
 
-bool Command(String& command, String& pay) {
-    if (command == "arduino_ota") {
-        arduinoOtaEnabled = pay == "ON";
-        spurt("/arduino_ota", String(arduinoOtaEnabled));
-    } else if (command == "auto_update") {
-        autoUpdateEnabled = pay == "ON";
-        spurt("/auto_update", String(autoUpdateEnabled));
-    } else if (command == "prerelease") {
-        prerelease = pay == "ON";
-        spurt("/prerelease", String(prerelease));
-    } else if (command == "update") {
-        spurt("/update", pay);
-        ESP.restart();
-    } else
-        return false;
-    return true;
-}
 }  // namespace Updater
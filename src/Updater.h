@@ -4,6 +4,5 @@ void Loop(void);
 void ConnectToWifi();
 bool SendOnline();
 bool SendDiscovery();
-bool Command(String& command, String& pay);
 void MarkOtaSuccess();
 }  // namespace Updater
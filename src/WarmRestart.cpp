@@ -0,0 +1,69 @@
+#include "WarmRestart.h"
+
+#include <esp_attr.h>
+#include <esp_system.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "BleFingerprint.h"
+#include "BleFingerprintCollection.h"
+#include "RetainedTable.h"
+
+namespace WarmRestart {
+
+static const uint32_t MAGIC = 0x4d524157;  // "WARM"
+
+// Not cleared by a software reset, garbage after power on; the magic and crc tell which
+RTC_NOINIT_ATTR RetainedTable<WarmState, WARM_RESTART_ENTRIES> table;
+
+std::vector<WarmState> restored;
+
+// Most recently seen first, as many as fit. A restart can come from any task while the scan task keeps
+// changing the table, so the fingerprints are collected under the lock and pinned until they are saved;
+// if the lock can't be had quickly nothing is saved and the restart is a cold one.
+static void save() {
+    table.open();
+    BleFingerprintCollection::Pin pin;
+    std::vector<BleFingerprint *> recent;
+    bool walked = BleFingerprintCollection::Walk(0, [&recent](BleFingerprint *f) {
+        if (f->getDistance() > 0) recent.push_back(f);
+        return true;
+    });
+    if (!walked) return;
+    std::sort(recent.begin(), recent.end(), [](BleFingerprint *a, BleFingerprint *b) { return a->getMsSinceLastSeen() < b->getMsSinceLastSeen(); });
+
+    uint16_t count = 0;
+    for (auto f : recent) {
+        if (count == WARM_RESTART_ENTRIES) break;
+        if (f->getId().length() >= WARM_RESTART_ID_SIZE) continue;
+        f->saveWarm(table.entries[count++]);
+    }
+    table.seal(MAGIC, count);
+}
+
+void Setup() {
+    if (table.valid(MAGIC) && esp_reset_reason() == ESP_RST_SW) {
+        restored.assign(table.entries, table.entries + table.count);
+        Serial.printf("Restored %u fingerprints from before the restart\r\n", restored.size());
+    }
+    table.open();
+    esp_register_shutdown_handler(save);
+}
+
+void Apply(BleFingerprint *f) {
+    if (restored.empty()) return;
+    // Whatever hasn't shown up again by now is gone
+    if (millis() > (unsigned long)BleFingerprintCollection::forgetMs) {
+        std::vector<WarmState>().swap(restored);
+        return;
+    }
+
+    auto native = f->getAddress().getNative();
+    auto it = std::find_if(restored.begin(), restored.end(), [native](const WarmState &s) { return !memcmp(s.address, native, 6); });
+    if (it == restored.end()) return;
+    f->restoreWarm(*it);
+    restored.erase(it);
+}
+
+}  // namespace WarmRestart
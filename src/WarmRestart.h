@@ -0,0 +1,30 @@
+#pragma once
+#include <Arduino.h>
+
+#include "FilteredDistance.h"
+#include "defaults.h"
+
+class BleFingerprint;
+
+// What a fingerprint keeps across a software restart
+struct WarmState {
+    uint8_t address[6];
+    uint8_t addressType;
+    int8_t calRssi;
+    int16_t idType;
+    int16_t rssi;
+    char id[WARM_RESTART_ID_SIZE];
+    float raw, dist;
+    FilteredDistance::State filter;
+};
+
+// Keeps the fingerprint table in RTC memory across intentional restarts (the restart command, a
+// stuck controller, too many reconnects...), so devices come back with their filter state and
+// identity instead of starting over and flapping between rooms. Saved from a shutdown handler, so
+// every ESP.restart() is covered; crashes and power loss still start cold.
+namespace WarmRestart {
+// Call before scanning starts; restores the table if the last reset was a software one
+void Setup();
+// Gives a newly created fingerprint what was saved for its address, if anything
+void Apply(BleFingerprint *f);
+}  // namespace WarmRestart
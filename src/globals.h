@@ -30,7 +30,6 @@ Setup variable declaration macros.
 _DECL String room, id, statusTopic, teleTopic, roomsTopic, setTopic, configTopic;
 _DECL AsyncMqttClient mqttClient;
 _DECL String homeAssistantDiscoveryPrefix;
-_DECL DynamicJsonDocument doc _INIT_N(((1024)));
 _DECL String localIp;
 _DECL AsyncWebSocket ws _INIT_N((("/ws")));
 _DECL bool enrolling;
@@ -23,7 +23,7 @@ neoPixelType getNeoPixelType(int type) {
 }
 
 void Addressable::begin() {
-    if (ws2812fx == NULL) {
+    if (ws2812fx == NULL && !ended) {
         ws2812fx = new WS2812FX(cnt, pin, getNeoPixelType(type), 1, 1);
         ws2812fx->init();
         ws2812fx->setColor(255, 255, 128);
@@ -33,14 +33,26 @@ void Addressable::begin() {
     }
 }
 
-void Addressable::service() {
+// ws2812fx isn't deleted: its destructor sets the pin back to an input, and the LED replacing this one
+// may be driving that pin by then
+void Addressable::end() {
+    ended = true;
+    if (ws2812fx != NULL) ws2812fx->stop();
+}
+
+bool Addressable::ready() {
     if (ws2812fx == NULL) begin();
+    return !ended;
+}
+
+void Addressable::service() {
+    if (!ready()) return;
     ws2812fx->service();
 }
 
 bool Addressable::setColor(uint8_t p_red, uint8_t p_green, uint8_t p_blue) {
     if (!LED::setColor(p_red, p_green, p_blue)) return false;
-    if (ws2812fx == NULL) begin();
+    if (!ready()) return false;
     ws2812fx->setColor(p_red, p_green, p_blue);
     ws2812fx->setBrightness(LED::getBrightness());
     LED::setState(true);
@@ -49,7 +61,7 @@ bool Addressable::setColor(uint8_t p_red, uint8_t p_green, uint8_t p_blue) {
 
 bool Addressable::setBrightness(uint8_t p_brightness) {
     if (!LED::setBrightness(p_brightness)) return false;
-    if (ws2812fx == NULL) begin();
+    if (!ready()) return false;
     ws2812fx->setBrightness(map(p_brightness, 0, 255, 0, MAX_BRIGHTNESS));
     LED::setState(p_brightness > 0);
     return true;
@@ -57,14 +69,14 @@ bool Addressable::setBrightness(uint8_t p_brightness) {
 
 bool Addressable::setState(bool p_state) {
     if (!LED::setState(p_state)) return false;
-    if (ws2812fx == NULL) begin();
+    if (!ready()) return false;
     ws2812fx->setBrightness(map(p_state ? LED::getBrightness() : 0, 0, 255, 0, MAX_BRIGHTNESS));
     return true;
 }
 
 bool Addressable::setWhite(uint8_t p_white) {
     Serial.printf("Addressable::setWhite: p_white=%d\r\n", p_white);
-    if (ws2812fx == NULL) begin();
+    if (!ready()) return false;
     ws2812fx->setColor(p_white, p_white, p_white);
     return true;
 }
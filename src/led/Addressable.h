@@ -7,6 +7,7 @@ class Addressable : public LED {
    public:
     Addressable(uint8_t index, ControlType controlType, int type, int pin, int cnt);
     void begin() override;
+    void end() override;
     void service() override;
 
     bool setColor(uint8_t p_red, uint8_t p_green, uint8_t p_blue) override;
@@ -23,4 +24,7 @@ class Addressable : public LED {
     int pin;
     int cnt;
     int cntrl;
+    volatile bool ended = false;
+
+    bool ready();
 };
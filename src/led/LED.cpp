@@ -3,6 +3,7 @@
 #include "string_utils.h"
 
 void LED::begin() {}
+void LED::end() {}
 void LED::service() {}
 
 uint8_t LED::getBrightness(void) {
@@ -20,7 +20,10 @@ struct Color {
 class LED {
    public:
     LED(uint8_t index, ControlType controlType);
+    virtual ~LED() {}
     virtual void begin();
+    // Switches off and lets go of the pin for an LED that replaces this one; anything called after does nothing
+    virtual void end();
     virtual void service();
 
     virtual uint8_t getBrightness(void);
@@ -16,7 +16,15 @@ void SinglePWM::begin() {
     setDuty(LED::getBrightness());
 }
 
+void SinglePWM::end() {
+    ended = true;
+    if (!inited) return;
+    ledcWrite(getIndex(), inverted ? 4096 : 0);
+    ledcDetachPin(pin);
+}
+
 void SinglePWM::setDuty(uint32_t x) {
+    if (ended) return;
     if (!inited) init();
     uint32_t duty = x >= 255 ? 4096 : (x <= 0 ? 0 : round(4096.0 * pow(10.0, 0.0055 * (x - 255.0))));
     if (inverted) duty = 4096 - duty;
@@ -7,6 +7,7 @@ class SinglePWM : public LED {
 
     SinglePWM(uint8_t index, ControlType controlType, bool inverted, int pin);
     void begin() override;
+    void end() override;
     void service() override;
 
     bool setState(bool state) override;
@@ -18,4 +19,5 @@ class SinglePWM : public LED {
     bool inverted;
     int pin;
     bool inited = false;
+    volatile bool ended = false;
 };
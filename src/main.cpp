@@ -3,11 +3,57 @@
 
 #include "esp_heap_caps.h"
 
+#include <memory>
+
 void heapCapsAllocFailedHook(size_t requestedSize, uint32_t caps, const char *functionName)
 {
     printf("%s was called but failed to allocate %d bytes with 0x%X capabilities. \n",functionName, requestedSize, caps);
 }
 
+// Each step is retried until it succeeds; entities whose payload the broker already has are skipped, so
+// a step that ran out of publish budget halfway only sends what is left when it is resumed
+static bool (*const discoverySteps[])() = {
+    sendConnectivityDiscovery,
+    [] { return sendTeleSensorDiscovery("Uptime", EC_DIAGNOSTIC, "{{ value_json.uptime }}", DEVICE_CLASS_NONE, "s"); },
+    [] { return sendTeleSensorDiscovery("Free Mem", EC_DIAGNOSTIC, "{{ value_json.freeHeap }}", DEVICE_CLASS_NONE, "bytes"); },
+    [] { return BleFingerprintCollection::countIds.isEmpty() ? sendDeleteDiscovery("sensor", "Count") : sendTeleSensorDiscovery("Count", EC_NONE, "{{ value_json.count }}"); },
+    [] { return sendButtonDiscovery("Restart", EC_DIAGNOSTIC); },
+    [] { return sendNumberDiscovery("Max Distance", EC_CONFIG); },
+    [] { return sendNumberDiscovery("Absorption", EC_CONFIG); },
+    Updater::SendDiscovery,
+    GUI::SendDiscovery,
+    Motion::SendDiscovery,
+    Switch::SendDiscovery,
+    Button::SendDiscovery,
+    Enrollment::SendDiscovery,
+    Battery::SendDiscovery,
+    CAN::SendDiscovery,
+#ifdef SENSORS
+    DHT::SendDiscovery,
+    AHTX0::SendDiscovery,
+    BH1750::SendDiscovery,
+    BME280::SendDiscovery,
+    BMP180::SendDiscovery,
+    BMP280::SendDiscovery,
+    SHT::SendDiscovery,
+    TSL2561::SendDiscovery,
+    SensirionSGP30::SendDiscovery,
+    HX711::SendDiscovery,
+    DS18B20::SendDiscovery,
+#endif
+};
+
+void discoveryLoop() {
+    if (!discovery || sentDiscovery) return;
+
+    beginDiscoveryBatch(DISCOVERY_PUBLISHES_PER_LOOP);
+    while (discoveryStep < sizeof(discoverySteps) / sizeof(discoverySteps[0])) {
+        if (!discoverySteps[discoveryStep]()) return;  // Out of budget or publish failed, resume here next loop (oversized payloads are logged and skipped)
+        discoveryStep++;
+    }
+    sentDiscovery = true;
+}
+
 bool sendTelemetry(unsigned int totalSeen, unsigned int totalFpSeen, unsigned int totalFpQueried, unsigned int totalFpReported, unsigned int count) {
     if (!online) {
         if (
@@ -35,42 +81,7 @@ bool sendTelemetry(unsigned int totalSeen, unsigned int totalFpSeen, unsigned in
         }
     }
 
-    if (discovery && !sentDiscovery) {
-        if (sendConnectivityDiscovery()
-            && sendTeleSensorDiscovery("Uptime", EC_DIAGNOSTIC, "{{ value_json.uptime }}", DEVICE_CLASS_NONE, "s")
-            && sendTeleSensorDiscovery("Free Mem", EC_DIAGNOSTIC, "{{ value_json.freeHeap }}", DEVICE_CLASS_NONE, "bytes")
-            && (BleFingerprintCollection::countIds.isEmpty() ? sendDeleteDiscovery("sensor", "Count") : sendTeleSensorDiscovery("Count", EC_NONE, "{{ value_json.count }}"))
-            && sendButtonDiscovery("Restart", EC_DIAGNOSTIC)
-            && sendNumberDiscovery("Max Distance", EC_CONFIG)
-            && sendNumberDiscovery("Absorption", EC_CONFIG)
-
-            && Updater::SendDiscovery()
-            && GUI::SendDiscovery()
-            && Motion::SendDiscovery()
-            && Switch::SendDiscovery()
-            && Button::SendDiscovery()
-            && Enrollment::SendDiscovery()
-            && Battery::SendDiscovery()
-            && CAN::SendDiscovery()
-#ifdef SENSORS
-            && DHT::SendDiscovery()
-            && AHTX0::SendDiscovery()
-            && BH1750::SendDiscovery()
-            && BME280::SendDiscovery()
-            && BMP180::SendDiscovery()
-            && BMP280::SendDiscovery()
-            && SHT::SendDiscovery()
-            && TSL2561::SendDiscovery()
-            && SensirionSGP30::SendDiscovery()
-            && HX711::SendDiscovery()
-            && DS18B20::SendDiscovery()
-#endif
-        ) {
-            sentDiscovery = true;
-        } else {
-            Serial.println("Error sending discovery");
-        }
-    }
+    discoveryLoop();
 
     auto now = millis();
 
@@ -79,59 +90,79 @@ bool sendTelemetry(unsigned int totalSeen, unsigned int totalFpSeen, unsigned in
 
     lastTeleMillis = now;
 
-    doc.clear();
-    doc["ip"] = localIp;
-    doc["uptime"] = esp_timer_get_time() / 1000000;
+    static char buffer[TELEMETRY_BUFFER_SIZE];
+    JsonWriter doc(buffer, sizeof(buffer));
+    localIp = Network.localIP().toString();  // Follows DHCP changes
+    doc.beginObject();
+    doc.add("ip", localIp);
+    doc.add("uptime", esp_timer_get_time() / 1000000);
 #ifdef FIRMWARE
-    doc["firm"] = String(FIRMWARE);
+    doc.add("firm", FIRMWARE);
 #endif
-    doc["rssi"] = WiFi.RSSI();
-    Battery::SendTelemetry();
+    doc.add("rssi", WiFi.RSSI());
+    Battery::SendTelemetry(doc);
+    Outbox::SendTelemetry(doc);
 
 #ifdef VERSION
-    doc["ver"] = String(VERSION);
+    doc.add("ver", VERSION);
 #else
-    doc["ver"] = ESP.getSketchMD5() + "-" + getBuildTimestamp();
+    doc.add("ver", ESP.getSketchMD5() + "-" + getBuildTimestamp());
 #endif
 
     if (!BleFingerprintCollection::countIds.isEmpty())
-        doc["count"] = count;
+        doc.add("count", count);
     if (totalSeen > 0)
-        doc["adverts"] = totalSeen;
+        doc.add("adverts", totalSeen);
     if (totalFpSeen > 0)
-        doc["seen"] = totalFpSeen;
+        doc.add("seen", totalFpSeen);
     if (totalFpQueried > 0)
-        doc["queried"] = totalFpQueried;
+        doc.add("queried", totalFpQueried);
     if (totalFpReported > 0)
-        doc["reported"] = totalFpReported;
+        doc.add("reported", totalFpReported);
     if (reportFailed > 0)
-        doc["failed"] = reportFailed;
+        doc.add("failed", reportFailed);
     if (teleFails > 0)
-        doc["teleFails"] = teleFails;
+        doc.add("teleFails", teleFails);
     if (reconnectTries > 0)
-        doc["reconnectTries"] = reconnectTries;
+        doc.add("reconnectTries", reconnectTries);
+    if (scanRecoveries > 0)
+        doc.add("scanRecoveries", scanRecoveries);
+    if (stackRecoveries > 0)
+        doc.add("stackRecoveries", stackRecoveries);
+    if (lastRecoveryMs > 0)
+        doc.add("lastRecoveryMs", lastRecoveryMs);
+    if (BleFingerprintCollection::ConfigsSettledMillis() > 0)
+        doc.add("configsSettled", BleFingerprintCollection::ConfigsSettledMillis());
     auto maxHeap = ESP.getMaxAllocHeap();
     auto freeHeap = ESP.getFreeHeap();
-    doc["freeHeap"] = freeHeap;
-    doc["maxHeap"] = maxHeap;
-    doc["scanStack"] = uxTaskGetStackHighWaterMark(scanTaskHandle);
-    doc["loopStack"] = uxTaskGetStackHighWaterMark(nullptr);
-    doc["bleStack"] = bleStack;
-
-    String buffer;
-    serializeJson(doc, buffer);
-    if (pub(teleTopic.c_str(), 0, false, buffer.c_str())) return true;
+    doc.add("freeHeap", freeHeap);
+    doc.add("maxHeap", maxHeap);
+    doc.add("scanStack", uxTaskGetStackHighWaterMark(scanTaskHandle));
+    doc.add("loopStack", loopStack);
+    doc.add("bleStack", bleStack);
+    doc.beginObject("boot");
+    if (bootTimes.ble) doc.add("ble", bootTimes.ble);
+    if (bootTimes.ip) doc.add("ip", bootTimes.ip);
+    if (bootTimes.mqtt) doc.add("mqtt", bootTimes.mqtt);
+    if (bootTimes.report) doc.add("report", bootTimes.report);
+    doc.endObject();
+    doc.endObject();
+
+    if (!doc.overflowed() && pub(teleTopic.c_str(), 0, false, doc.c_str(), doc.length())) return true;
 
     teleFails++;
     log_e("Error after 10 tries sending telemetry (%d times since boot)", teleFails);
     return false;
 }
 
+void scanTask(void *parameter);
+
 void setupNetwork() {
     Serial.println("Setup network");
     WiFi.setScanMethod(WIFI_ALL_CHANNEL_SCAN);
     GUI::Connected(false, false);
 
+    auto settings = esp_timer_get_time();
     room = HeadlessWiFiSettings.string("room", ESPMAC, "Room");
     HeadlessWiFiSettings.string("wifi-ssid", "", "WiFi SSID");
     HeadlessWiFiSettings.pstring("wifi-password", "", "WiFi Password");
@@ -149,34 +180,54 @@ void setupNetwork() {
     publishTele = HeadlessWiFiSettings.checkbox("pub_tele", true, "Send to telemetry topic");
     publishRooms = HeadlessWiFiSettings.checkbox("pub_rooms_dep", false, "Send to rooms topic (deprecated in v4)");
     publishDevices = HeadlessWiFiSettings.checkbox("pub_devices", true, "Send to devices topic");
+    BootProfile::Record("settings", settings, esp_timer_get_time());
 
-    Updater::ConnectToWifi();
+    BootProfile::Time("Updater::ConnectToWifi", Updater::ConnectToWifi);
 
     HeadlessWiFiSettings.markExtra();
 
-    GUI::ConnectToWifi();
+    BootProfile::Time("GUI::ConnectToWifi", GUI::ConnectToWifi);
 
-    BleFingerprintCollection::ConnectToWifi();
-    Motion::ConnectToWifi();
-    Switch::ConnectToWifi();
-    Button::ConnectToWifi();
+    BootProfile::Time("BleFingerprintCollection::ConnectToWifi", BleFingerprintCollection::ConnectToWifi);
+    BootProfile::Time("Motion::ConnectToWifi", Motion::ConnectToWifi);
+    BootProfile::Time("Switch::ConnectToWifi", Switch::ConnectToWifi);
+    BootProfile::Time("Button::ConnectToWifi", Button::ConnectToWifi);
+    BootProfile::Time("Enrollment::ConnectToWifi", Enrollment::ConnectToWifi);
+    BootProfile::Time("Outbox::ConnectToWifi", Outbox::ConnectToWifi);
+
+    CommandRouter::Register("restart", [](String &pay) { ESP.restart(); }, false);
+    CommandRouter::Register("wifi-ssid", [](String &pay) { SettingsStore::Put("/wifi-ssid", pay); }, false);
+    CommandRouter::Register("wifi-password", [](String &pay) { SettingsStore::Put("/wifi-password", pay); }, false);
 
 #ifdef SENSORS
-    DHT::ConnectToWifi();
-    I2C::ConnectToWifi();
-
-    AHTX0::ConnectToWifi();
-    BH1750::ConnectToWifi();
-    BME280::ConnectToWifi();
-    BMP180::ConnectToWifi();
-    BMP280::ConnectToWifi();
-    SHT::ConnectToWifi();
-    TSL2561::ConnectToWifi();
-    SensirionSGP30::ConnectToWifi();
-    HX711::ConnectToWifi();
-    DS18B20::ConnectToWifi();
+    BootProfile::Time("DHT::ConnectToWifi", DHT::ConnectToWifi);
+    BootProfile::Time("I2C::ConnectToWifi", I2C::ConnectToWifi);
+
+    BootProfile::Time("AHTX0::ConnectToWifi", AHTX0::ConnectToWifi);
+    BootProfile::Time("BH1750::ConnectToWifi", BH1750::ConnectToWifi);
+    BootProfile::Time("BME280::ConnectToWifi", BME280::ConnectToWifi);
+    BootProfile::Time("BMP180::ConnectToWifi", BMP180::ConnectToWifi);
+    BootProfile::Time("BMP280::ConnectToWifi", BMP280::ConnectToWifi);
+    BootProfile::Time("SHT::ConnectToWifi", SHT::ConnectToWifi);
+    BootProfile::Time("TSL2561::ConnectToWifi", TSL2561::ConnectToWifi);
+    BootProfile::Time("SensirionSGP30::ConnectToWifi", SensirionSGP30::ConnectToWifi);
+    BootProfile::Time("HX711::ConnectToWifi", HX711::ConnectToWifi);
+    BootProfile::Time("DS18B20::ConnectToWifi", DS18B20::ConnectToWifi);
 #endif
 
+    BootProfile::Time("CommandRouter::Build", CommandRouter::Build);
+
+    // Every setting the scan depends on is read by now; scan while the network comes up, the
+    // fingerprint table holds what was seen until mqtt is there to report it
+    xTaskCreatePinnedToCore(scanTask, "scanTask", SCAN_TASK_STACK_SIZE, nullptr, 1, &scanTaskHandle, CONFIG_BT_NIMBLE_PINNED_TO_CORE);
+
+    // Settings applied live from the web UI can change entities and retained states
+    SettingsStore::onReloaded = [] {
+        online = false;
+        sentDiscovery = false;
+        discoveryStep = 0;
+    };
+
     unsigned int connectProgress = 0;
     HeadlessWiFiSettings.onWaitLoop = [&connectProgress]() {
         GUI::Wifi(connectProgress++);
@@ -197,11 +248,15 @@ void setupNetwork() {
     HeadlessWiFiSettings.hostname = "espresense-" + kebabify(room);
 
     bool success = false;
+    auto connecting = esp_timer_get_time();
     if (ethernetType > 0) success = Network.connect(ethernetType, 20, HeadlessWiFiSettings.hostname.c_str());
     if (!success && !HeadlessWiFiSettings.connect(true, wifiTimeout))
         ESP.restart();
+    BootProfile::Record("connect", connecting, esp_timer_get_time());
 
     GUI::Connected(true, false);
+    bootTimes.ip = millis();
+    Serial.printf("Network up %lums after boot\r\n", bootTimes.ip);
 
 #ifdef FIRMWARE
     Serial.println("Firmware:     " + String(FIRMWARE));
@@ -257,7 +312,7 @@ void setupNetwork() {
     teleTopic = roomsTopic + "/telemetry";
     setTopic = roomsTopic + "/+/set";
     configTopic = CHANNEL + String("/settings/+/config");
-    HeadlessWiFiSettings.httpSetup();
+    BootProfile::Time("httpSetup", [] { HeadlessWiFiSettings.httpSetup(); });
     Updater::MarkOtaSuccess();
 }
 
@@ -265,8 +320,17 @@ void onMqttConnect(bool sessionPresent) {
     xTimerStop(reconnectTimer, 0);
     mqttClient.subscribe("espresense/rooms/*/+/set", 1);
     mqttClient.subscribe(setTopic.c_str(), 1);
-    mqttClient.subscribe(configTopic.c_str(), 1);
+    configSubscription = mqttClient.subscribe(configTopic.c_str(), 1);
+    if (discovery) mqttClient.subscribe((homeAssistantDiscoveryPrefix + "/status").c_str(), 1);
+    resetDiscovery();  // A broker without persistence comes back empty
+    sentDiscovery = false;
+    discoveryStep = 0;
     GUI::Connected(true, true);
+    if (!bootTimes.mqtt) bootTimes.mqtt = millis();
+}
+
+void onMqttSubscribe(uint16_t packetId, uint8_t qos) {
+    if (packetId == configSubscription && qos != 0x80) BleFingerprintCollection::ConfigsSubscribed();
 }
 
 void onMqttDisconnect(AsyncMqttClientDisconnectReason reason) {
@@ -274,67 +338,56 @@ void onMqttDisconnect(AsyncMqttClientDisconnectReason reason) {
     Serial.printf("Disconnected from MQTT; reason %d\r\n", (int)reason);
     xTimerStart(reconnectTimer, 0);
     online = false;
+    resetDiscovery();
+}
+
+// Finds the topic level in front of `suffix` ("/config" or "/set") without copying the topic
+static bool topicLevel(const char *topic, size_t topicLen, const char *suffix, const char *&level, size_t &levelLen) {
+    auto suffixLen = strlen(suffix);
+    if (topicLen <= suffixLen || memcmp(topic + topicLen - suffixLen, suffix, suffixLen) != 0) return false;
+    auto end = topic + topicLen - suffixLen;
+    auto start = end;
+    while (start > topic && start[-1] != '/') start--;
+    if (start == topic) return false;
+    level = start;
+    levelLen = end - start;
+    return true;
 }
 
-void onMqttMessage(const char *topic, const char *payload) {
-    String top = String(topic);
-    String pay = String(payload);
+void onMqttMessage(const char *topic, const char *payload, size_t length) {
+    auto topicLen = strlen(topic);
+    const char *level;
+    size_t levelLen;
+    String pay;
+    pay.concat(payload, length);
 
-    auto setPos = top.lastIndexOf("/set");
-    auto configPos = top.lastIndexOf("/config");
-    if (configPos > 1) {
-        auto idPos = top.lastIndexOf("/", configPos - 1);
-        if (idPos < 0) goto skip;
-        auto id = top.substring(idPos + 1, configPos);
+    if (topicLevel(topic, topicLen, "/config", level, levelLen)) {
+        String id;
+        id.concat(level, levelLen);
         Serial.printf("%d Config | %s to %s\r\n", xPortGetCoreID(), id.c_str(), pay.c_str());
         BleFingerprintCollection::Config(id, pay);
-    } else if (setPos > 1) {
-        auto commandPos = top.lastIndexOf("/", setPos - 1);
-        if (commandPos < 0) goto skip;
-        auto command = top.substring(commandPos + 1, setPos);
-        Serial.printf("%d Set    | %s to %s\r\n", xPortGetCoreID(), command.c_str(), pay.c_str());
-
-        bool changed = false;
-        if (command == "restart")
-            ESP.restart();
-        else if (command == "wifi-ssid" || command == "wifi-password")
-            spurt("/" + command, pay);
-        else if (GUI::Command(command, pay))
-            ;
-        else if (Motion::Command(command, pay))
-            ;
-        else if (BleFingerprintCollection::Command(command, pay))
-            changed = true;
-        else if (Enrollment::Command(command, pay))
-            changed = true;
-        else if (Updater::Command(command, pay))
-            changed = true;
-        else if (Motion::Command(command, pay))
-            changed = true;
-        else if (Switch::Command(command, pay))
-            changed = true;
-        else if (Button::Command(command, pay))
-            changed = true;
-        if (changed) online = false;
+    } else if (topicLevel(topic, topicLen, "/set", level, levelLen)) {
+        Serial.printf("%d Set    | %.*s to %s\r\n", xPortGetCoreID(), (int)levelLen, level, pay.c_str());
+        bool republish = false;
+        if (CommandRouter::Dispatch(level, levelLen, pay, &republish) && republish) {
+            online = false;
+            sentDiscovery = false;  // Re-walk discovery, only entities whose payload changed get republished
+            discoveryStep = 0;
+        }
+    } else if (discovery && homeAssistantDiscoveryPrefix + "/status" == topic) {
+        if (pay != "online") return;
+        Serial.printf("%d HA     | Home Assistant restarted, resending discovery\r\n", xPortGetCoreID());
+        resetDiscovery();
+        sentDiscovery = false;
+        discoveryStep = 0;
     } else {
-    skip:
-        Serial.printf("%d Unknown| %s to %s\r\n", xPortGetCoreID(), topic, payload);
+        Serial.printf("%d Unknown| %s to %s\r\n", xPortGetCoreID(), topic, pay.c_str());
     }
 }
 
-std::string payload_buffer_;
+MqttReassembler mqttReassembler(MQTT_REASSEMBLY_SLOTS, MQTT_REASSEMBLY_MAX_PAYLOAD, onMqttMessage);
 void onMqttMessageRaw(char *topic, char *payload, AsyncMqttClientMessageProperties properties, size_t len, size_t index, size_t total) {
-    if (index == 0)
-        payload_buffer_.reserve(total);
-
-    // append new payload, may contain incomplete MQTT message
-    payload_buffer_.append(payload, len);
-
-    // MQTT fully received
-    if (len + index == total) {
-        onMqttMessage(topic, payload_buffer_.data());
-        payload_buffer_.clear();
-    }
+    mqttReassembler.onFragment(topic, payload, len, index, total);
 }
 
 void reconnect(TimerHandle_t xTimer) {
@@ -363,6 +416,7 @@ void connectToMqtt() {
     reconnectTimer = xTimerCreate("reconnectionTimer", pdMS_TO_TICKS(3000), pdTRUE, (void *)nullptr, reconnect);
     mqttClient.onConnect(onMqttConnect);
     mqttClient.onDisconnect(onMqttDisconnect);
+    mqttClient.onSubscribe(onMqttSubscribe);
     mqttClient.onMessage(onMqttMessageRaw);
     mqttClient.setClientId(HeadlessWiFiSettings.hostname.c_str());
     mqttClient.setServer(mqttHost.c_str(), mqttPort);
@@ -379,22 +433,26 @@ bool reportBuffer(BleFingerprint *f) {
 }
 
 bool reportDevice(BleFingerprint *f) {
-    doc.clear();
-    JsonObject obj = doc.to<JsonObject>();
-    if (!f->report(&obj))
+    static char buffer[REPORT_BUFFER_SIZE];
+    JsonWriter doc(buffer, sizeof(buffer));
+    doc.beginObject();
+    if (!f->report(&doc))
         return false;
+    doc.endObject();
+    if (doc.overflowed()) {
+        reportFailed++;
+        return false;
+    }
 
-    String buffer;
-    serializeJson(doc, buffer);
     String devicesTopic = Sprintf(CHANNEL "/devices/%s/%s", f->getId().c_str(), id.c_str());
 
     bool p1 = false, p2 = false;
     for (int i = 0; i < 10; i++) {
         if (!mqttClient.connected()) return false;
-        if (!p1 && (!publishRooms || mqttClient.publish(roomsTopic.c_str(), 0, false, buffer.c_str())))
+        if (!p1 && (!publishRooms || mqttClient.publish(roomsTopic.c_str(), 0, false, doc.c_str(), doc.length())))
             p1 = true;
 
-        if (!p2 && (!publishDevices || mqttClient.publish(devicesTopic.c_str(), 0, false, buffer.c_str())))
+        if (!p2 && (!publishDevices || mqttClient.publish(devicesTopic.c_str(), 0, false, doc.c_str(), doc.length())))
             p2 = true;
 
         if (p1 && p2)
@@ -411,16 +469,64 @@ unsigned int totalFpSeen = 0;
 unsigned int totalFpQueried = 0;
 unsigned int totalFpReported = 0;
 
+enum Stage { STAGE_ADVERT, STAGE_QUERY, STAGE_REPORT };
+static const char *const stageNames[] = {"advert", "query", "report"};
+static const Bucket stageBuckets[] = {{100, "0.0001"}, {500, "0.0005"}, {1000, "0.001"}, {5000, "0.005"}, {10000, "0.01"}, {50000, "0.05"}, {100000, "0.1"}, {500000, "0.5"}, {1000000, "1"}};
+Histogram<3, 9> stageDuration("espresense_stage_duration_seconds", "Time spent handling one advert, one query pass over all fingerprints and one report loop", "stage", stageNames, stageBuckets);
+
+// Same numbers as the telemetry topic, for /metrics
+Counter advertsMetric("espresense_adverts", "BLE advertisements received", [] { return (uint64_t)totalSeen; });
+Counter seenMetric("espresense_seen", "Fingerprints seen, summed over report loops", [] { return (uint64_t)totalFpSeen; });
+Counter queriedMetric("espresense_queried", "Fingerprints queried", [] { return (uint64_t)totalFpQueried; });
+Counter reportedMetric("espresense_reported", "Device reports published", [] { return (uint64_t)totalFpReported; });
+Counter failedMetric("espresense_report_failed", "Device reports that could not be published", [] { return (uint64_t)reportFailed; });
+Counter teleFailsMetric("espresense_tele_fails", "Telemetry messages that could not be published", [] { return (uint64_t)teleFails; });
+Gauge reconnectMetric("espresense_mqtt_reconnect_tries", "Mqtt reconnect attempts since the last successful one", [] { return (int64_t)reconnectTries; });
+Gauge uptimeMetric("espresense_uptime_seconds", "Seconds since boot", [] { return (int64_t)(esp_timer_get_time() / 1000000); });
+Gauge rssiMetric("espresense_wifi_rssi_dbm", "WiFi signal strength", [] { return (int64_t)WiFi.RSSI(); });
+Gauge freeHeapMetric("espresense_free_heap_bytes", "Free heap", [] { return (int64_t)ESP.getFreeHeap(); });
+Gauge maxHeapMetric("espresense_max_alloc_heap_bytes", "Largest block that can be allocated", [] { return (int64_t)ESP.getMaxAllocHeap(); });
+Gauge scanStackMetric("espresense_scan_stack_free_bytes", "Scan task stack high water mark", [] { return (int64_t)uxTaskGetStackHighWaterMark(scanTaskHandle); });
+Gauge loopStackMetric("espresense_loop_stack_free_bytes", "Loop task stack high water mark", [] { return (int64_t)loopStack; });
+Gauge bleStackMetric("espresense_ble_stack_free_bytes", "BLE host task stack high water mark", [] { return (int64_t)bleStack; });
+
 void reportSetup() {
     connectToMqtt();
 }
 
+// Publishes an entry held by the outbox while mqtt was down
+bool replayOutbox(bool event, const char *deviceId, const char *payload, size_t length) {
+    if (!mqttClient.connected()) return false;
+    if (event) return mqttClient.publish((roomsTopic + "/events").c_str(), 0, false, payload, length);
+
+    if (publishRooms && !mqttClient.publish(roomsTopic.c_str(), 0, false, payload, length)) return false;
+    if (publishDevices && !mqttClient.publish(Sprintf(CHANNEL "/devices/%s/%s", deviceId, id.c_str()).c_str(), 0, false, payload, length)) return false;
+    return true;
+}
+
+// Once per boot, retained so it is there whenever someone looks
+bool sendBootProfile() {
+    std::unique_ptr<char[]> buffer(new char[BOOT_PROFILE_BUFFER_SIZE]);
+    JsonWriter doc(buffer.get(), BOOT_PROFILE_BUFFER_SIZE);
+    BootProfile::Serialize(doc);
+    if (doc.overflowed()) {
+        log_e("Boot profile doesn't fit in %d bytes", BOOT_PROFILE_BUFFER_SIZE);
+        return true;
+    }
+    return pub((roomsTopic + "/boot").c_str(), 0, true, doc.c_str(), doc.length());
+}
+
 void reportLoop() {
+    loopStack = uxTaskGetStackHighWaterMark(nullptr);
     if (!mqttClient.connected()) {
+        if (Outbox::Enabled())
+            for (auto &f : BleFingerprintCollection::GetCopy())
+                Outbox::State(f);
         return;
     }
 
     yield();
+    auto started = esp_timer_get_time();
     auto copy = BleFingerprintCollection::GetCopy();
 
     unsigned int count = 0;
@@ -432,6 +538,9 @@ void reportLoop() {
 
     yield();
     sendTelemetry(totalSeen, totalFpSeen, totalFpQueried, totalFpReported, count);
+    if (online && !sentBootProfile) sentBootProfile = sendBootProfile();
+    yield();
+    Outbox::Loop(replayOutbox);
     yield();
 
     auto reported = 0;
@@ -447,45 +556,156 @@ void reportLoop() {
                 f->clearReport();
         }
         if (reportDevice(f)) {
+            Outbox::Supersede(f->getId());
             totalFpReported++;
             reported++;
+            if (!bootTimes.report) {
+                bootTimes.report = millis();
+                Serial.printf("First report %lums after boot (ble %lums, network %lums, mqtt %lums)\r\n", bootTimes.report, bootTimes.ble, bootTimes.ip, bootTimes.mqtt);
+            }
         }
         yield();
     }
+    stageDuration.observe(STAGE_REPORT, esp_timer_get_time() - started);
 }
 
+// Adverts since boot; the scan task compares them per window to tell a quiet moment from a
+// controller that stopped delivering
+volatile uint32_t advertsReceived = 0;
+
 class MyAdvertisedDeviceCallbacks : public BLEAdvertisedDeviceCallbacks {
     void onResult(BLEAdvertisedDevice *advertisedDevice) {
+        advertsReceived++;
         bleStack = uxTaskGetStackHighWaterMark(nullptr);
+        auto started = esp_timer_get_time();
         BleFingerprintCollection::Seen(advertisedDevice);
+        stageDuration.observe(STAGE_ADVERT, esp_timer_get_time() - started);
     }
 };
 
-void scanTask(void *parameter) {
-    NimBLEDevice::init("ESPresense");
+static MyAdvertisedDeviceCallbacks advertisedDeviceCallbacks;  // Outlives the scan object across a stack reinit
+
+enum Recovery { RECOVERY_NONE, RECOVERY_SCAN, RECOVERY_STACK };
+
+Counter scanRecoveriesMetric("espresense_ble_scan_recoveries", "BLE stalls ended by restarting the scan", [] { return (uint64_t)scanRecoveries; });
+Counter stackRecoveriesMetric("espresense_ble_stack_recoveries", "BLE stalls ended by reinitializing the BLE stack", [] { return (uint64_t)stackRecoveries; });
+Gauge lastRecoveryMetric("espresense_ble_last_recovery_ms", "How long the last recovered BLE stall lasted", [] { return (int64_t)lastRecoveryMs; });
+
+// Everything registered on the stack after NimBLEDevice::init, again after every reinit
+static void setupBle() {
     Enrollment::Setup();
     NimBLEDevice::setMTU(23);
+}
+
+// Start failures in a row. The controller not taking the command, unlike a quiet room, is evidence it is stuck.
+static unsigned int scanStartFailures = 0;
 
+static bool restartScan(NimBLEScan *pBLEScan, bool isContinue) {
+    if (pBLEScan->start(0, nullptr, isContinue)) {
+        scanStartFailures = 0;
+        return true;
+    }
+    scanStartFailures++;
+    log_e("Error re-starting continuous ble scan");
+    return false;
+}
+
+static NimBLEScan *startScan() {
     auto pBLEScan = NimBLEDevice::getScan();
     pBLEScan->setInterval(BLE_SCAN_INTERVAL);
     pBLEScan->setWindow(BLE_SCAN_WINDOW);
-    pBLEScan->setAdvertisedDeviceCallbacks(new MyAdvertisedDeviceCallbacks(), true);
+    pBLEScan->setAdvertisedDeviceCallbacks(&advertisedDeviceCallbacks, true);
     pBLEScan->setActiveScan(false);
     pBLEScan->setDuplicateFilter(false);
     pBLEScan->setMaxResults(0);
-    if (!pBLEScan->start(0, nullptr, false))
-        log_e("Error starting continuous ble scan");
+    if (restartScan(pBLEScan, false) && !bootTimes.ble)
+        bootTimes.ble = millis();
+    return pBLEScan;
+}
+
+// A window without adverts restarts the scan, which is harmless. It can't go further on that alone,
+// because a room with no advertisers looks the same as a controller that stopped delivering. The BLE
+// stack is reinitialized, and after that the ESP rebooted, only on evidence the controller is stuck:
+// the scan won't start, or the host lost sync with the controller. The first adverts after a stall
+// credit the tier that ended it.
+//
+// Only the scan task touches BLE objects: queries and Enrollment::Loop run here, and the enroll
+// commands from mqtt and the web socket just leave a request for Enrollment::Loop. So nothing else
+// can be using the stack while it is torn down here, and the host task's callbacks end in deinit.
+static void checkLiveness(NimBLEScan *&pBLEScan) {
+    static unsigned long windowStart = millis(), lastAdvert = millis(), stalledSince = 0;
+    static uint32_t windowAdverts = 0, lastCount = 0;
+    static Recovery tier = RECOVERY_NONE;
+
+    auto now = millis();
+    uint32_t adverts = advertsReceived;
+    if (adverts != lastCount) {
+        lastCount = adverts;
+        lastAdvert = now;
+    }
+    if (now - windowStart < BLE_LIVENESS_WINDOW_MS) return;
+    bool alive = adverts - windowAdverts >= BLE_LIVENESS_MIN_ADVERTS;
+    windowStart = now;
+    windowAdverts = adverts;
+
+    if (alive) {
+        if (tier == RECOVERY_NONE) return;
+        (tier == RECOVERY_SCAN ? scanRecoveries : stackRecoveries)++;
+        lastRecoveryMs = lastAdvert - stalledSince;
+        Serial.printf("%u BLE   | Recovered by restarting the %s after %lu ms\r\n", xPortGetCoreID(), tier == RECOVERY_SCAN ? "scan" : "stack", lastRecoveryMs);
+        tier = RECOVERY_NONE;
+        return;
+    }
+
+    bool stuck = scanStartFailures || !ble_hs_synced();
+    if (!stuck) {
+        if (tier == RECOVERY_NONE) {
+            stalledSince = lastAdvert;
+            tier = RECOVERY_SCAN;
+            Serial.printf("%u BLE   | No adverts for %lu ms, restarting scan\r\n", xPortGetCoreID(), now - lastAdvert);
+        }
+        pBLEScan->stop();
+        pBLEScan->clearResults();
+        restartScan(pBLEScan, false);  // If that fails the next window has its evidence
+        return;
+    }
+
+    if (tier == RECOVERY_STACK && esp_timer_get_time() / 1000000ULL > ALLOW_BLE_CONTROLLER_RESTART_AFTER_SECS) {
+        Serial.println("Bluetooth controller seems stuck, restarting");
+        ESP.restart();
+    }
+
+    if (tier == RECOVERY_NONE) stalledSince = lastAdvert;
+    tier = RECOVERY_STACK;
+    Serial.printf("%u BLE   | Controller stuck (%u failed scan starts, %s), reinitializing BLE\r\n", xPortGetCoreID(), scanStartFailures, ble_hs_synced() ? "synced" : "not synced");
+    pBLEScan->stop();
+    NimBLEDevice::deinit(true);
+    NimBLEDevice::init("ESPresense");
+    setupBle();
+    pBLEScan = startScan();
+}
+
+void scanTask(void *parameter) {
+    auto bleInit = esp_timer_get_time();
+    NimBLEDevice::init("ESPresense");
+    BootProfile::Record("NimBLEDevice::init", bleInit, esp_timer_get_time());
+    setupBle();
+    auto pBLEScan = startScan();
 
     while (true) {
+        auto started = esp_timer_get_time();
         for (auto &f : BleFingerprintCollection::fingerprints)
             if (f->query())
                 totalFpQueried++;
+        stageDuration.observe(STAGE_QUERY, esp_timer_get_time() - started);
 
         Enrollment::Loop();
+        BleFingerprintCollection::Loop();
+        if (!booted) BleFingerprintCollection::Cleanup();  // Nothing reports yet, keep the table bounded meanwhile
+        checkLiveness(pBLEScan);
 
         if (!pBLEScan->isScanning()) {
-            if (!pBLEScan->start(0, nullptr, true))
-                log_e("Error re-starting continuous ble scan");
+            restartScan(pBLEScan, true);
             delay(3000);  // If we stopped scanning, don't query for 3 seconds in order for us to catch any missed broadcasts
         } else {
             delay(100);
@@ -509,41 +729,47 @@ void setup() {
     heap_caps_register_failed_alloc_callback(heapCapsAllocFailedHook);
 
 #if M5STICK
-    AXP192::Setup();
+    BootProfile::Time("AXP192::Setup", AXP192::Setup);
 #endif
 
-    GUI::Setup(true);
-    BleFingerprintCollection::Setup();
-    SPIFFS.begin(true);
+    BootProfile::Time("GUI::Setup(true)", [] { GUI::Setup(true); });
+    BootProfile::Time("SPIFFS.begin", [] { SPIFFS.begin(true); });
+    BootProfile::Time("SettingsStore::Setup", SettingsStore::Setup);
+    BootProfile::Time("BleFingerprintCollection::Setup", BleFingerprintCollection::Setup);
+    BootProfile::Time("WarmRestart::Setup", WarmRestart::Setup);
+    BootProfile::Time("Outbox::Setup", Outbox::Setup);
+    BootProfile::Time("Events::Setup", Events::Setup);
+    BootProfile::Time("AdvertInspector::Setup", AdvertInspector::Setup);
     setupNetwork();
-    Updater::Setup();
+    BootProfile::Time("Updater::Setup", Updater::Setup);
 #if NTP
-    setClock();
+    BootProfile::Time("setClock", setClock);
 #endif
-    GUI::Setup(false);
-    Motion::Setup();
-    Switch::Setup();
-    Button::Setup();
-    Battery::Setup();
-    CAN::Setup();
+    BootProfile::Time("GUI::Setup(false)", [] { GUI::Setup(false); });
+    BootProfile::Time("Motion::Setup", Motion::Setup);
+    BootProfile::Time("Switch::Setup", Switch::Setup);
+    BootProfile::Time("Button::Setup", Button::Setup);
+    BootProfile::Time("Battery::Setup", Battery::Setup);
+    BootProfile::Time("CAN::Setup", CAN::Setup);
 #ifdef SENSORS
-    DHT::Setup();
-    I2C::Setup();
-    AHTX0::Setup();
-    BH1750::Setup();
-    BME280::Setup();
-    BMP180::Setup();
-    BMP280::Setup();
-    SHT::Setup();
-    TSL2561::Setup();
-    SensirionSGP30::Setup();
-    HX711::Setup();
-    DS18B20::Setup();
+    BootProfile::Time("DHT::Setup", DHT::Setup);
+    BootProfile::Time("I2C::Setup", I2C::Setup);
+    BootProfile::Time("AHTX0::Setup", AHTX0::Setup);
+    BootProfile::Time("BH1750::Setup", BH1750::Setup);
+    BootProfile::Time("BME280::Setup", BME280::Setup);
+    BootProfile::Time("BMP180::Setup", BMP180::Setup);
+    BootProfile::Time("BMP280::Setup", BMP280::Setup);
+    BootProfile::Time("SHT::Setup", SHT::Setup);
+    BootProfile::Time("TSL2561::Setup", TSL2561::Setup);
+    BootProfile::Time("SensirionSGP30::Setup", SensirionSGP30::Setup);
+    BootProfile::Time("HX711::Setup", HX711::Setup);
+    BootProfile::Time("DS18B20::Setup", DS18B20::Setup);
 #endif
-    xTaskCreatePinnedToCore(scanTask, "scanTask", SCAN_TASK_STACK_SIZE, nullptr, 1, &scanTaskHandle, CONFIG_BT_NIMBLE_PINNED_TO_CORE);
-    reportSetup();
+    BootProfile::Time("reportSetup", reportSetup);
+    BootProfile::Record("setup", 0, esp_timer_get_time());
     Serial.printf("Post-Setup Free Mem: %d\r\n", ESP.getFreeHeap());
     Serial.println();
+    booted = true;
 }
 
 void loop() {
@@ -560,6 +786,7 @@ void loop() {
     Switch::Loop();
     Button::Loop();
     HttpWebServer::Loop();
+    SettingsStore::Loop();
     SerialImprov::Loop(false);
 #if M5STICK
     AXP192::Loop();
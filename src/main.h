@@ -6,23 +6,34 @@
 #include <NimBLEDevice.h>
 #include <SPIFFS.h>
 #include <WiFi.h>
+#include <atomic>
 #include <freertos/FreeRTOS.h>
 #include <freertos/timers.h>
 
+#include "AdvertInspector.h"
 #include "Battery.h"
+#include "BootProfile.h"
 #include "BleFingerprint.h"
 #include "BleFingerprintCollection.h"
 #include "CAN.h"
+#include "CommandRouter.h"
 #include "Enrollment.h"
+#include "Events.h"
 #include "GUI.h"
 #include "HttpReleaseUpdate.h"
 #include "HttpWebServer.h"
+#include "JsonWriter.h"
+#include "Metrics.h"
 #include "Motion.h"
+#include "MqttReassembler.h"
 #include "Switch.h"
 #include "Button.h"
 #include "Network.h"
+#include "Outbox.h"
 #include "SerialImprov.h"
+#include "SettingsStore.h"
 #include "Updater.h"
+#include "WarmRestart.h"
 #include "defaults.h"
 #include "globals.h"
 #include "mqtt.h"
@@ -58,7 +69,20 @@ int teleFails = 0;
 int reportFailed = 0;
 bool online = false;         // Have we successfully sent status=online
 bool sentDiscovery = false;  // Have we successfully sent discovery
+size_t discoveryStep = 0;    // Next discovery step to (re)try
+uint16_t configSubscription = 0;  // Packet id of the device config subscription
 UBaseType_t bleStack = 0;
+UBaseType_t loopStack = 0;
+unsigned int scanRecoveries = 0;   // BLE stalls ended by restarting the scan
+unsigned int stackRecoveries = 0;  // ... and by reinitializing the BLE stack
+unsigned long lastRecoveryMs = 0;  // From the last advert before a stall to the first one after it
+std::atomic<bool> booted{false};  // setup() has returned and loop() reports; read by the scan task
+bool sentBootProfile = false;  // Have we published where startup time went
+
+// Milliseconds after boot each startup phase was first reached, 0 = not yet
+struct BootTimes {
+    unsigned long ble, ip, mqtt, report;
+} bootTimes = {};
 
 int ethernetType = 0;
 String mqttHost, mqttUser, mqttPass;
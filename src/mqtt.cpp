@@ -1,7 +1,10 @@
 #include "globals.h"
 #include "defaults.h"
 #include "string_utils.h"
+#include "JsonWriter.h"
+#include "Network.h"
 #include <WiFi.h>
+#include <map>
 
 bool pub(const char *topic, uint8_t qos, bool retain, const char *payload, size_t length = 0, bool dup = false, uint16_t message_id = 0)
 {
@@ -14,224 +17,314 @@ bool pub(const char *topic, uint8_t qos, bool retain, const char *payload, size_
     return false;
 }
 
-void commonDiscovery()
+// Discovery is only ever built from the loop task, so one static buffer serves every helper
+static char discoveryBuffer[DISCOVERY_BUFFER_SIZE];
+static char commonBuffer[DISCOVERY_COMMON_BUFFER_SIZE];
+static size_t commonLength = 0;
+static String commonIp, commonRoom;  // What the device block was built with
+static unsigned int discoveryBudget = 0;
+static std::map<uint32_t, uint32_t> discoveryHashes;  // topic hash -> hash of the payload last published there
+static volatile bool discoveryHashesStale = false;
+
+static uint32_t fnv1a(const char *data, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (uint8_t)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// The broker (or Home Assistant) may have lost what was published, so nothing can be skipped next time.
+// Only flags it: the hashes belong to the loop task, they are cleared when the next batch begins
+void resetDiscovery()
+{
+    discoveryHashesStale = true;
+}
+
+void beginDiscoveryBatch(unsigned int publishes)
+{
+    if (discoveryHashesStale)
+    {
+        discoveryHashesStale = false;
+        discoveryHashes.clear();
+    }
+    discoveryBudget = publishes;
+}
+
+// Publishes once without retrying; returns true without publishing when the broker already has this exact payload
+static bool pubDiscovery(const String &topic, const char *payload, size_t length)
+{
+    auto key = fnv1a(topic.c_str(), topic.length());
+    auto hash = fnv1a(payload, length);
+    auto it = discoveryHashes.find(key);
+    if (it != discoveryHashes.end() && it->second == hash) return true;
+    if (discoveryBudget == 0) return false;
+    discoveryBudget--;
+    if (!mqttClient.publish(topic.c_str(), 0, true, payload, length)) return false;
+    discoveryHashes[key] = hash;
+    return true;
+}
+
+// An entity that doesn't fit never will, so it is logged and skipped (true) rather than retried every loop;
+// false is kept for running out of budget or a failed publish, which the next loop resumes
+static bool pubRetained(const String &topic, const JsonWriter &doc)
 {
-    doc.clear();
-    auto identifiers = doc["dev"].createNestedArray("ids");
-    identifiers.add(Sprintf("espresense_%06x", CHIPID));
-    auto connections = doc["dev"].createNestedArray("cns");
-    auto mac = connections.createNestedArray();
-    mac.add("mac");
-    mac.add(WiFi.macAddress());
-    doc["dev"]["name"] = "ESPresense " + room;
-    doc["dev"]["sa"] = room;
+    if (doc.overflowed())
+    {
+        log_e("Discovery for %s larger than %d bytes, skipped", topic.c_str(), DISCOVERY_BUFFER_SIZE);
+        return true;
+    }
+    return pubDiscovery(topic, doc.c_str(), doc.length());
+}
+
+// Rebuilt whenever the address or room changes; false when it doesn't fit, so nothing malformed is published.
+// That can't fix itself either, so the helpers below skip their entity (return true) like pubRetained does
+bool commonDiscovery(JsonWriter &doc)
+{
+    auto ip = Network.localIP().toString();
+    if (!commonLength || ip != commonIp || room != commonRoom)
+    {
+        commonLength = 0;
+        JsonWriter dev(commonBuffer, sizeof(commonBuffer));
+        dev.beginObject();
+        dev.beginArray("ids").add(Sprintf("espresense_%06x", CHIPID)).endArray();
+        dev.beginArray("cns").beginArray().add("mac").add(WiFi.macAddress()).endArray().endArray();
+        dev.add("name", "ESPresense " + room);
+        dev.add("sa", room);
 #ifdef VERSION
-    doc["dev"]["sw"] = VERSION;
+        dev.add("sw", VERSION);
 #endif
 #ifdef FIRMWARE
-    doc["dev"]["mf"] = "ESPresense (" FIRMWARE ")";
+        dev.add("mf", "ESPresense (" FIRMWARE ")");
 #endif
-    doc["dev"]["cu"] = "http://" + localIp;
-    doc["dev"]["mdl"] = String(ESP.getChipModel());
+        dev.add("cu", "http://" + ip);
+        dev.add("mdl", ESP.getChipModel());
+        dev.endObject();
+        if (dev.overflowed())
+        {
+            log_e("Discovery device block larger than %d bytes", DISCOVERY_COMMON_BUFFER_SIZE);
+            return false;
+        }
+        commonLength = dev.length();
+        commonIp = ip;
+        commonRoom = room;
+    }
+    doc.addRaw("dev", commonBuffer, commonLength);
+    return true;
 }
 
 bool sendConnectivityDiscovery()
 {
-    commonDiscovery();
-    doc["~"] = roomsTopic;
-    doc["name"] = "Connectivity";
-    doc["uniq_id"] = Sprintf("espresense_%06x_connectivity", CHIPID);
-    doc["json_attr_t"] = "~/telemetry";
-    doc["stat_t"] = "~/status";
-    doc["dev_cla"] = "connectivity";
-    doc["pl_on"] = "online";
-    doc["pl_off"] = "offline";
-
-    String buffer = String();
-    serializeJson(doc, buffer);
+    JsonWriter doc(discoveryBuffer, sizeof(discoveryBuffer));
+    doc.beginObject();
+    if (!commonDiscovery(doc)) return true;
+    doc.add("~", roomsTopic);
+    doc.add("name", "Connectivity");
+    doc.add("uniq_id", Sprintf("espresense_%06x_connectivity", CHIPID));
+    doc.add("json_attr_t", "~/telemetry");
+    doc.add("stat_t", "~/status");
+    doc.add("dev_cla", "connectivity");
+    doc.add("pl_on", "online");
+    doc.add("pl_off", "offline");
+    doc.endObject();
+
     const String discoveryTopic = Sprintf("%s/binary_sensor/espresense_%06x/connectivity/config", homeAssistantDiscoveryPrefix.c_str(), CHIPID);
-    return pub(discoveryTopic.c_str(), 0, true, buffer.c_str());
+    return pubRetained(discoveryTopic, doc);
 }
 
 bool sendTeleBinarySensorDiscovery(const String &name, const String &entityCategory, const String &temp, const String &devClass = "")
 {
     auto slug = slugify(name);
 
-    commonDiscovery();
-    doc["~"] = roomsTopic;
-    doc["name"] = name;
-    doc["uniq_id"] = Sprintf("espresense_%06x_%s", CHIPID, slug.c_str());
-    doc["avty_t"] = "~/status";
-    doc["stat_t"] = "~/telemetry";
-    doc["value_template"] = temp;
-    if (!entityCategory.isEmpty()) doc["entity_category"] = entityCategory;
-    if (!devClass.isEmpty()) doc["dev_cla"] = devClass;
-
-    String buffer = String();
-    serializeJson(doc, buffer);
+    JsonWriter doc(discoveryBuffer, sizeof(discoveryBuffer));
+    doc.beginObject();
+    if (!commonDiscovery(doc)) return true;
+    doc.add("~", roomsTopic);
+    doc.add("name", name);
+    doc.add("uniq_id", Sprintf("espresense_%06x_%s", CHIPID, slug.c_str()));
+    doc.add("avty_t", "~/status");
+    doc.add("stat_t", "~/telemetry");
+    doc.add("value_template", temp);
+    if (!entityCategory.isEmpty()) doc.add("entity_category", entityCategory);
+    if (!devClass.isEmpty()) doc.add("dev_cla", devClass);
+    doc.endObject();
+
     const String discoveryTopic = Sprintf("%s/binary_sensor/espresense_%06x/%s/config", homeAssistantDiscoveryPrefix.c_str(), CHIPID, slug.c_str());
-    return pub(discoveryTopic.c_str(), 0, true, buffer.c_str());
+    return pubRetained(discoveryTopic, doc);
 }
 
 bool sendTeleSensorDiscovery(const String &name, const String &entityCategory, const String &temp, const String &devClass = "", const String &units = "")
 {
     auto slug = slugify(name);
 
-    commonDiscovery();
-    doc["~"] = roomsTopic;
-    doc["name"] = name;
-    doc["uniq_id"] = Sprintf("espresense_%06x_%s", CHIPID, slug.c_str());
-    doc["avty_t"] = "~/status";
-    doc["stat_t"] = "~/telemetry";
-    doc["value_template"] = temp;
-    if (!entityCategory.isEmpty()) doc["entity_category"] = entityCategory;
-    if (!units.isEmpty()) doc["unit_of_meas"] = units;
-    if (!devClass.isEmpty()) doc["dev_cla"] = devClass;
-
-    String buffer = String();
-    serializeJson(doc, buffer);
+    JsonWriter doc(discoveryBuffer, sizeof(discoveryBuffer));
+    doc.beginObject();
+    if (!commonDiscovery(doc)) return true;
+    doc.add("~", roomsTopic);
+    doc.add("name", name);
+    doc.add("uniq_id", Sprintf("espresense_%06x_%s", CHIPID, slug.c_str()));
+    doc.add("avty_t", "~/status");
+    doc.add("stat_t", "~/telemetry");
+    doc.add("value_template", temp);
+    if (!entityCategory.isEmpty()) doc.add("entity_category", entityCategory);
+    if (!units.isEmpty()) doc.add("unit_of_meas", units);
+    if (!devClass.isEmpty()) doc.add("dev_cla", devClass);
+    doc.endObject();
+
     const String discoveryTopic = Sprintf("%s/sensor/espresense_%06x/%s/config", homeAssistantDiscoveryPrefix.c_str(),CHIPID, slug.c_str());
-    return pub(discoveryTopic.c_str(), 0, true, buffer.c_str());
+    return pubRetained(discoveryTopic, doc);
 }
 
 bool sendSensorDiscovery(const String &name, const String &entityCategory, const String &devClass = "", const String &units = "", bool frcUpdate = true)
 {
     auto slug = slugify(name);
 
-    commonDiscovery();
-    doc["~"] = roomsTopic;
-    doc["name"] = name;
-    doc["uniq_id"] = Sprintf("espresense_%06x_%s", CHIPID, slug.c_str());
-    doc["avty_t"] = "~/status";
-    doc["stat_t"] = "~/" + slug;
-    if (!entityCategory.isEmpty()) doc["entity_category"] = entityCategory;
-    if (!units.isEmpty()) doc["unit_of_meas"] = units;
-    if (!devClass.isEmpty()) doc["dev_cla"] = devClass;
-    doc["frc_upd"] = frcUpdate;
-
-    String buffer = String();
-    serializeJson(doc, buffer);
+    JsonWriter doc(discoveryBuffer, sizeof(discoveryBuffer));
+    doc.beginObject();
+    if (!commonDiscovery(doc)) return true;
+    doc.add("~", roomsTopic);
+    doc.add("name", name);
+    doc.add("uniq_id", Sprintf("espresense_%06x_%s", CHIPID, slug.c_str()));
+    doc.add("avty_t", "~/status");
+    doc.add("stat_t", "~/" + slug);
+    if (!entityCategory.isEmpty()) doc.add("entity_category", entityCategory);
+    if (!units.isEmpty()) doc.add("unit_of_meas", units);
+    if (!devClass.isEmpty()) doc.add("dev_cla", devClass);
+    doc.add("frc_upd", frcUpdate);
+    doc.endObject();
+
     const String discoveryTopic = Sprintf("%s/sensor/espresense_%06x/%s/config", homeAssistantDiscoveryPrefix.c_str(), CHIPID, slug.c_str());
-    return pub(discoveryTopic.c_str(), 0, true, buffer.c_str());
+    return pubRetained(discoveryTopic, doc);
 }
 
 bool sendBinarySensorDiscovery(const String &name, const String &entityCategory, const String &devClass = "")
 {
     auto slug = slugify(name);
 
-    commonDiscovery();
-    doc["~"] = roomsTopic;
-    doc["name"] = name;
-    doc["uniq_id"] = Sprintf("espresense_%06x_%s", CHIPID, slug.c_str());
-    doc["avty_t"] = "~/status";
-    doc["stat_t"] = "~/" + slug;
-    if (!entityCategory.isEmpty()) doc["entity_category"] = entityCategory;
-    if (!devClass.isEmpty()) doc["dev_cla"] = devClass;
-
-    String buffer = String();
-    serializeJson(doc, buffer);
+    JsonWriter doc(discoveryBuffer, sizeof(discoveryBuffer));
+    doc.beginObject();
+    if (!commonDiscovery(doc)) return true;
+    doc.add("~", roomsTopic);
+    doc.add("name", name);
+    doc.add("uniq_id", Sprintf("espresense_%06x_%s", CHIPID, slug.c_str()));
+    doc.add("avty_t", "~/status");
+    doc.add("stat_t", "~/" + slug);
+    if (!entityCategory.isEmpty()) doc.add("entity_category", entityCategory);
+    if (!devClass.isEmpty()) doc.add("dev_cla", devClass);
+    doc.endObject();
+
     const String discoveryTopic = Sprintf("%s/binary_sensor/espresense_%06x/%s/config", homeAssistantDiscoveryPrefix.c_str(), CHIPID, slug.c_str());
-    return pub(discoveryTopic.c_str(), 0, true, buffer.c_str());
+    return pubRetained(discoveryTopic, doc);
 }
 
 bool sendButtonDiscovery(const String &name, const String &entityCategory)
 {
     auto slug = slugify(name);
 
-    commonDiscovery();
-    doc["~"] = roomsTopic;
-    doc["name"] = name;
-    doc["uniq_id"] = Sprintf("espresense_%06x_%s", CHIPID, slug.c_str());
-    doc["avty_t"] = "~/status";
-    doc["stat_t"] = "~/" + slug;
-    doc["cmd_t"] = "~/" + slug + "/set";
-    if (!entityCategory.isEmpty()) doc["entity_category"] = entityCategory;
-
-    String buffer = String();
-    serializeJson(doc, buffer);
+    JsonWriter doc(discoveryBuffer, sizeof(discoveryBuffer));
+    doc.beginObject();
+    if (!commonDiscovery(doc)) return true;
+    doc.add("~", roomsTopic);
+    doc.add("name", name);
+    doc.add("uniq_id", Sprintf("espresense_%06x_%s", CHIPID, slug.c_str()));
+    doc.add("avty_t", "~/status");
+    doc.add("stat_t", "~/" + slug);
+    doc.add("cmd_t", "~/" + slug + "/set");
+    if (!entityCategory.isEmpty()) doc.add("entity_category", entityCategory);
+    doc.endObject();
+
     const String discoveryTopic = Sprintf("%s/button/espresense_%06x/%s/config", homeAssistantDiscoveryPrefix.c_str(), CHIPID, slug.c_str());
-    return pub(discoveryTopic.c_str(), 0, true, buffer.c_str());
+    return pubRetained(discoveryTopic, doc);
 }
 
 bool sendSwitchDiscovery(const String &name, const String &entityCategory)
 {
     auto slug = slugify(name);
 
-    commonDiscovery();
-    doc["~"] = roomsTopic;
-    doc["name"] = name;
-    doc["uniq_id"] = Sprintf("espresense_%06x_%s", CHIPID, slug.c_str());
-    doc["avty_t"] = "~/status";
-    doc["stat_t"] = "~/" + slug;
-    doc["cmd_t"] = "~/" + slug + "/set";
-    doc["entity_category"] = entityCategory;
-
-    String buffer = String();
-    serializeJson(doc, buffer);
+    JsonWriter doc(discoveryBuffer, sizeof(discoveryBuffer));
+    doc.beginObject();
+    if (!commonDiscovery(doc)) return true;
+    doc.add("~", roomsTopic);
+    doc.add("name", name);
+    doc.add("uniq_id", Sprintf("espresense_%06x_%s", CHIPID, slug.c_str()));
+    doc.add("avty_t", "~/status");
+    doc.add("stat_t", "~/" + slug);
+    doc.add("cmd_t", "~/" + slug + "/set");
+    doc.add("entity_category", entityCategory);
+    doc.endObject();
+
     String discoveryTopic = Sprintf("%s/switch/espresense_%06x/%s/config", homeAssistantDiscoveryPrefix.c_str(), CHIPID, slug.c_str());
-    return pub(discoveryTopic.c_str(), 0, true, buffer.c_str(), 0);
+    return pubRetained(discoveryTopic, doc);
 }
 
 bool sendNumberDiscovery(const String &name, const String &entityCategory)
 {
     auto slug = slugify(name);
 
-    commonDiscovery();
-    doc["~"] = roomsTopic;
-    doc["name"] = name;
-    doc["uniq_id"] = Sprintf("espresense_%06x_%s", CHIPID, slug.c_str());
-    doc["avty_t"] = "~/status";
-    doc["stat_t"] = "~/" + slug;
-    doc["cmd_t"] = "~/" + slug + "/set";
-    doc["step"] = "0.1";
-    if (!entityCategory.isEmpty()) doc["entity_category"] = entityCategory;
-
-    String buffer = String();
-    serializeJson(doc, buffer);
+    JsonWriter doc(discoveryBuffer, sizeof(discoveryBuffer));
+    doc.beginObject();
+    if (!commonDiscovery(doc)) return true;
+    doc.add("~", roomsTopic);
+    doc.add("name", name);
+    doc.add("uniq_id", Sprintf("espresense_%06x_%s", CHIPID, slug.c_str()));
+    doc.add("avty_t", "~/status");
+    doc.add("stat_t", "~/" + slug);
+    doc.add("cmd_t", "~/" + slug + "/set");
+    doc.add("step", "0.1");
+    if (!entityCategory.isEmpty()) doc.add("entity_category", entityCategory);
+    doc.endObject();
+
     const String discoveryTopic = Sprintf("%s/number/espresense_%06x/%s/config", homeAssistantDiscoveryPrefix.c_str(), CHIPID, slug.c_str());
-    return pub(discoveryTopic.c_str(), 0, true, buffer.c_str());
+    return pubRetained(discoveryTopic, doc);
 }
 
 bool sendLightDiscovery(const String &name, const String &entityCategory, bool rgb)
 {
     auto slug = slugify(name);
 
-    commonDiscovery();
-    doc["~"] = roomsTopic;
-    doc["name"] = name;
-    doc["uniq_id"] = Sprintf("espresense_%06x_%s", CHIPID, slug.c_str());
-    doc["schema"] = "json";
-    doc["stat_t"] = "~/" + slug;
-    doc["cmd_t"] = "~/" + slug + "/set";
-    doc["brightness"] = true;
-    doc["rgb"] = rgb;
-    if (!entityCategory.isEmpty()) doc["entity_category"] = entityCategory;
-
-    String buffer = String();
-    serializeJson(doc, buffer);
+    JsonWriter doc(discoveryBuffer, sizeof(discoveryBuffer));
+    doc.beginObject();
+    if (!commonDiscovery(doc)) return true;
+    doc.add("~", roomsTopic);
+    doc.add("name", name);
+    doc.add("uniq_id", Sprintf("espresense_%06x_%s", CHIPID, slug.c_str()));
+    doc.add("schema", "json");
+    doc.add("stat_t", "~/" + slug);
+    doc.add("cmd_t", "~/" + slug + "/set");
+    doc.add("brightness", true);
+    doc.add("rgb", rgb);
+    if (!entityCategory.isEmpty()) doc.add("entity_category", entityCategory);
+    doc.endObject();
+
     const String discoveryTopic = Sprintf("%s/light/espresense_%06x/%s/config", homeAssistantDiscoveryPrefix.c_str(), CHIPID, slug.c_str());
-    return pub(discoveryTopic.c_str(), 0, true, buffer.c_str());
+    return pubRetained(discoveryTopic, doc);
 }
 
 bool sendDeleteDiscovery(const String &domain, const String &name)
 {
     auto slug = slugify(name);
     const String discoveryTopic = Sprintf("%s/%s/espresense_%06x/%s/config", homeAssistantDiscoveryPrefix.c_str(), domain.c_str(), CHIPID, slug.c_str());
-    return pub(discoveryTopic.c_str(), 0, false, "");
+    return pubDiscovery(discoveryTopic, "", 0);
 }
 
 
 bool sendConfig(const String &id, const String &alias, const String &name = "", int calRssi = -128)
 {
     Serial.printf("%u Alias  | %s to %s\r\n", xPortGetCoreID(), id.c_str(), alias.c_str());
-    doc.clear();
-    doc["id"] = alias;
-    doc["name"] = name;
-    if (calRssi > -128) doc["rssi@1m"] = calRssi;
-    String buffer = String();
-    serializeJson(doc, buffer);
+    // Called from the scan and web tasks too, so this one can't share discoveryBuffer
+    char buffer[256];
+    JsonWriter doc(buffer, sizeof(buffer));
+    doc.beginObject();
+    doc.add("id", alias);
+    doc.add("name", name);
+    if (calRssi > -128) doc.add("rssi@1m", calRssi);
+    doc.endObject();
+    if (doc.overflowed()) return false;
     const String settingsTopic = CHANNEL + String("/settings/") + id + "/config";
-    return pub(settingsTopic.c_str(), 0, true, buffer.c_str());
+    return pub(settingsTopic.c_str(), 0, true, doc.c_str(), doc.length());
 }
 
 bool deleteConfig(const String &id)
@@ -1,6 +1,8 @@
 #pragma once
 #include <Arduino.h>
 
+#include "JsonWriter.h"
+
 const char *const EC_DIAGNOSTIC = "diagnostic";
 const char *const EC_CONFIG = "config";
 const char *const EC_NONE = "";
@@ -8,7 +10,9 @@ const char *const EC_NONE = "";
 static const char *const DEVICE_CLASS_NONE = "";
 
 bool pub(const char *topic, uint8_t qos, bool retain, const char *payload, size_t length = 0, bool dup = false, uint16_t message_id = 0);
-void commonDiscovery();
+bool commonDiscovery(JsonWriter &doc);
+void beginDiscoveryBatch(unsigned int publishes);
+void resetDiscovery();
 
 bool sendConnectivityDiscovery();
 
@@ -3,7 +3,6 @@
  */
 
 #pragma once
-#include <ESPAsyncWebServer.h>
 #include <Arduino.h>
 
 // app/immutable/assets/index.DN2mWWgh.css
@@ -288,12 +287,6 @@ const uint8_t APP_IMMUTABLE_ASSETS_INDEX_DN2MWWGH_CSS[] PROGMEM = {
   0x61, 0x00, 0x00
 };
 
-inline void serveAppImmutableAssetsIndexDn2mWWghCss(AsyncWebServerRequest* request) {
-  AsyncWebServerResponse *response = request->beginResponse_P(200, "text/css", APP_IMMUTABLE_ASSETS_INDEX_DN2MWWGH_CSS, APP_IMMUTABLE_ASSETS_INDEX_DN2MWWGH_CSS_L);
-  response->addHeader(F("Content-Encoding"), "gzip");
-  request->send(response);
-}
-
 // app/immutable/assets/index.BfkQNPT2.css
 const uint16_t APP_IMMUTABLE_ASSETS_INDEX_BFKQNPT2_CSS_L = 4454;
 const uint8_t APP_IMMUTABLE_ASSETS_INDEX_BFKQNPT2_CSS[] PROGMEM = {
@@ -578,9 +571,3 @@ const uint8_t APP_IMMUTABLE_ASSETS_INDEX_BFKQNPT2_CSS[] PROGMEM = {
   0xc0, 0xf0, 0xa9, 0x63, 0x00, 0x00
 };
 
-inline void serveAppImmutableAssetsIndexBfkQnpt2Css(AsyncWebServerRequest* request) {
-  AsyncWebServerResponse *response = request->beginResponse_P(200, "text/css", APP_IMMUTABLE_ASSETS_INDEX_BFKQNPT2_CSS, APP_IMMUTABLE_ASSETS_INDEX_BFKQNPT2_CSS_L);
-  response->addHeader(F("Content-Encoding"), "gzip");
-  request->send(response);
-}
-
@@ -3,7 +3,6 @@
  */
 
 #pragma once
-#include <ESPAsyncWebServer.h>
 #include <Arduino.h>
 
 // app/immutable/chunks/DfKMpNM3.js
@@ -2782,9 +2781,3 @@ const uint8_t APP_IMMUTABLE_CHUNKS_DFKMPNM3_JS[] PROGMEM = {
   0xce, 0x8e, 0xad, 0x8b, 0x6b, 0x41, 0x02, 0x00
 };
 
-inline void serveAppImmutableChunksDfKMpNm3Js(AsyncWebServerRequest* request) {
-  AsyncWebServerResponse *response = request->beginResponse_P(200, "application/javascript", APP_IMMUTABLE_CHUNKS_DFKMPNM3_JS, APP_IMMUTABLE_CHUNKS_DFKMPNM3_JS_L);
-  response->addHeader(F("Content-Encoding"), "gzip");
-  request->send(response);
-}
-
@@ -3,7 +3,6 @@
  */
 
 #pragma once
-#include <ESPAsyncWebServer.h>
 #include <Arduino.h>
 
 // app/immutable/entry/app.f1xA8tYB.js
@@ -22,12 +21,6 @@ const uint8_t APP_IMMUTABLE_ENTRY_APP_F1XA8TYB_JS[] PROGMEM = {
   0x00, 0x00
 };
 
-inline void serveAppImmutableEntryAppF1xA8tYbJs(AsyncWebServerRequest* request) {
-  AsyncWebServerResponse *response = request->beginResponse_P(200, "application/javascript", APP_IMMUTABLE_ENTRY_APP_F1XA8TYB_JS, APP_IMMUTABLE_ENTRY_APP_F1XA8TYB_JS_L);
-  response->addHeader(F("Content-Encoding"), "gzip");
-  request->send(response);
-}
-
 // app/immutable/entry/start.DWUfuLlk.js
 const uint16_t APP_IMMUTABLE_ENTRY_START_DWUFULLK_JS_L = 62;
 const uint8_t APP_IMMUTABLE_ENTRY_START_DWUFULLK_JS[] PROGMEM = {
@@ -37,8 +30,3 @@ const uint8_t APP_IMMUTABLE_ENTRY_START_DWUFULLK_JS[] PROGMEM = {
   0x7b, 0x74, 0x20, 0x61, 0x73, 0x20, 0x73, 0x74, 0x61, 0x72, 0x74, 0x7d, 0x3b, 0x0a
 };
 
-inline void serveAppImmutableEntryStartDwUfuLlkJs(AsyncWebServerRequest* request) {
-  AsyncWebServerResponse *response = request->beginResponse_P(200, "application/javascript", APP_IMMUTABLE_ENTRY_START_DWUFULLK_JS, APP_IMMUTABLE_ENTRY_START_DWUFULLK_JS_L);
-  request->send(response);
-}
-
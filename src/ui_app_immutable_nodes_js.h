@@ -3,7 +3,6 @@
  */
 
 #pragma once
-#include <ESPAsyncWebServer.h>
 #include <Arduino.h>
 
 // app/immutable/nodes/0.BpUMrsxe.js
@@ -17,11 +16,6 @@ const uint8_t APP_IMMUTABLE_NODES_0_BPUMRSXE_JS[] PROGMEM = {
   0x65, 0x72, 0x73, 0x61, 0x6c, 0x7d, 0x3b, 0x0a
 };
 
-inline void serveAppImmutableNodes_0BpUMrsxeJs(AsyncWebServerRequest* request) {
-  AsyncWebServerResponse *response = request->beginResponse_P(200, "application/javascript", APP_IMMUTABLE_NODES_0_BPUMRSXE_JS, APP_IMMUTABLE_NODES_0_BPUMRSXE_JS_L);
-  request->send(response);
-}
-
 // app/immutable/nodes/1.FH0nAYsZ.js
 const uint16_t APP_IMMUTABLE_NODES_1_FH0NAYSZ_JS_L = 66;
 const uint8_t APP_IMMUTABLE_NODES_1_FH0NAYSZ_JS[] PROGMEM = {
@@ -32,11 +26,6 @@ const uint8_t APP_IMMUTABLE_NODES_1_FH0NAYSZ_JS[] PROGMEM = {
   0x3b, 0x0a
 };
 
-inline void serveAppImmutableNodes_1Fh0nAYsZJs(AsyncWebServerRequest* request) {
-  AsyncWebServerResponse *response = request->beginResponse_P(200, "application/javascript", APP_IMMUTABLE_NODES_1_FH0NAYSZ_JS, APP_IMMUTABLE_NODES_1_FH0NAYSZ_JS_L);
-  request->send(response);
-}
-
 // app/immutable/nodes/2.B9h3vkVi.js
 const uint16_t APP_IMMUTABLE_NODES_2_B9H3VKVI_JS_L = 66;
 const uint8_t APP_IMMUTABLE_NODES_2_B9H3VKVI_JS[] PROGMEM = {
@@ -47,11 +36,6 @@ const uint8_t APP_IMMUTABLE_NODES_2_B9H3VKVI_JS[] PROGMEM = {
   0x3b, 0x0a
 };
 
-inline void serveAppImmutableNodes_2B9h3vkViJs(AsyncWebServerRequest* request) {
-  AsyncWebServerResponse *response = request->beginResponse_P(200, "application/javascript", APP_IMMUTABLE_NODES_2_B9H3VKVI_JS, APP_IMMUTABLE_NODES_2_B9H3VKVI_JS_L);
-  request->send(response);
-}
-
 // app/immutable/nodes/3.DNSqvfMd.js
 const uint16_t APP_IMMUTABLE_NODES_3_DNSQVFMD_JS_L = 66;
 const uint8_t APP_IMMUTABLE_NODES_3_DNSQVFMD_JS[] PROGMEM = {
@@ -62,11 +46,6 @@ const uint8_t APP_IMMUTABLE_NODES_3_DNSQVFMD_JS[] PROGMEM = {
   0x3b, 0x0a
 };
 
-inline void serveAppImmutableNodes_3DnSqvfMdJs(AsyncWebServerRequest* request) {
-  AsyncWebServerResponse *response = request->beginResponse_P(200, "application/javascript", APP_IMMUTABLE_NODES_3_DNSQVFMD_JS, APP_IMMUTABLE_NODES_3_DNSQVFMD_JS_L);
-  request->send(response);
-}
-
 // app/immutable/nodes/4.Ci0Xog3L.js
 const uint16_t APP_IMMUTABLE_NODES_4_CI0XOG3L_JS_L = 66;
 const uint8_t APP_IMMUTABLE_NODES_4_CI0XOG3L_JS[] PROGMEM = {
@@ -77,11 +56,6 @@ const uint8_t APP_IMMUTABLE_NODES_4_CI0XOG3L_JS[] PROGMEM = {
   0x3b, 0x0a
 };
 
-inline void serveAppImmutableNodes_4Ci0Xog3LJs(AsyncWebServerRequest* request) {
-  AsyncWebServerResponse *response = request->beginResponse_P(200, "application/javascript", APP_IMMUTABLE_NODES_4_CI0XOG3L_JS, APP_IMMUTABLE_NODES_4_CI0XOG3L_JS_L);
-  request->send(response);
-}
-
 // app/immutable/nodes/5.Do1_zzRQ.js
 const uint16_t APP_IMMUTABLE_NODES_5_DO1_ZZRQ_JS_L = 66;
 const uint8_t APP_IMMUTABLE_NODES_5_DO1_ZZRQ_JS[] PROGMEM = {
@@ -92,11 +66,6 @@ const uint8_t APP_IMMUTABLE_NODES_5_DO1_ZZRQ_JS[] PROGMEM = {
   0x3b, 0x0a
 };
 
-inline void serveAppImmutableNodes_5Do1ZzRqJs(AsyncWebServerRequest* request) {
-  AsyncWebServerResponse *response = request->beginResponse_P(200, "application/javascript", APP_IMMUTABLE_NODES_5_DO1_ZZRQ_JS, APP_IMMUTABLE_NODES_5_DO1_ZZRQ_JS_L);
-  request->send(response);
-}
-
 // app/immutable/nodes/6.D7KGf8V1.js
 const uint16_t APP_IMMUTABLE_NODES_6_D7KGF8V1_JS_L = 66;
 const uint8_t APP_IMMUTABLE_NODES_6_D7KGF8V1_JS[] PROGMEM = {
@@ -107,8 +76,3 @@ const uint8_t APP_IMMUTABLE_NODES_6_D7KGF8V1_JS[] PROGMEM = {
   0x3b, 0x0a
 };
 
-inline void serveAppImmutableNodes_6D7KGf8V1Js(AsyncWebServerRequest* request) {
-  AsyncWebServerResponse *response = request->beginResponse_P(200, "application/javascript", APP_IMMUTABLE_NODES_6_D7KGF8V1_JS, APP_IMMUTABLE_NODES_6_D7KGF8V1_JS_L);
-  request->send(response);
-}
-
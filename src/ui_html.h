@@ -3,7 +3,6 @@
  */
 
 #pragma once
-#include <ESPAsyncWebServer.h>
 #include <Arduino.h>
 
 // devices.html
@@ -54,12 +53,6 @@ const uint8_t DEVICES_HTML[] PROGMEM = {
   0x00
 };
 
-inline void serveDevicesHtml(AsyncWebServerRequest* request) {
-  AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", DEVICES_HTML, DEVICES_HTML_L);
-  response->addHeader(F("Content-Encoding"), "gzip");
-  request->send(response);
-}
-
 // fingerprints.html
 const uint16_t FINGERPRINTS_HTML_L = 673;
 const uint8_t FINGERPRINTS_HTML[] PROGMEM = {
@@ -108,12 +101,6 @@ const uint8_t FINGERPRINTS_HTML[] PROGMEM = {
   0x00
 };
 
-inline void serveFingerprintsHtml(AsyncWebServerRequest* request) {
-  AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", FINGERPRINTS_HTML, FINGERPRINTS_HTML_L);
-  response->addHeader(F("Content-Encoding"), "gzip");
-  request->send(response);
-}
-
 // index.html
 const uint16_t INDEX_HTML_L = 673;
 const uint8_t INDEX_HTML[] PROGMEM = {
@@ -162,12 +149,6 @@ const uint8_t INDEX_HTML[] PROGMEM = {
   0x00
 };
 
-inline void serveIndexHtml(AsyncWebServerRequest* request) {
-  AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", INDEX_HTML, INDEX_HTML_L);
-  response->addHeader(F("Content-Encoding"), "gzip");
-  request->send(response);
-}
-
 // network.html
 const uint16_t NETWORK_HTML_L = 673;
 const uint8_t NETWORK_HTML[] PROGMEM = {
@@ -216,12 +197,6 @@ const uint8_t NETWORK_HTML[] PROGMEM = {
   0x00
 };
 
-inline void serveNetworkHtml(AsyncWebServerRequest* request) {
-  AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", NETWORK_HTML, NETWORK_HTML_L);
-  response->addHeader(F("Content-Encoding"), "gzip");
-  request->send(response);
-}
-
 // settings.html
 const uint16_t SETTINGS_HTML_L = 673;
 const uint8_t SETTINGS_HTML[] PROGMEM = {
@@ -270,9 +245,3 @@ const uint8_t SETTINGS_HTML[] PROGMEM = {
   0x00
 };
 
-inline void serveSettingsHtml(AsyncWebServerRequest* request) {
-  AsyncWebServerResponse *response = request->beginResponse_P(200, "text/html", SETTINGS_HTML, SETTINGS_HTML_L);
-  response->addHeader(F("Content-Encoding"), "gzip");
-  request->send(response);
-}
-
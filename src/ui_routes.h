@@ -14,6 +14,7 @@
 #pragma once
 
 #include <ESPAsyncWebServer.h>
+#include "AssetHandler.h"
 #include "ui_app_immutable_assets_css.h"
 #include "ui_html.h"
 #include "ui_app_immutable_chunks_js.h"
@@ -21,28 +22,32 @@
 #include "ui_app_immutable_nodes_js.h"
 #include "ui_svg.h"
 
+// Sorted by path
+const Asset uiAssets[] = {
+    {"/", "text/html", INDEX_HTML, INDEX_HTML_L, true, false, "\"ae63aeeafb88d830\""},
+    {"/app/immutable/assets/index.BfkQNPT2.css", "text/css", APP_IMMUTABLE_ASSETS_INDEX_BFKQNPT2_CSS, APP_IMMUTABLE_ASSETS_INDEX_BFKQNPT2_CSS_L, true, true, "\"694e93d7ae14acfc\""},
+    {"/app/immutable/assets/index.DN2mWWgh.css", "text/css", APP_IMMUTABLE_ASSETS_INDEX_DN2MWWGH_CSS, APP_IMMUTABLE_ASSETS_INDEX_DN2MWWGH_CSS_L, true, true, "\"6ffe63b14321030b\""},
+    {"/app/immutable/chunks/DfKMpNM3.js", "application/javascript", APP_IMMUTABLE_CHUNKS_DFKMPNM3_JS, APP_IMMUTABLE_CHUNKS_DFKMPNM3_JS_L, true, true, "\"55eda025b845fae8\""},
+    {"/app/immutable/entry/app.f1xA8tYB.js", "application/javascript", APP_IMMUTABLE_ENTRY_APP_F1XA8TYB_JS, APP_IMMUTABLE_ENTRY_APP_F1XA8TYB_JS_L, true, true, "\"3909eda596854cb2\""},
+    {"/app/immutable/entry/start.DWUfuLlk.js", "application/javascript", APP_IMMUTABLE_ENTRY_START_DWUFULLK_JS, APP_IMMUTABLE_ENTRY_START_DWUFULLK_JS_L, false, true, "\"12c77805fffe1a7c\""},
+    {"/app/immutable/nodes/0.BpUMrsxe.js", "application/javascript", APP_IMMUTABLE_NODES_0_BPUMRSXE_JS, APP_IMMUTABLE_NODES_0_BPUMRSXE_JS_L, false, true, "\"1425c38de4c47b42\""},
+    {"/app/immutable/nodes/1.FH0nAYsZ.js", "application/javascript", APP_IMMUTABLE_NODES_1_FH0NAYSZ_JS, APP_IMMUTABLE_NODES_1_FH0NAYSZ_JS_L, false, true, "\"ec0ce9e71b786229\""},
+    {"/app/immutable/nodes/2.B9h3vkVi.js", "application/javascript", APP_IMMUTABLE_NODES_2_B9H3VKVI_JS, APP_IMMUTABLE_NODES_2_B9H3VKVI_JS_L, false, true, "\"9bee0738f5b26769\""},
+    {"/app/immutable/nodes/3.DNSqvfMd.js", "application/javascript", APP_IMMUTABLE_NODES_3_DNSQVFMD_JS, APP_IMMUTABLE_NODES_3_DNSQVFMD_JS_L, false, true, "\"2889a72f8fa20bb6\""},
+    {"/app/immutable/nodes/4.Ci0Xog3L.js", "application/javascript", APP_IMMUTABLE_NODES_4_CI0XOG3L_JS, APP_IMMUTABLE_NODES_4_CI0XOG3L_JS_L, false, true, "\"b2b253e5c40117ee\""},
+    {"/app/immutable/nodes/5.Do1_zzRQ.js", "application/javascript", APP_IMMUTABLE_NODES_5_DO1_ZZRQ_JS, APP_IMMUTABLE_NODES_5_DO1_ZZRQ_JS_L, false, true, "\"9e16b5d0f8ccfd4a\""},
+    {"/app/immutable/nodes/6.D7KGf8V1.js", "application/javascript", APP_IMMUTABLE_NODES_6_D7KGF8V1_JS, APP_IMMUTABLE_NODES_6_D7KGF8V1_JS_L, false, true, "\"3134490546cdd7e9\""},
+    {"/devices", "text/html", DEVICES_HTML, DEVICES_HTML_L, true, false, "\"ae63aeeafb88d830\""},
+    {"/devices.html", "text/html", DEVICES_HTML, DEVICES_HTML_L, true, false, "\"ae63aeeafb88d830\""},
+    {"/favicon.svg", "image/svg+xml", FAVICON_SVG, FAVICON_SVG_L, true, false, "\"5971d99c25c1cc62\""},
+    {"/fingerprints", "text/html", FINGERPRINTS_HTML, FINGERPRINTS_HTML_L, true, false, "\"ae63aeeafb88d830\""},
+    {"/fingerprints.html", "text/html", FINGERPRINTS_HTML, FINGERPRINTS_HTML_L, true, false, "\"ae63aeeafb88d830\""},
+    {"/network", "text/html", NETWORK_HTML, NETWORK_HTML_L, true, false, "\"ae63aeeafb88d830\""},
+    {"/network.html", "text/html", NETWORK_HTML, NETWORK_HTML_L, true, false, "\"ae63aeeafb88d830\""},
+    {"/settings", "text/html", SETTINGS_HTML, SETTINGS_HTML_L, true, false, "\"ae63aeeafb88d830\""},
+    {"/settings.html", "text/html", SETTINGS_HTML, SETTINGS_HTML_L, true, false, "\"ae63aeeafb88d830\""},
+};
+
 inline void setupRoutes(AsyncWebServer* server) {
-    server->on("/app/immutable/assets/index.DN2mWWgh.css", HTTP_GET, serveAppImmutableAssetsIndexDn2mWWghCss);
-    server->on("/app/immutable/assets/index.BfkQNPT2.css", HTTP_GET, serveAppImmutableAssetsIndexBfkQnpt2Css);
-    server->on("/app/immutable/chunks/DfKMpNM3.js", HTTP_GET, serveAppImmutableChunksDfKMpNm3Js);
-    server->on("/app/immutable/entry/app.f1xA8tYB.js", HTTP_GET, serveAppImmutableEntryAppF1xA8tYbJs);
-    server->on("/app/immutable/entry/start.DWUfuLlk.js", HTTP_GET, serveAppImmutableEntryStartDwUfuLlkJs);
-    server->on("/app/immutable/nodes/0.BpUMrsxe.js", HTTP_GET, serveAppImmutableNodes_0BpUMrsxeJs);
-    server->on("/app/immutable/nodes/1.FH0nAYsZ.js", HTTP_GET, serveAppImmutableNodes_1Fh0nAYsZJs);
-    server->on("/app/immutable/nodes/2.B9h3vkVi.js", HTTP_GET, serveAppImmutableNodes_2B9h3vkViJs);
-    server->on("/app/immutable/nodes/3.DNSqvfMd.js", HTTP_GET, serveAppImmutableNodes_3DnSqvfMdJs);
-    server->on("/app/immutable/nodes/4.Ci0Xog3L.js", HTTP_GET, serveAppImmutableNodes_4Ci0Xog3LJs);
-    server->on("/app/immutable/nodes/5.Do1_zzRQ.js", HTTP_GET, serveAppImmutableNodes_5Do1ZzRqJs);
-    server->on("/app/immutable/nodes/6.D7KGf8V1.js", HTTP_GET, serveAppImmutableNodes_6D7KGf8V1Js);
-    server->on("/favicon.svg", HTTP_GET, serveFaviconSvg);
-    // HTML routes
-    server->on("/devices", HTTP_GET, serveDevicesHtml);
-    server->on("/devices.html", HTTP_GET, serveDevicesHtml);
-    server->on("/fingerprints", HTTP_GET, serveFingerprintsHtml);
-    server->on("/fingerprints.html", HTTP_GET, serveFingerprintsHtml);
-    server->on("/", HTTP_GET, serveIndexHtml);
-    server->on("/network", HTTP_GET, serveNetworkHtml);
-    server->on("/network.html", HTTP_GET, serveNetworkHtml);
-    server->on("/settings", HTTP_GET, serveSettingsHtml);
-    server->on("/settings.html", HTTP_GET, serveSettingsHtml);
+    server->addHandler(new AssetHandler(uiAssets, sizeof(uiAssets) / sizeof(uiAssets[0])));
 }
@@ -3,7 +3,6 @@
  */
 
 #pragma once
-#include <ESPAsyncWebServer.h>
 #include <Arduino.h>
 
 // favicon.svg
@@ -40,9 +39,3 @@ const uint8_t FAVICON_SVG[] PROGMEM = {
   0x56, 0x30, 0xcc, 0x75, 0x14, 0x04, 0x00, 0x00
 };
 
-inline void serveFaviconSvg(AsyncWebServerRequest* request) {
-  AsyncWebServerResponse *response = request->beginResponse_P(200, "image/svg+xml", FAVICON_SVG, FAVICON_SVG_L);
-  response->addHeader(F("Content-Encoding"), "gzip");
-  request->send(response);
-}
-
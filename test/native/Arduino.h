@@ -0,0 +1,93 @@
+#pragma once
+// Just enough of the Arduino core for the libraries under lib/ to build and run on the host
+// (pio test -e native)
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#define log_e(format, ...) fprintf(stderr, format "\n", ##__VA_ARGS__)
+
+// The tests move time forward themselves
+inline unsigned long &nativeMillis() {
+    static unsigned long now = 0;
+    return now;
+}
+inline unsigned long millis() { return nativeMillis(); }
+inline unsigned long micros() { return nativeMillis() * 1000; }
+
+class String {
+   public:
+    String() {}
+    String(const char *c) : s(c ? c : "") {}
+    String(const std::string &c) : s(c) {}
+    String(char c) : s(1, c) {}
+    String(int value) : s(std::to_string(value)) {}
+    String(unsigned int value) : s(std::to_string(value)) {}
+    String(long value) : s(std::to_string(value)) {}
+    String(unsigned long value) : s(std::to_string(value)) {}
+    String(float value, unsigned char decimals = 2) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+        s = buffer;
+    }
+
+    const char *c_str() const { return s.c_str(); }
+    unsigned int length() const { return s.size(); }
+    bool isEmpty() const { return s.empty(); }
+    bool reserve(unsigned int size) {
+        s.reserve(size);
+        return true;
+    }
+    bool concat(const char *c, unsigned int n) {
+        s.append(c, n);
+        return true;
+    }
+    char charAt(unsigned int i) const { return i < s.size() ? s[i] : 0; }
+    char operator[](unsigned int i) const { return charAt(i); }
+
+    int indexOf(char c, unsigned int from = 0) const { return found(s.find(c, from)); }
+    int indexOf(const char *c, unsigned int from = 0) const { return found(s.find(c, from)); }
+    int indexOf(const String &c, unsigned int from = 0) const { return found(s.find(c.s, from)); }
+    int lastIndexOf(char c) const { return found(s.rfind(c)); }
+    String substring(unsigned int from) const { return from < s.size() ? String(s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const { return from < to && from < s.size() ? String(s.substr(from, to - from)) : String(); }
+    bool startsWith(const String &prefix) const { return s.compare(0, prefix.s.size(), prefix.s) == 0; }
+    bool equals(const String &o) const { return s == o.s; }
+    void trim() {
+        auto first = s.find_first_not_of(" \t\r\n");
+        auto last = s.find_last_not_of(" \t\r\n");
+        s = first == std::string::npos ? std::string() : s.substr(first, last - first + 1);
+    }
+    long toInt() const { return strtol(s.c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(s.c_str(), nullptr); }
+
+    String &operator+=(const String &o) {
+        s += o.s;
+        return *this;
+    }
+    String &operator+=(const char *o) {
+        s += o;
+        return *this;
+    }
+    String &operator+=(char c) {
+        s += c;
+        return *this;
+    }
+    friend String operator+(String a, const String &b) { return a += b; }
+    friend String operator+(String a, const char *b) { return a += b; }
+
+    bool operator==(const String &o) const { return s == o.s; }
+    bool operator==(const char *o) const { return s == o; }
+    bool operator!=(const String &o) const { return s != o.s; }
+    bool operator!=(const char *o) const { return s != o; }
+    bool operator<(const String &o) const { return s < o.s; }
+
+   private:
+    std::string s;
+
+    static int found(size_t at) { return at == std::string::npos ? -1 : (int)at; }
+};
@@ -0,0 +1,13 @@
+#pragma once
+// The ESP32 ROM's crc32_le, bit by bit: with 0 to start it is the zlib crc32
+#include <stddef.h>
+#include <stdint.h>
+
+inline uint32_t crc32_le(uint32_t crc, const uint8_t *buf, size_t len) {
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++) crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    }
+    return ~crc;
+}
@@ -0,0 +1,248 @@
+// Polls a table the way /json/devices?since= does while another thread keeps adding, changing and
+// removing entries, and checks the poller's copy always catches up with the table
+#include <ChangeLog.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Stands in for a fingerprint: changed without the lock, added and removed with it
+struct Entry {
+    uint32_t serial;
+    String id;
+    std::atomic<int> value{0};
+    std::atomic<uint32_t> version{0};
+};
+
+struct Table {
+    explicit Table(size_t tombstones) : changes(tombstones) {}
+    ~Table() {
+        for (auto e : entries) delete e;
+    }
+
+    std::mutex mutex;
+    std::vector<Entry *> entries;  // By serial, like the fingerprints
+    ChangeLog changes;
+    uint32_t lastSerial = 0;
+};
+
+// What a poller has after applying every response
+struct Mirror {
+    std::map<std::string, int> devices;
+    uint32_t since = 0;
+    unsigned polls = 0, lost = 0;
+};
+
+static uint32_t xorshift(uint32_t &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static void add(Table &t) {
+    std::lock_guard<std::mutex> lock(t.mutex);
+    auto e = new Entry();
+    e->serial = ++t.lastSerial;
+    e->id = String("d") + String((int)e->serial);
+    e->version = t.changes.next();
+    t.entries.push_back(e);
+}
+
+static void change(Table &t, uint32_t pick, int value) {
+    Entry *e;
+    {
+        std::lock_guard<std::mutex> lock(t.mutex);
+        if (t.entries.empty()) return;
+        e = t.entries[pick % t.entries.size()];
+    }
+    // Only this thread frees entries, so it can go on without the lock like the scan task does
+    e->value = value;
+    e->version = t.changes.next();
+}
+
+static void remove(Table &t, uint32_t pick) {
+    std::lock_guard<std::mutex> lock(t.mutex);
+    if (t.entries.empty()) return;
+    auto it = t.entries.begin() + pick % t.entries.size();
+    t.changes.remove((*it)->id, "");
+    delete *it;
+    t.entries.erase(it);
+}
+
+static void write(Table &t, unsigned ops, uint32_t seed) {
+    for (unsigned i = 0; i < ops; i++) {
+        auto r = xorshift(seed);
+        size_t size;
+        {
+            std::lock_guard<std::mutex> lock(t.mutex);
+            size = t.entries.size();
+        }
+        auto op = r % 100;
+        if (size < 5 || (op < 30 && size < 60))
+            add(t);
+        else if (op < 85)
+            change(t, r >> 8, (int)(r >> 4));
+        else
+            remove(t, r >> 8);
+        if (i % 64 == 0) std::this_thread::yield();
+    }
+}
+
+// One request, piece by piece with the lock taken for each like DevicesStream, applied to the mirror.
+// midway runs between tombstones, where the writer can get in.
+static void poll(Table &t, Mirror &m, std::function<void()> midway = nullptr) {
+    auto since = m.since;
+    auto generation = t.changes.current();
+    bool full = !since || !t.changes.removedSince(since);
+
+    std::vector<std::string> removed;
+    if (!full) {
+        auto after = since;
+        ChangeLog::Removed r;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(t.mutex);
+                if (!t.changes.nextRemoved(after, r)) break;
+            }
+            after = r.generation;
+            removed.push_back(r.id.c_str());
+            if (midway) midway();
+        }
+        if (!t.changes.removedSince(since)) {
+            full = true;
+            m.lost++;
+        }
+    }
+
+    std::map<std::string, int> devices;
+    uint32_t after = 0;
+    while (true) {
+        std::lock_guard<std::mutex> lock(t.mutex);
+        auto it = std::upper_bound(t.entries.begin(), t.entries.end(), after, [](uint32_t serial, Entry *e) { return serial < e->serial; });
+        if (it == t.entries.end()) break;
+        after = (*it)->serial;
+        if (full || (*it)->version > since) devices[(*it)->id.c_str()] = (*it)->value;
+    }
+
+    if (full) {
+        m.devices.swap(devices);
+    } else {
+        for (auto &id : removed) m.devices.erase(id);
+        for (auto &d : devices) m.devices[d.first] = d.second;
+    }
+    m.since = generation;
+    m.polls++;
+}
+
+static std::map<std::string, int> contents(Table &t) {
+    std::map<std::string, int> devices;
+    for (auto e : t.entries) devices[e->id.c_str()] = e->value;
+    return devices;
+}
+
+static void race(unsigned ops, uint32_t seed, Mirror &m, Table &t) {
+    std::atomic<bool> done{false};
+    std::thread writer([&] {
+        write(t, ops, seed);
+        done = true;
+    });
+    std::thread poller([&] {
+        while (!done) poll(t, m);
+    });
+    writer.join();
+    poller.join();
+    poll(t, m);  // Nothing changes any more, this one has to get it all
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_tombstones_come_back_oldest_first() {
+    ChangeLog log(8);
+    auto since = log.next();
+    log.remove("a", "1");
+    log.next();
+    log.remove("b", "2");
+    ChangeLog::Removed r;
+    TEST_ASSERT_TRUE(log.nextRemoved(since, r));
+    TEST_ASSERT_EQUAL_STRING("a", r.id.c_str());
+    TEST_ASSERT_EQUAL_STRING("1", r.mac.c_str());
+    TEST_ASSERT_TRUE(log.nextRemoved(r.generation, r));
+    TEST_ASSERT_EQUAL_STRING("b", r.id.c_str());
+    TEST_ASSERT_EQUAL(log.current(), r.generation);
+    TEST_ASSERT_FALSE(log.nextRemoved(r.generation, r));
+}
+
+void test_removed_since_is_false_once_tombstones_were_forgotten() {
+    ChangeLog log(4);
+    log.next();
+    auto since = log.current();
+    TEST_ASSERT_TRUE(log.removedSince(since));
+    for (int i = 0; i < 4; i++) log.remove(String(i), "");
+    TEST_ASSERT_TRUE(log.removedSince(since));
+    log.remove("one too many", "");
+    TEST_ASSERT_FALSE(log.removedSince(since));
+    TEST_ASSERT_EQUAL(4, log.size());
+    TEST_ASSERT_TRUE(log.removedSince(log.current()));
+}
+
+void test_removed_since_is_false_for_a_generation_from_before_a_reboot() {
+    ChangeLog log(4);
+    log.next();
+    TEST_ASSERT_FALSE(log.removedSince(log.current() + 1));
+}
+
+void test_poller_catches_up_under_concurrent_changes() {
+    Table t(64);
+    Mirror m;
+    race(50000, 0x1234567, m, t);
+    TEST_ASSERT_GREATER_THAN(1, m.polls);
+    TEST_ASSERT_TRUE(contents(t) == m.devices);
+}
+
+void test_poller_catches_up_when_tombstones_are_forgotten_midway() {
+    Table t(2);  // Forgotten almost as soon as they are made, most deltas fall back to everything
+    Mirror m;
+    race(50000, 0x89abcdef, m, t);
+    TEST_ASSERT_GREATER_THAN(1, m.polls);
+    TEST_ASSERT_TRUE(contents(t) == m.devices);
+}
+
+void test_delta_turns_full_when_unread_tombstones_are_forgotten() {
+    Table t(4);
+    Mirror m;
+    for (int i = 0; i < 10; i++) add(t);
+    poll(t, m);
+    remove(t, 0);
+    remove(t, 0);
+    bool once = true;
+    poll(t, m, [&] {
+        if (once) {  // The second tombstone goes before it was read
+            for (int i = 0; i < 4; i++) remove(t, 0);
+            once = false;
+        }
+    });
+    TEST_ASSERT_EQUAL(1, m.lost);
+    TEST_ASSERT_TRUE(contents(t) == m.devices);
+    poll(t, m);
+    TEST_ASSERT_EQUAL(1, m.lost);
+    TEST_ASSERT_TRUE(contents(t) == m.devices);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_tombstones_come_back_oldest_first);
+    RUN_TEST(test_removed_since_is_false_once_tombstones_were_forgotten);
+    RUN_TEST(test_removed_since_is_false_for_a_generation_from_before_a_reboot);
+    RUN_TEST(test_delta_turns_full_when_unread_tombstones_are_forgotten);
+    RUN_TEST(test_poller_catches_up_under_concurrent_changes);
+    RUN_TEST(test_poller_catches_up_when_tombstones_are_forgotten_midway);
+    return UNITY_END();
+}
@@ -0,0 +1,90 @@
+#include <CommandRouter.h>
+#include <unity.h>
+
+#include <map>
+#include <string>
+
+// Every command the firmware registers at setup, including the led_N ones LEDs registers per LED
+static const char *const commands[] = {
+    "absorption", "arduino_ota", "auto_update", "button_1_timeout", "button_2_timeout", "cancelEnroll", "count_ids",
+    "enroll", "exclude", "include", "known_irks", "known_macs", "led_1", "led_2", "led_3", "max_distance",
+    "pir_timeout", "prerelease", "query", "radar_timeout", "ref_rssi", "restart", "rx_adj_rssi", "skip_distance",
+    "skip_ms", "switch_1_timeout", "switch_2_timeout", "tx_ref_rssi", "update", "wifi-password", "wifi-ssid"};
+static const size_t COUNT = sizeof(commands) / sizeof(commands[0]);
+
+static std::map<std::string, int> calls;
+static std::map<std::string, std::string> payloads;
+
+void setUp() {
+    calls.clear();
+    payloads.clear();
+}
+void tearDown() {}
+
+static void registerAll() {
+    for (size_t i = 0; i < COUNT; i++) {
+        std::string name = commands[i];
+        CommandRouter::Register(commands[i], [name](String &pay) {
+            calls[name]++;
+            payloads[name] = pay.c_str();
+        }, i % 2 == 0);
+    }
+    CommandRouter::Build();
+}
+
+void test_every_command_dispatches_once_to_its_handler() {
+    registerAll();
+    for (size_t i = 0; i < COUNT; i++) {
+        String pay = commands[i];
+        bool republish = i % 2 != 0;
+        TEST_ASSERT_TRUE(CommandRouter::Dispatch(commands[i], strlen(commands[i]), pay, &republish));
+        TEST_ASSERT_EQUAL(i % 2 == 0, republish);
+    }
+    TEST_ASSERT_EQUAL(COUNT, calls.size());
+    for (size_t i = 0; i < COUNT; i++) {
+        TEST_ASSERT_EQUAL(1, calls[commands[i]]);
+        TEST_ASSERT_EQUAL_STRING(commands[i], payloads[commands[i]].c_str());
+    }
+}
+
+void test_dispatches_from_inside_a_topic() {
+    registerAll();
+    const char *topic = "espresense/rooms/office/max_distance/set";
+    String pay = "7.5";
+    TEST_ASSERT_TRUE(CommandRouter::Dispatch(topic + 24, 12, pay));
+    TEST_ASSERT_EQUAL(1, calls["max_distance"]);
+    TEST_ASSERT_EQUAL_STRING("7.5", payloads["max_distance"].c_str());
+}
+
+void test_unknown_commands_are_rejected() {
+    registerAll();
+    static const char *const unknown[] = {"", "enrol", "enrollx", "Enroll", "restart/", "wifi", "max_distance ", "skip_msx", "x", "led", "led_4", "led_1x"};
+    for (auto command : unknown) {
+        String pay = "1";
+        TEST_ASSERT_FALSE(CommandRouter::Dispatch(command, strlen(command), pay));
+    }
+    TEST_ASSERT_EQUAL(0, calls.size());
+}
+
+void test_registering_again_replaces_the_handler() {
+    registerAll();
+    int replaced = 0;
+    CommandRouter::Register("restart", [&replaced](String &) { replaced++; });
+    String pay;
+    bool dispatched = CommandRouter::Dispatch("restart", 7, pay);
+    // The replacement captures a local, so don't leave it behind for whatever dispatches next
+    CommandRouter::Register("restart", [](String &) {});
+    TEST_ASSERT_TRUE(dispatched);
+    TEST_ASSERT_EQUAL(1, replaced);
+    TEST_ASSERT_EQUAL(0, calls["restart"]);
+    calls.erase("restart");
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_every_command_dispatches_once_to_its_handler);
+    RUN_TEST(test_dispatches_from_inside_a_topic);
+    RUN_TEST(test_unknown_commands_are_rejected);
+    RUN_TEST(test_registering_again_replaces_the_handler);
+    return UNITY_END();
+}
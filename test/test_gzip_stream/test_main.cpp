@@ -0,0 +1,137 @@
+// Compresses inputs through GzipStream at several write and read sizes and inflates the result with
+// the host's zlib, which also checks the gzip header, the crc and the length in the trailer
+#include <GzipStream.h>
+#include <unity.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+void setUp() {}
+void tearDown() {}
+
+static const size_t writeSizes[] = {1, 7, 512, 4096};
+static const size_t readSizes[] = {1, 13, 256, 4096};
+
+static void compress(const std::string &input, size_t writeSize, size_t readSize, std::string &output) {
+    GzipStream gz;
+    uint8_t buffer[4096];
+    size_t written = 0;
+    bool finished = false;
+    while (!gz.done()) {
+        size_t progress = 0;
+        if (written < input.size()) {
+            auto n = std::min(writeSize, input.size() - written);
+            auto taken = gz.write((const uint8_t *)input.data() + written, n);
+            written += taken;
+            progress += taken;
+        } else if (!finished) {
+            gz.finish();
+            finished = true;
+            progress++;
+        }
+        auto got = gz.read(buffer, readSize);
+        output.append((const char *)buffer, got);
+        progress += got;
+        if (!progress) break;  // Stuck; the comparison below fails
+    }
+    TEST_ASSERT_EQUAL(input.size(), gz.totalIn());
+    TEST_ASSERT_EQUAL(output.size(), gz.totalOut());
+}
+
+static bool inflated(const std::string &compressed, std::string &output) {
+    z_stream z = {};
+    if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK) return false;
+    z.next_in = (Bytef *)compressed.data();
+    z.avail_in = compressed.size();
+    uint8_t buffer[4096];
+    int result;
+    do {
+        z.next_out = buffer;
+        z.avail_out = sizeof(buffer);
+        result = inflate(&z, Z_NO_FLUSH);
+        output.append((const char *)buffer, sizeof(buffer) - z.avail_out);
+    } while (result == Z_OK);
+    bool whole = result == Z_STREAM_END && z.avail_in == 0;
+    inflateEnd(&z);
+    return whole;
+}
+
+// Sets compressedSize to what every combination of write and read sizes has to agree on
+static void roundTrip(const std::string &input, size_t &compressedSize) {
+    compressedSize = 0;
+    for (auto writeSize : writeSizes)
+        for (auto readSize : readSizes) {
+            std::string compressed, output;
+            compress(input, writeSize, readSize, compressed);
+            TEST_ASSERT_TRUE_MESSAGE(inflated(compressed, output), "not a complete gzip stream");
+            TEST_ASSERT_EQUAL(input.size(), output.size());
+            TEST_ASSERT_TRUE(input == output);
+            if (compressedSize)  // Chunking changes when bytes come out, never which
+                TEST_ASSERT_EQUAL(compressedSize, compressed.size());
+            compressedSize = compressed.size();
+        }
+}
+
+void test_empty_input() {
+    size_t size;
+    roundTrip("", size);
+}
+
+void test_one_byte() {
+    size_t size;
+    roundTrip("x", size);
+    roundTrip(std::string(1, '\0'), size);
+}
+
+void test_repetitive_input_longer_than_64k() {
+    std::string input;
+    while (input.size() < 70000) input += "abcabcabcabd";
+    input += std::string(5000, 'z');
+    size_t size;
+    roundTrip(input, size);
+    TEST_ASSERT_LESS_THAN(input.size() / 50, size);
+}
+
+void test_incompressible_input() {
+    std::string input;
+    uint32_t x = 2463534242u;
+    for (int i = 0; i < 20000; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        input += (char)(x & 0xff);
+    }
+    size_t size;
+    roundTrip(input, size);
+    TEST_ASSERT_LESS_THAN(input.size() * 9 / 8 + 64, size);  // Fixed codes spend at most 9 bits a byte
+}
+
+void test_devices_shaped_input() {
+    std::string input = "{\"room\":\"office\",\"devices\":[";
+    char device[256];
+    for (unsigned i = 0; i < 200; i++) {
+        snprintf(device, sizeof(device),
+                 "%s{\"mac\":\"c0ffee%06x\",\"id\":\"apple:%04x:%u-%u\",\"name\":\"Watch\",\"idType\":30,\"rssi@1m\":-65,"
+                 "\"rssi\":%d,\"raw\":%.2f,\"distance\":%.2f,\"var\":%.2f,\"close\":%s,\"int\":%u,\"visible\":true}",
+                 i ? "," : "", i * 40503u & 0xffffff, (i * 2654435761u >> 16) & 0xffff, i % 40, i % 7, -60 - (int)(i % 30),
+                 1.5 + i % 100 / 10.0, 1.25 + i % 90 / 10.0, i % 13 / 100.0, i % 5 ? "false" : "true", 1000 + i * 7);
+        input += device;
+    }
+    input += "]}";
+    size_t size;
+    roundTrip(input, size);
+    printf("devices: %u bytes -> %u gzipped\n", (unsigned)input.size(), (unsigned)size);
+    TEST_ASSERT_LESS_THAN(input.size() / 3, size);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_input);
+    RUN_TEST(test_one_byte);
+    RUN_TEST(test_repetitive_input_longer_than_64k);
+    RUN_TEST(test_incompressible_input);
+    RUN_TEST(test_devices_shaped_input);
+    return UNITY_END();
+}
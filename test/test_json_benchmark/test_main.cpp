@@ -0,0 +1,100 @@
+// Builds the same device report both ways: the ArduinoJson document + String path reportDevice used
+// to take, and JsonWriter into a static buffer. Checks they agree byte for byte and prints the time
+// per message for each.
+#include <ArduinoJson.h>
+#include <JsonWriter.h>
+#include <unity.h>
+
+#include <chrono>
+#include <string>
+
+void setUp() {}
+void tearDown() {}
+
+static const int ITERATIONS = 20000;
+
+struct Report {
+    const char *mac, *id, *name;
+    int idType, rssi1m, rssi;
+    float raw, dist, vari;
+    bool close;
+    unsigned long interval;
+};
+
+static const Report report = {"c0ffee123456", "apple:1005:9-26", "Watch", 30, -65, -72, 2.3456f, 2.1049f, 0.25f, true, 1532};
+
+static std::string fixed(float value) {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%.2f", value);
+    return buffer;
+}
+
+static std::string withArduinoJson(DynamicJsonDocument &doc, const Report &r) {
+    doc.clear();
+    doc["mac"] = r.mac;
+    doc["id"] = r.id;
+    doc["name"] = r.name;
+    doc["idType"] = r.idType;
+    doc["rssi@1m"] = r.rssi1m;
+    doc["rssi"] = r.rssi;
+    doc["raw"] = serialized(fixed(r.raw));
+    doc["distance"] = serialized(fixed(r.dist));
+    doc["var"] = serialized(fixed(r.vari));
+    doc["close"] = r.close;
+    doc["int"] = r.interval;
+    std::string buffer;
+    serializeJson(doc, buffer);
+    return buffer;
+}
+
+static size_t withJsonWriter(char *buffer, size_t size, const Report &r) {
+    JsonWriter doc(buffer, size);
+    doc.beginObject();
+    doc.add("mac", r.mac);
+    doc.add("id", r.id);
+    doc.add("name", r.name);
+    doc.add("idType", r.idType);
+    doc.add("rssi@1m", r.rssi1m);
+    doc.add("rssi", r.rssi);
+    doc.addFixed("raw", r.raw);
+    doc.addFixed("distance", r.dist);
+    doc.addFixed("var", r.vari);
+    doc.add("close", r.close);
+    doc.add("int", r.interval);
+    doc.endObject();
+    return doc.overflowed() ? 0 : doc.length();
+}
+
+void test_same_output() {
+    DynamicJsonDocument doc(1024);
+    char buffer[256];
+    auto length = withJsonWriter(buffer, sizeof(buffer), report);
+    TEST_ASSERT_GREATER_THAN(0, length);
+    TEST_ASSERT_EQUAL_STRING(withArduinoJson(doc, report).c_str(), buffer);
+}
+
+void test_benchmark() {
+    typedef std::chrono::steady_clock Clock;
+    DynamicJsonDocument doc(1024);
+    static char buffer[256];
+    size_t sink = 0;
+
+    auto started = Clock::now();
+    for (int i = 0; i < ITERATIONS; i++) sink += withArduinoJson(doc, report).size();
+    auto arduinoJson = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count() / ITERATIONS;
+
+    started = Clock::now();
+    for (int i = 0; i < ITERATIONS; i++) sink += withJsonWriter(buffer, sizeof(buffer), report);
+    auto jsonWriter = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count() / ITERATIONS;
+
+    char message[128];
+    snprintf(message, sizeof(message), "ArduinoJson + String: %lld ns/report, JsonWriter: %lld ns/report (%zu bytes)", (long long)arduinoJson, (long long)jsonWriter, sink);
+    TEST_MESSAGE(message);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_same_output);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,182 @@
+// Streams a /json/devices shaped document of synthetic devices the way the web server does and checks
+// that peak heap use stays the same whether there are 20 devices or 2000
+#include <JsonStream.h>
+#include <unity.h>
+
+#include <new>
+
+static size_t allocated = 0, peak = 0, leaked = 0;
+
+void *operator new(size_t size) {
+    auto p = (size_t *)malloc(size + sizeof(size_t));
+    if (!p) throw std::bad_alloc();
+    *p = size;
+    allocated += size;
+    if (allocated > peak) peak = allocated;
+    return p + 1;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept {
+    if (!p) return;
+    auto block = (size_t *)p - 1;
+    allocated -= *block;
+    free(block);
+}
+void operator delete[](void *p) noexcept { operator delete(p); }
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+void operator delete[](void *p, size_t) noexcept { operator delete(p); }
+
+static const size_t PIECE_SIZE = 512;
+
+class SyntheticDevices : public JsonStream {
+   public:
+    SyntheticDevices(size_t count, size_t oversizedEvery = 0) : JsonStream(PIECE_SIZE), count(count), oversizedEvery(oversizedEvery) {}
+    size_t skipped = 0;
+
+   protected:
+    bool next() override {
+        if (stage == 0) {
+            stage = 1;
+            beginElements();
+            return piece([](JsonWriter &doc) {
+                doc.beginObject();
+                doc.add("room", "office");
+                doc.beginArray("devices");
+            });
+        }
+        while (stage == 1 && index < count) {
+            auto i = index++;
+            char id[48];
+            snprintf(id, sizeof(id), "apple:%04x:%u-%u", (unsigned)(i * 2654435761u >> 16), (unsigned)i % 40, (unsigned)i % 7);
+            bool oversized = oversizedEvery && i % oversizedEvery == oversizedEvery - 1;
+            if (element([&](JsonWriter &doc) {
+                    doc.beginObject();
+                    doc.add("mac", "c0ffee123456");
+                    doc.add("id", id);
+                    if (oversized)
+                        for (int n = 0; n < 40; n++) doc.add("filler", "too much to fit in one piece");
+                    doc.add("rssi@1m", -65);
+                    doc.add("rssi", -60 - (int)(i % 30));
+                    doc.addFixed("raw", 1.5f + i % 100 / 10.0f);
+                    doc.addFixed("distance", 1.25f + i % 90 / 10.0f);
+                    doc.add("int", 1000 + i);
+                    doc.endObject();
+                }))
+                return true;
+            skipped++;
+        }
+        if (stage == 1) {
+            stage = 2;
+            return piece([](JsonWriter &doc) { doc.endArray().endObject(); });
+        }
+        return false;
+    }
+
+   private:
+    size_t count, oversizedEvery, index = 0;
+    int stage = 0;
+};
+
+// Checks the output is one well formed object as it comes, without keeping it
+struct Validator {
+    int depth = 0, elements = 0;
+    bool inString = false, escaped = false, ok = true;
+    char last = 0;
+
+    void feed(const uint8_t *data, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            char c = data[i];
+            if (inString) {
+                if (escaped)
+                    escaped = false;
+                else if (c == '\\')
+                    escaped = true;
+                else if (c == '"')
+                    inString = false;
+                last = c;
+                continue;
+            }
+            if (c == '"') inString = true;
+            if (c == '{' || c == '[') {
+                if (depth == 2 && c == '{') elements++;
+                depth++;
+            }
+            if (c == '}' || c == ']') {
+                if (last == ',') ok = false;  // Separator without an element
+                depth--;
+            }
+            if (c == ',' && (last == ',' || last == '[' || last == '{')) ok = false;
+            if (depth < 0) ok = false;
+            last = c;
+        }
+    }
+};
+
+// Heap used at most while the stream exists, its own buffer included
+static size_t streamPeak(size_t count, size_t chunk, Validator &v) {
+    size_t before = allocated;
+    peak = allocated;
+    {
+        SyntheticDevices stream(count);
+        uint8_t buffer[1436];
+        while (auto n = stream.read(buffer, chunk)) v.feed(buffer, n);
+    }
+    leaked = allocated - before;
+    return peak - before;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_peak_memory_does_not_grow_with_device_count() {
+    Validator small, large;
+    auto smallPeak = streamPeak(20, 1436, small);
+    auto largePeak = streamPeak(2000, 1436, large);
+    TEST_ASSERT_TRUE(small.ok && large.ok);
+    TEST_ASSERT_EQUAL(0, large.depth);
+    TEST_ASSERT_EQUAL(20, small.elements);
+    TEST_ASSERT_EQUAL(2000, large.elements);
+    TEST_ASSERT_EQUAL(0, leaked);
+    TEST_ASSERT_GREATER_OR_EQUAL(PIECE_SIZE, smallPeak);
+    TEST_ASSERT_EQUAL(smallPeak, largePeak);
+}
+
+void test_any_chunk_size_gives_the_same_document() {
+    static const size_t chunks[] = {1, 7, 64, 512, 1436};
+    for (auto chunk : chunks) {
+        Validator v;
+        streamPeak(300, chunk, v);
+        TEST_ASSERT_TRUE(v.ok);
+        TEST_ASSERT_EQUAL(0, v.depth);
+        TEST_ASSERT_EQUAL(300, v.elements);
+    }
+}
+
+void test_elements_that_do_not_fit_are_skipped_cleanly() {
+    SyntheticDevices stream(100, 10);
+    Validator v;
+    uint8_t buffer[1436];
+    while (auto n = stream.read(buffer, sizeof(buffer))) v.feed(buffer, n);
+    TEST_ASSERT_TRUE(v.ok);
+    TEST_ASSERT_EQUAL(0, v.depth);
+    TEST_ASSERT_EQUAL(10, stream.skipped);
+    TEST_ASSERT_EQUAL(90, v.elements);
+}
+
+void test_first_element_skipped_leaves_no_leading_separator() {
+    SyntheticDevices stream(3, 1);  // Every element is too big
+    uint8_t buffer[256];
+    auto n = stream.read(buffer, sizeof(buffer) - 1);
+    buffer[n] = 0;
+    TEST_ASSERT_EQUAL_STRING("{\"room\":\"office\",\"devices\":[]}", (const char *)buffer);
+    TEST_ASSERT_EQUAL(0, stream.read(buffer, sizeof(buffer)));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_peak_memory_does_not_grow_with_device_count);
+    RUN_TEST(test_any_chunk_size_gives_the_same_document);
+    RUN_TEST(test_elements_that_do_not_fit_are_skipped_cleanly);
+    RUN_TEST(test_first_element_skipped_leaves_no_leading_separator);
+    return UNITY_END();
+}
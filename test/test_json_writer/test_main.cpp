@@ -0,0 +1,98 @@
+#include <JsonWriter.h>
+#include <unity.h>
+
+void setUp() {}
+void tearDown() {}
+
+static char buffer[256];
+
+void test_object_with_every_type() {
+    JsonWriter doc(buffer, sizeof(buffer));
+    doc.beginObject();
+    doc.add("id", "apple:1005:9-26");
+    doc.add("rssi", -72);
+    doc.add("int", 1500u);
+    doc.add("close", true);
+    doc.addFixed("distance", 2.345f);
+    doc.add("name", (const char *)nullptr);
+    doc.beginArray("ids").add("a").add("b").endArray();
+    doc.beginObject("dev").add("n", 1).endObject();
+    doc.endObject();
+    TEST_ASSERT_FALSE(doc.overflowed());
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"id\":\"apple:1005:9-26\",\"rssi\":-72,\"int\":1500,\"close\":true,\"distance\":2.35,\"name\":null,"
+        "\"ids\":[\"a\",\"b\"],\"dev\":{\"n\":1}}",
+        doc.c_str());
+}
+
+void test_escapes_strings() {
+    JsonWriter doc(buffer, sizeof(buffer));
+    doc.beginObject().add("s", "q\"b\\n\nt\tc\x01").endObject();
+    TEST_ASSERT_EQUAL_STRING("{\"s\":\"q\\\"b\\\\n\\nt\\tc\\u0001\"}", doc.c_str());
+}
+
+void test_fixed_point() {
+    JsonWriter doc(buffer, sizeof(buffer));
+    doc.beginArray();
+    doc.addFixed(nullptr, 0.0f);
+    doc.addFixed(nullptr, -0.004f);
+    doc.addFixed(nullptr, -1.5f, 1);
+    doc.addFixed(nullptr, 0.05f, 3);
+    doc.addFixed(nullptr, 12.0f, 0);
+    doc.addFixed(nullptr, NAN);
+    doc.addFixed(nullptr, INFINITY);
+    doc.endArray();
+    TEST_ASSERT_EQUAL_STRING("[0.00,0.00,-1.5,0.050,12,null,null]", doc.c_str());
+}
+
+void test_integer_limits() {
+    JsonWriter doc(buffer, sizeof(buffer));
+    doc.beginArray();
+    doc.add(nullptr, (long long)INT64_MIN);
+    doc.add(nullptr, (unsigned long long)UINT64_MAX);
+    doc.add(nullptr, (int8_t)-128);
+    doc.endArray();
+    TEST_ASSERT_EQUAL_STRING("[-9223372036854775808,18446744073709551615,-128]", doc.c_str());
+}
+
+void test_raw_values() {
+    JsonWriter doc(buffer, sizeof(buffer));
+    doc.beginObject().addRaw("dev", "{\"ids\":[1]}").addRaw("x", "123456", 3).endObject();
+    TEST_ASSERT_EQUAL_STRING("{\"dev\":{\"ids\":[1]},\"x\":123}", doc.c_str());
+}
+
+void test_overflow_is_sticky_and_terminated() {
+    char small[16];
+    JsonWriter doc(small, sizeof(small));
+    doc.beginObject().add("id", "too long to fit in here");
+    TEST_ASSERT_TRUE(doc.overflowed());
+    doc.endObject();
+    TEST_ASSERT_TRUE(doc.overflowed());
+    TEST_ASSERT_LESS_THAN(sizeof(small), doc.length());
+    TEST_ASSERT_EQUAL(doc.length(), strlen(small));
+
+    doc.reset();
+    TEST_ASSERT_FALSE(doc.overflowed());
+    doc.beginObject().add("a", 1).endObject();
+    TEST_ASSERT_EQUAL_STRING("{\"a\":1}", doc.c_str());
+}
+
+void test_exact_fit() {
+    char exact[8];  // {"a":1} plus the terminator
+    JsonWriter doc(exact, sizeof(exact));
+    doc.beginObject().add("a", 1).endObject();
+    TEST_ASSERT_FALSE(doc.overflowed());
+    TEST_ASSERT_EQUAL_STRING("{\"a\":1}", exact);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_object_with_every_type);
+    RUN_TEST(test_escapes_strings);
+    RUN_TEST(test_fixed_point);
+    RUN_TEST(test_integer_limits);
+    RUN_TEST(test_raw_values);
+    RUN_TEST(test_overflow_is_sticky_and_terminated);
+    RUN_TEST(test_exact_fit);
+    return UNITY_END();
+}
@@ -0,0 +1,75 @@
+// Renders a small registry through MetricsRenderer at several read sizes and checks the exact
+// OpenMetrics text: counters get _total, buckets are cumulative and end in +Inf, _sum is in seconds
+#include <Metrics.h>
+#include <unity.h>
+
+#include <string>
+
+void setUp() {}
+void tearDown() {}
+
+static const Bucket buckets[] = {{1000, "0.001"}, {10000, "0.01"}, {1000000, "1"}};
+static const char *const routes[] = {"devices", "metrics"};
+
+static Counter reports("esp_reports", "Reports published", [] { return (uint64_t)12345678901ull; });
+static Gauge heap("esp_free_heap_bytes", "Free heap", [] { return (int64_t)-42; });
+static Histogram<2, 3> requests("esp_http_request_seconds", "Time to serve a request", "route", routes, buckets);
+static Gauge tooLong("esp_too_long", "A help text that can't fit in the renderer's line buffer, so its header is left out rather than cut "
+                                     "short, while the value line that does fit is still written",
+                     [] { return (int64_t)7; });
+
+static const char *const expected =
+    "# HELP esp_reports Reports published\n"
+    "# TYPE esp_reports counter\n"
+    "esp_reports_total 12345678901\n"
+    "# HELP esp_free_heap_bytes Free heap\n"
+    "# TYPE esp_free_heap_bytes gauge\n"
+    "esp_free_heap_bytes -42\n"
+    "# HELP esp_http_request_seconds Time to serve a request\n"
+    "# TYPE esp_http_request_seconds histogram\n"
+    "esp_http_request_seconds_bucket{route=\"devices\",le=\"0.001\"} 2\n"
+    "esp_http_request_seconds_bucket{route=\"devices\",le=\"0.01\"} 3\n"
+    "esp_http_request_seconds_bucket{route=\"devices\",le=\"1\"} 3\n"
+    "esp_http_request_seconds_bucket{route=\"devices\",le=\"+Inf\"} 4\n"
+    "esp_http_request_seconds_count{route=\"devices\"} 4\n"
+    "esp_http_request_seconds_sum{route=\"devices\"} 2.006500\n"
+    "esp_http_request_seconds_bucket{route=\"metrics\",le=\"0.001\"} 0\n"
+    "esp_http_request_seconds_bucket{route=\"metrics\",le=\"0.01\"} 0\n"
+    "esp_http_request_seconds_bucket{route=\"metrics\",le=\"1\"} 0\n"
+    "esp_http_request_seconds_bucket{route=\"metrics\",le=\"+Inf\"} 0\n"
+    "esp_http_request_seconds_count{route=\"metrics\"} 0\n"
+    "esp_http_request_seconds_sum{route=\"metrics\"} 0.000000\n"
+    "# TYPE esp_too_long gauge\n"
+    "esp_too_long 7\n"
+    "# EOF\n";
+
+static void render(size_t readSize, std::string &text) {
+    MetricsRenderer renderer;
+    char buffer[4096];
+    size_t n;
+    while ((n = renderer.read(buffer, readSize)) > 0) {
+        TEST_ASSERT_TRUE(n <= readSize);
+        text.append(buffer, n);
+    }
+    TEST_ASSERT_EQUAL(0, renderer.read(buffer, readSize));  // Stays finished
+}
+
+void test_renders_the_same_text_at_any_read_size() {
+    static const size_t readSizes[] = {1, 2, 7, 13, 61, 160, 161, 4096};
+    for (auto readSize : readSizes) {
+        std::string text;
+        render(readSize, text);
+        TEST_ASSERT_EQUAL_STRING(expected, text.c_str());
+    }
+}
+
+int main() {
+    requests.observe(0, 500);
+    requests.observe(0, 1000);  // Bounds are inclusive
+    requests.observe(0, 5000);
+    requests.observe(0, 2000000);
+    requests.observe(2, 10);  // No such series, ignored
+    UNITY_BEGIN();
+    RUN_TEST(test_renders_the_same_text_at_any_read_size);
+    return UNITY_END();
+}
@@ -0,0 +1,172 @@
+// Feeds MqttReassembler the fragment orders a broker (or a bad connection) can produce
+#include <MqttReassembler.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+struct Delivery {
+    std::string topic, payload;
+};
+static std::vector<Delivery> delivered;
+
+static void handler(const char *topic, const char *payload, size_t length) {
+    delivered.push_back({topic, std::string(payload, length)});
+}
+
+void setUp() {
+    delivered.clear();
+    nativeMillis() = 0;
+}
+void tearDown() {}
+
+static std::string pattern(char seed, size_t length) {
+    std::string s;
+    for (size_t i = 0; i < length; i++) s += char('a' + (seed + i * 7) % 26);
+    return s;
+}
+
+// Delivers `payload` from `offset` in fragments of `chunk`, like AsyncMqttClient does
+static void fragment(MqttReassembler &r, const char *topic, const std::string &payload, size_t offset, size_t chunk) {
+    auto len = std::min(chunk, payload.size() - offset);
+    nativeMillis()++;
+    r.onFragment(topic, payload.data() + offset, len, offset, payload.size());
+}
+
+void test_single_fragment_is_passed_through() {
+    MqttReassembler r(2, 64, handler);
+    r.onFragment("a/set", "5", 1, 0, 1);
+    TEST_ASSERT_EQUAL(1, delivered.size());
+    TEST_ASSERT_EQUAL_STRING("5", delivered[0].payload.c_str());
+}
+
+void test_interleaved_topics_do_not_mix() {
+    MqttReassembler r(4, 4096, handler);
+    auto one = pattern(1, 1000), two = pattern(2, 1500), three = pattern(3, 700);
+    size_t a = 0, b = 0, c = 0;
+    while (a < one.size() || b < two.size() || c < three.size()) {
+        if (b < two.size()) fragment(r, "espresense/settings/b/config", two, b, 97), b += 97;
+        if (a < one.size()) fragment(r, "espresense/settings/a/config", one, a, 128), a += 128;
+        if (c < three.size()) fragment(r, "espresense/rooms/x/query/set", three, c, 50), c += 50;
+    }
+    TEST_ASSERT_EQUAL(3, delivered.size());
+    for (auto &d : delivered) {
+        if (d.topic == "espresense/settings/a/config") TEST_ASSERT_TRUE(d.payload == one);
+        else if (d.topic == "espresense/settings/b/config") TEST_ASSERT_TRUE(d.payload == two);
+        else TEST_ASSERT_TRUE(d.payload == three);
+    }
+    TEST_ASSERT_EQUAL(0, r.dropped());
+}
+
+void test_same_topic_two_messages_back_to_back() {
+    MqttReassembler r(2, 1024, handler);
+    auto first = pattern(4, 300), second = pattern(5, 300);
+    for (size_t i = 0; i < first.size(); i += 100) fragment(r, "t/config", first, i, 100);
+    for (size_t i = 0; i < second.size(); i += 100) fragment(r, "t/config", second, i, 100);
+    TEST_ASSERT_EQUAL(2, delivered.size());
+    TEST_ASSERT_TRUE(delivered[0].payload == first);
+    TEST_ASSERT_TRUE(delivered[1].payload == second);
+}
+
+void test_oversized_message_is_dropped_without_buffering() {
+    MqttReassembler r(2, 256, handler);
+    auto big = pattern(6, 1000);
+    for (size_t i = 0; i < big.size(); i += 100) fragment(r, "t/config", big, i, 100);
+    TEST_ASSERT_EQUAL(0, delivered.size());
+    TEST_ASSERT_EQUAL(1, r.dropped());
+
+    auto small = pattern(7, 200);
+    for (size_t i = 0; i < small.size(); i += 100) fragment(r, "t/config", small, i, 100);
+    TEST_ASSERT_EQUAL(1, delivered.size());
+    TEST_ASSERT_TRUE(delivered[0].payload == small);
+}
+
+void test_missing_fragment_drops_the_message() {
+    MqttReassembler r(2, 1024, handler);
+    auto payload = pattern(8, 300);
+    fragment(r, "t/config", payload, 0, 100);
+    fragment(r, "t/config", payload, 200, 100);  // 100..199 never arrives
+    TEST_ASSERT_EQUAL(0, delivered.size());
+    TEST_ASSERT_EQUAL(1, r.dropped());
+}
+
+void test_duplicate_fragment_drops_the_message() {
+    MqttReassembler r(2, 1024, handler);
+    auto payload = pattern(9, 300);
+    fragment(r, "t/config", payload, 0, 100);
+    fragment(r, "t/config", payload, 100, 100);
+    fragment(r, "t/config", payload, 100, 100);
+    fragment(r, "t/config", payload, 200, 100);
+    TEST_ASSERT_EQUAL(0, delivered.size());
+}
+
+void test_fragment_without_a_start_is_ignored() {
+    MqttReassembler r(2, 1024, handler);
+    auto payload = pattern(10, 300);
+    fragment(r, "t/config", payload, 100, 100);
+    fragment(r, "t/config", payload, 200, 100);
+    TEST_ASSERT_EQUAL(0, delivered.size());
+}
+
+void test_fragment_past_the_announced_total_is_dropped() {
+    MqttReassembler r(2, 1024, handler);
+    r.onFragment("t/config", "0123456789", 10, 0, 15);
+    r.onFragment("t/config", "0123456789", 10, 10, 15);
+    TEST_ASSERT_EQUAL(0, delivered.size());
+    TEST_ASSERT_EQUAL(1, r.dropped());
+}
+
+void test_more_topics_than_slots_evicts_the_stalest() {
+    MqttReassembler r(2, 1024, handler);
+    auto a = pattern(11, 200), b = pattern(12, 200), c = pattern(13, 200);
+    fragment(r, "a", a, 0, 100);
+    fragment(r, "b", b, 0, 100);
+    fragment(r, "c", c, 0, 100);  // No slot left: "a" waited longest and is dropped
+    fragment(r, "a", a, 100, 100);
+    fragment(r, "b", b, 100, 100);
+    fragment(r, "c", c, 100, 100);
+    TEST_ASSERT_EQUAL(2, delivered.size());
+    TEST_ASSERT_EQUAL_STRING("b", delivered[0].topic.c_str());
+    TEST_ASSERT_EQUAL_STRING("c", delivered[1].topic.c_str());
+    TEST_ASSERT_TRUE(delivered[1].payload == c);
+    TEST_ASSERT_EQUAL(1, r.dropped());
+}
+
+void test_unfragmented_message_restarts_a_half_received_one() {
+    MqttReassembler r(2, 1024, handler);
+    auto payload = pattern(14, 300);
+    fragment(r, "t/config", payload, 0, 100);
+    r.onFragment("t/config", "{}", 2, 0, 2);
+    fragment(r, "t/config", payload, 100, 100);
+    fragment(r, "t/config", payload, 200, 100);
+    TEST_ASSERT_EQUAL(1, delivered.size());
+    TEST_ASSERT_EQUAL_STRING("{}", delivered[0].payload.c_str());
+}
+
+void test_restarted_message_replaces_the_half_received_one() {
+    MqttReassembler r(2, 1024, handler);
+    auto stale = pattern(15, 300), fresh = pattern(16, 250);
+    fragment(r, "t/config", stale, 0, 100);
+    for (size_t i = 0; i < fresh.size(); i += 100) fragment(r, "t/config", fresh, i, 100);
+    fragment(r, "t/config", stale, 100, 100);
+    fragment(r, "t/config", stale, 200, 100);
+    TEST_ASSERT_EQUAL(1, delivered.size());
+    TEST_ASSERT_TRUE(delivered[0].payload == fresh);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_single_fragment_is_passed_through);
+    RUN_TEST(test_interleaved_topics_do_not_mix);
+    RUN_TEST(test_same_topic_two_messages_back_to_back);
+    RUN_TEST(test_oversized_message_is_dropped_without_buffering);
+    RUN_TEST(test_missing_fragment_drops_the_message);
+    RUN_TEST(test_duplicate_fragment_drops_the_message);
+    RUN_TEST(test_fragment_without_a_start_is_ignored);
+    RUN_TEST(test_fragment_past_the_announced_total_is_dropped);
+    RUN_TEST(test_more_topics_than_slots_evicts_the_stalest);
+    RUN_TEST(test_unfragmented_message_restarts_a_half_received_one);
+    RUN_TEST(test_restarted_message_replaces_the_half_received_one);
+    return UNITY_END();
+}
@@ -0,0 +1,131 @@
+// Checks PrefixMatcher against the linear scan it replaced (prefixExists: split on spaces, skip empty
+// tokens, match if the string starts with any of them) and prints the time per lookup for both with
+// a 200 entry list.
+#include <PrefixMatcher.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+static bool prefixExists(const std::string &prefixes, const std::string &s) {
+    size_t start = 0, space;
+    while ((space = prefixes.find(' ', start)) != std::string::npos) {
+        if (space > start && s.compare(0, space - start, prefixes, start, space - start) == 0) return true;
+        start = space + 1;
+    }
+    return start < prefixes.size() && s.compare(0, prefixes.size() - start, prefixes, start, std::string::npos) == 0;
+}
+
+static void agree(const char *prefixes, const std::vector<std::string> &strings) {
+    PrefixMatcher matcher(prefixes);
+    for (auto &s : strings) {
+        bool expected = prefixExists(prefixes, s);
+        if (matcher.matches(s.c_str()) != expected) {
+            char message[256];
+            snprintf(message, sizeof(message), "\"%s\" against \"%s\", expected %d", s.c_str(), prefixes, expected);
+            TEST_FAIL_MESSAGE(message);
+        }
+    }
+}
+
+static const std::vector<std::string> ids = {"", "a", "ab", "abc", "abd", "b", "ba", "apple:1005:9-26", "apple:", "apple",
+                                             "iBeacon:e5ca1ade", "irk:0123", "msft:cdp:0123", "tile:", "z"};
+
+void test_empty_list_matches_nothing() {
+    PrefixMatcher matcher("");
+    TEST_ASSERT_TRUE(matcher.empty());
+    TEST_ASSERT_TRUE(PrefixMatcher().empty());
+    agree("", ids);
+    agree(" ", ids);
+    agree("   ", ids);
+}
+
+void test_empty_tokens_and_repeated_spaces_are_ignored() {
+    agree(" apple:", ids);
+    agree("apple: ", ids);
+    agree("apple:  irk:", ids);
+    agree("  apple:   irk:  ", ids);
+    TEST_ASSERT_FALSE(PrefixMatcher("apple:  irk:").matches("tile:"));
+}
+
+void test_covered_and_duplicate_prefixes() {
+    agree("apple apple:", ids);
+    agree("apple: apple", ids);
+    agree("a ab abc", ids);
+    agree("abc ab a", ids);
+    agree("abc abc", ids);
+    agree("ab ab abd", ids);
+    agree("b a", ids);
+    TEST_ASSERT_TRUE(PrefixMatcher("abc ab").matches("abd"));
+}
+
+void test_random_lists_agree_with_linear_scan() {
+    uint32_t x = 2463534242u;
+    auto next = [&x]() {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        return x;
+    };
+    auto word = [&next](size_t maxLength) {  // Short words over "ab " so prefixes overlap a lot
+        std::string w;
+        for (size_t n = next() % (maxLength + 1); n; n--) w += "ab "[next() % 3];
+        return w;
+    };
+    for (int list = 0; list < 500; list++) {
+        auto prefixes = word(16);
+        std::vector<std::string> strings;
+        for (int i = 0; i < 50; i++) {
+            auto s = word(6);
+            s.erase(std::remove(s.begin(), s.end(), ' '), s.end());
+            strings.push_back(s);
+        }
+        agree(prefixes.c_str(), strings);
+    }
+}
+
+void test_benchmark_200_prefixes() {
+    typedef std::chrono::steady_clock Clock;
+    static const int ITERATIONS = 20000;
+    std::string prefixes;
+    char prefix[32];
+    for (unsigned i = 0; i < 200; i++) {
+        snprintf(prefix, sizeof(prefix), "%sapple:%04x:", i ? " " : "", i * 2654435761u >> 16 & 0xffff);
+        prefixes += prefix;
+    }
+    std::vector<std::string> strings;
+    for (unsigned i = 0; i < 64; i++) {
+        snprintf(prefix, sizeof(prefix), "apple:%04x:9-26", (i % 2 ? i * 2654435761u >> 16 : i * 40503u) & 0xffff);
+        strings.push_back(prefix);
+    }
+    agree(prefixes.c_str(), strings);
+
+    PrefixMatcher matcher(prefixes.c_str());
+    size_t sink = 0;
+    auto started = Clock::now();
+    for (int i = 0; i < ITERATIONS; i++) sink += prefixExists(prefixes, strings[i % strings.size()]);
+    auto linear = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count() / ITERATIONS;
+
+    started = Clock::now();
+    for (int i = 0; i < ITERATIONS; i++) sink += matcher.matches(strings[i % strings.size()].c_str());
+    auto compiled = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count() / ITERATIONS;
+
+    char message[128];
+    snprintf(message, sizeof(message), "200 prefixes, linear scan: %lld ns/lookup, PrefixMatcher: %lld ns/lookup (%zu matches)", (long long)linear, (long long)compiled, sink);
+    TEST_MESSAGE(message);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_list_matches_nothing);
+    RUN_TEST(test_empty_tokens_and_repeated_spaces_are_ignored);
+    RUN_TEST(test_covered_and_duplicate_prefixes);
+    RUN_TEST(test_random_lists_agree_with_linear_scan);
+    RUN_TEST(test_benchmark_200_prefixes);
+    return UNITY_END();
+}
@@ -0,0 +1,72 @@
+// A value a reader holds must outlive any number of publishes, and be freed once the last holder
+// lets go
+#include <Published.h>
+#include <unity.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+void setUp() {}
+void tearDown() {}
+
+struct Value {
+    static std::atomic<int> alive;
+    int number;
+    int copy;  // Always equals number while the value is alive
+    explicit Value(int number) : number(number), copy(number) { alive++; }
+    ~Value() {
+        copy = -1;
+        alive--;
+    }
+};
+std::atomic<int> Value::alive{0};
+
+void test_held_value_survives_publishes() {
+    {
+        Published<Value> published(new Value(1));
+        auto held = published.get();
+        for (int i = 2; i < 100; i++) published.publish(new Value(i));
+        TEST_ASSERT_EQUAL(1, held->number);
+        TEST_ASSERT_EQUAL(1, held->copy);
+        TEST_ASSERT_EQUAL(99, published->number);
+        TEST_ASSERT_EQUAL(2, Value::alive.load());
+        held.reset();
+        TEST_ASSERT_EQUAL(1, Value::alive.load());
+    }
+    TEST_ASSERT_EQUAL(0, Value::alive.load());
+}
+
+void test_slow_readers_during_publishes() {
+    {
+        Published<Value> published(new Value(0));
+        std::atomic<bool> stop{false};
+        std::atomic<int> torn{0}, backwards{0};
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 4; r++)
+            readers.emplace_back([&] {
+                int last = 0;
+                while (!stop) {
+                    auto value = published.get();
+                    std::this_thread::yield();  // Hold it across publishes
+                    if (value->copy != value->number) torn++;
+                    if (value->number < last) backwards++;
+                    last = value->number;
+                }
+            });
+        for (int i = 1; i <= 20000; i++) published.publish(new Value(i));
+        stop = true;
+        for (auto &t : readers) t.join();
+        TEST_ASSERT_EQUAL(0, torn.load());
+        TEST_ASSERT_EQUAL(0, backwards.load());
+        TEST_ASSERT_EQUAL(1, Value::alive.load());
+    }
+    TEST_ASSERT_EQUAL(0, Value::alive.load());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_held_value_survives_publishes);
+    RUN_TEST(test_slow_readers_during_publishes);
+    return UNITY_END();
+}
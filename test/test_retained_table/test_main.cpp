@@ -0,0 +1,139 @@
+// What RTC memory can hold after a reset, and which of it a RetainedTable takes
+#include <RetainedTable.h>
+#include <unity.h>
+
+#include <string.h>
+
+#include <memory>
+#include <new>
+
+static const uint32_t MAGIC = 0x4d524157;
+
+struct Entry {
+    uint8_t address[6];
+    int16_t rssi;
+    char id[24];
+    float dist;
+};
+
+// The same table from a firmware that added a field
+struct LongerEntry {
+    uint8_t address[6];
+    int16_t rssi;
+    char id[24];
+    float dist;
+    float variance;
+};
+
+typedef RetainedTable<Entry, 8> Table;
+typedef RetainedTable<LongerEntry, 8> LongerTable;
+
+static void fill(Table &t, uint16_t count) {
+    t.open();
+    for (uint16_t i = 0; i < count; i++) {
+        memset(&t.entries[i], 0, sizeof(Entry));
+        t.entries[i].address[5] = i;
+        t.entries[i].rssi = -60 - i;
+        snprintf(t.entries[i].id, sizeof(t.entries[i].id), "apple:%04x", i);
+        t.entries[i].dist = 1.5f * i;
+    }
+    t.seal(MAGIC, count);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_sealed_table_is_valid() {
+    Table t;
+    fill(t, 5);
+    TEST_ASSERT_TRUE(t.valid(MAGIC));
+    TEST_ASSERT_EQUAL(5, t.count);
+    TEST_ASSERT_EQUAL_STRING("apple:0004", t.entries[4].id);
+}
+
+void test_empty_table_is_valid() {
+    Table t;
+    fill(t, 0);
+    TEST_ASSERT_TRUE(t.valid(MAGIC));
+}
+
+void test_power_on_garbage_is_rejected() {
+    Table t;
+    for (unsigned seed = 1; seed < 200; seed++) {
+        uint32_t x = seed;
+        auto bytes = (uint8_t *)&t;
+        for (size_t i = 0; i < sizeof(t); i++) {
+            x = x * 1103515245 + 12345;
+            bytes[i] = x >> 16;
+        }
+        TEST_ASSERT_FALSE(t.valid(MAGIC));
+    }
+}
+
+void test_other_magic_is_rejected() {
+    Table t;
+    fill(t, 3);
+    TEST_ASSERT_FALSE(t.valid(MAGIC + 1));
+}
+
+void test_any_changed_bit_in_the_entries_is_rejected() {
+    Table t;
+    fill(t, 4);
+    auto bytes = (uint8_t *)t.entries;
+    for (size_t i = 0; i < 4 * sizeof(Entry) * 8; i++) {
+        bytes[i / 8] ^= 1 << i % 8;
+        TEST_ASSERT_FALSE(t.valid(MAGIC));
+        bytes[i / 8] ^= 1 << i % 8;
+    }
+    TEST_ASSERT_TRUE(t.valid(MAGIC));
+}
+
+void test_count_past_the_end_is_rejected_without_reading_past_it() {
+    // Exactly as big as the table, so reading entries past the end trips the sanitizer
+    std::unique_ptr<uint8_t[]> memory(new uint8_t[sizeof(Table)]);
+    auto t = new (memory.get()) Table;
+    fill(*t, 8);
+    t->count = 0xffff;
+    TEST_ASSERT_FALSE(t->valid(MAGIC));
+    t->count = 9;
+    TEST_ASSERT_FALSE(t->valid(MAGIC));
+}
+
+void test_opened_table_is_rejected_until_sealed() {
+    Table t;
+    fill(t, 3);
+    t.open();  // A shutdown handler that didn't get to seal it
+    TEST_ASSERT_FALSE(t.valid(MAGIC));
+    t.seal(MAGIC, 3);
+    TEST_ASSERT_TRUE(t.valid(MAGIC));
+}
+
+void test_table_from_a_different_layout_is_rejected() {
+    Table t;
+    fill(t, 3);
+    LongerTable other;
+    memset(&other, 0, sizeof(other));
+    memcpy(&other, &t, sizeof(t));  // What the new firmware finds in RTC memory
+    TEST_ASSERT_FALSE(other.valid(MAGIC));
+
+    LongerTable longer;
+    longer.open();
+    memset(longer.entries, 0, sizeof(longer.entries));
+    longer.seal(MAGIC, 2);
+    Table older;
+    memcpy(&older, &longer, sizeof(older));  // And going back to the old firmware
+    TEST_ASSERT_FALSE(older.valid(MAGIC));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_sealed_table_is_valid);
+    RUN_TEST(test_empty_table_is_valid);
+    RUN_TEST(test_power_on_garbage_is_rejected);
+    RUN_TEST(test_other_magic_is_rejected);
+    RUN_TEST(test_any_changed_bit_in_the_entries_is_rejected);
+    RUN_TEST(test_count_past_the_end_is_rejected_without_reading_past_it);
+    RUN_TEST(test_opened_table_is_rejected_until_sealed);
+    RUN_TEST(test_table_from_a_different_layout_is_rejected);
+    return UNITY_END();
+}
@@ -0,0 +1,245 @@
+// Commits settings to a simulated flash that can lose power at any write, and checks that recovering
+// afterwards always leaves either every setting of the commit changed or none of them
+#include <SettingsJournal.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <string>
+
+struct PowerLoss {};
+
+// Files in memory. After `writesLeft` more writes, the next one only gets `torn` bytes to flash and
+// the power goes; removes can be cut the same way.
+class MemoryFlash : public SettingsFlash {
+   public:
+    std::map<std::string, std::vector<uint8_t>> files;
+    int writesLeft = -1, removesLeft = -1;
+    size_t torn = 0;
+    unsigned int writes = 0;
+
+    bool read(const String &fn, std::vector<uint8_t> &data) override {
+        auto it = files.find(fn.c_str());
+        if (it == files.end()) return false;
+        data = it->second;
+        return true;
+    }
+
+    bool write(const String &fn, const uint8_t *data, size_t length) override {
+        writes++;
+        if (writesLeft == 0) {
+            files[fn.c_str()].assign(data, data + std::min(torn, length));
+            throw PowerLoss();
+        }
+        if (writesLeft > 0) writesLeft--;
+        files[fn.c_str()].assign(data, data + length);
+        return true;
+    }
+
+    void remove(const String &fn) override {
+        if (removesLeft == 0) throw PowerLoss();
+        if (removesLeft > 0) removesLeft--;
+        files.erase(fn.c_str());
+    }
+
+    std::string get(const char *fn) {
+        auto &data = files[fn];
+        return std::string(data.begin(), data.end());
+    }
+
+    void set(const char *fn, const char *value) { files[fn].assign(value, value + strlen(value)); }
+
+    void powerBack() { writesLeft = removesLeft = -1; }
+};
+
+static const char *journalPath = "/settings.journal";
+
+static void oldValues(MemoryFlash &flash) {
+    flash.files.clear();
+    flash.set("/absorption", "3.50");
+    flash.set("/max_distance", "16.00");
+    flash.set("/skip_ms", "5000");
+}
+
+static SettingsJournal::TChanges newValues() {
+    SettingsJournal::TChanges changes;
+    changes["/absorption"] = "2.70";
+    changes["/max_distance"] = "7.50";
+    changes["/skip_ms"] = "250";
+    return changes;
+}
+
+static SettingsJournal::TChanges oneValue() {
+    SettingsJournal::TChanges changes;
+    changes["/skip_ms"] = "250";
+    return changes;
+}
+
+// Every file holds its old value, or with `applied` the value `changes` has for it if any
+static bool holds(MemoryFlash &flash, const SettingsJournal::TChanges &changes, bool applied) {
+    MemoryFlash old;
+    oldValues(old);
+    for (auto &f : old.files) {
+        auto change = changes.find(f.first.c_str());
+        auto expected = applied && change != changes.end() ? std::string(change->second.c_str()) : old.get(f.first.c_str());
+        if (flash.get(f.first.c_str()) != expected) return false;
+    }
+    return true;
+}
+
+static bool allOld(MemoryFlash &flash) {
+    return flash.get("/absorption") == "3.50" && flash.get("/max_distance") == "16.00" && flash.get("/skip_ms") == "5000";
+}
+
+static bool allNew(MemoryFlash &flash) {
+    return flash.get("/absorption") == "2.70" && flash.get("/max_distance") == "7.50" && flash.get("/skip_ms") == "250";
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_record_round_trips() {
+    std::vector<uint8_t> record;
+    auto changes = newValues();
+    changes["/empty"] = "";
+    SettingsJournal::encode(changes, record);
+    SettingsJournal::TChanges decoded;
+    TEST_ASSERT_TRUE(SettingsJournal::decode(record, decoded));
+    TEST_ASSERT_TRUE(decoded == changes);
+}
+
+void test_truncated_or_corrupt_records_are_rejected() {
+    std::vector<uint8_t> record;
+    SettingsJournal::encode(newValues(), record);
+    for (size_t length = 0; length < record.size(); length++) {
+        std::vector<uint8_t> cut(record.begin(), record.begin() + length);
+        SettingsJournal::TChanges decoded;
+        TEST_ASSERT_FALSE(SettingsJournal::decode(cut, decoded));
+    }
+    for (size_t i = 0; i < record.size() * 8; i++) {
+        auto flipped = record;
+        flipped[i / 8] ^= 1 << i % 8;
+        SettingsJournal::TChanges decoded;
+        TEST_ASSERT_FALSE(SettingsJournal::decode(flipped, decoded));
+    }
+}
+
+void test_commit_writes_every_file_and_removes_the_journal() {
+    MemoryFlash flash;
+    oldValues(flash);
+    SettingsJournal journal(flash, journalPath);
+    auto changes = newValues();
+    TEST_ASSERT_EQUAL(3, journal.commit(changes));
+    TEST_ASSERT_TRUE(allNew(flash));
+    TEST_ASSERT_EQUAL(0, flash.files.count(journalPath));
+    TEST_ASSERT_EQUAL(4, flash.writes);  // The journal, then each file
+}
+
+void test_unchanged_settings_are_not_written() {
+    MemoryFlash flash;
+    oldValues(flash);
+    SettingsJournal journal(flash, journalPath);
+    SettingsJournal::TChanges changes;
+    changes["/absorption"] = "3.50";
+    changes["/skip_ms"] = "250";
+    TEST_ASSERT_EQUAL(1, journal.commit(changes));
+    TEST_ASSERT_EQUAL(1, journal.skipped());
+    TEST_ASSERT_EQUAL(2, flash.writes);  // A single change is journaled too, a torn file would lose both values
+    TEST_ASSERT_EQUAL_STRING("250", flash.get("/skip_ms").c_str());
+}
+
+// Cuts the power at every write of a commit, with every possible number of bytes of that write on flash
+static void powerLossAtAnyWrite(const SettingsJournal::TChanges &committed) {
+    std::vector<uint8_t> record;
+    SettingsJournal::encode(committed, record);
+    for (int write = 0; write <= (int)committed.size(); write++) {
+        auto longest = write == 0 ? record.size() : 5;
+        for (size_t torn = 0; torn <= longest; torn++) {
+            MemoryFlash flash;
+            oldValues(flash);
+            flash.writesLeft = write;
+            flash.torn = torn;
+            bool lost = false;
+            try {
+                SettingsJournal journal(flash, journalPath);
+                auto changes = committed;
+                journal.commit(changes);
+            } catch (PowerLoss &) {
+                lost = true;
+            }
+            TEST_ASSERT_TRUE(lost);
+
+            flash.powerBack();
+            SettingsJournal rebooted(flash, journalPath);
+            rebooted.recover();
+            bool whole = write == 0 && torn == record.size();  // The journal made it after all
+            TEST_ASSERT_TRUE(holds(flash, committed, write > 0 || whole));
+            TEST_ASSERT_EQUAL(0, flash.files.count(journalPath));
+        }
+    }
+}
+
+void test_power_loss_at_any_write_leaves_all_or_nothing() {
+    powerLossAtAnyWrite(newValues());
+    powerLossAtAnyWrite(oneValue());
+}
+
+void test_power_loss_before_the_journal_is_removed() {
+    MemoryFlash flash;
+    oldValues(flash);
+    flash.removesLeft = 0;
+    try {
+        SettingsJournal journal(flash, journalPath);
+        auto changes = newValues();
+        journal.commit(changes);
+    } catch (PowerLoss &) {
+    }
+    flash.powerBack();
+    SettingsJournal rebooted(flash, journalPath);
+    TEST_ASSERT_EQUAL(3, rebooted.recover());
+    TEST_ASSERT_TRUE(allNew(flash));
+}
+
+void test_power_loss_while_recovering_recovers_again() {
+    MemoryFlash flash;
+    oldValues(flash);
+    flash.writesLeft = 2;  // Journal and one file
+    flash.torn = 1;
+    try {
+        SettingsJournal journal(flash, journalPath);
+        auto changes = newValues();
+        journal.commit(changes);
+    } catch (PowerLoss &) {
+    }
+    flash.writesLeft = 1;  // And again partway through the replay
+    try {
+        SettingsJournal rebooted(flash, journalPath);
+        rebooted.recover();
+    } catch (PowerLoss &) {
+    }
+    flash.powerBack();
+    SettingsJournal rebootedAgain(flash, journalPath);
+    TEST_ASSERT_EQUAL(3, rebootedAgain.recover());
+    TEST_ASSERT_TRUE(allNew(flash));
+}
+
+void test_nothing_to_recover() {
+    MemoryFlash flash;
+    oldValues(flash);
+    SettingsJournal journal(flash, journalPath);
+    TEST_ASSERT_EQUAL(0, journal.recover());
+    TEST_ASSERT_TRUE(allOld(flash));
+    TEST_ASSERT_EQUAL(0, flash.writes);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_record_round_trips);
+    RUN_TEST(test_truncated_or_corrupt_records_are_rejected);
+    RUN_TEST(test_commit_writes_every_file_and_removes_the_journal);
+    RUN_TEST(test_unchanged_settings_are_not_written);
+    RUN_TEST(test_power_loss_at_any_write_leaves_all_or_nothing);
+    RUN_TEST(test_power_loss_before_the_journal_is_removed);
+    RUN_TEST(test_power_loss_while_recovering_recovers_again);
+    RUN_TEST(test_nothing_to_recover);
+    return UNITY_END();
+}
@@ -0,0 +1,95 @@
+// Carries a FilteredDistance across a simulated software restart the way WarmRestart does: its State
+// goes into a WarmState in a sealed RetainedTable, the table is validated after the "restart" and the
+// state restored into a new filter, which then has to keep tracking with the one that never stopped.
+#include <FilteredDistance.h>
+#include <RetainedTable.h>
+#include <WarmRestart.h>
+#include <unity.h>
+
+#include <math.h>
+#include <string.h>
+
+static const uint32_t MAGIC = 0x4d524157;
+typedef RetainedTable<WarmState, WARM_RESTART_ENTRIES> Table;
+
+// What BleFingerprintCollection creates fingerprints with (ONE_EURO_*)
+static const float FCMIN = 1e-1f, BETA = 1e-3f, DCUTOFF = 5e-3f;
+
+static Table before, after;  // RTC memory as the old firmware left it, and as the new one finds it
+
+// A device walking from 6 m to 2 m and staying there, with noise and the odd reflection
+static float walk(int step) {
+    float d = step < 80 ? 6.0f - step * 0.05f : 2.0f;
+    d += 0.15f * sinf(step * 1.7f);
+    if (step % 23 == 0) d += 3.0f;
+    return d;
+}
+
+static void measure(FilteredDistance &filter, int step) {
+    filter.addMeasurement(walk(step));
+}
+
+void setUp() {
+    nativeMillis() = 1000;  // A filter reads micros() == 0 as never measured
+    memset(&before, 0x5a, sizeof(before));
+    memset(&after, 0, sizeof(after));
+}
+void tearDown() {}
+
+static void saveAndRestart(const FilteredDistance &filter) {
+    before.open();
+    auto &s = before.entries[0];
+    memset(&s, 0, sizeof(s));
+    strncpy(s.id, "apple:1005:9-26", sizeof(s.id) - 1);
+    s.dist = filter.getDistance();
+    s.filter = filter.save();
+    before.seal(MAGIC, 1);
+    memcpy(&after, &before, sizeof(after));
+}
+
+void test_restored_filter_tracks_the_original() {
+    FilteredDistance original(FCMIN, BETA, DCUTOFF);
+    int step = 0;
+    for (; step < 60; step++, nativeMillis() += 100) measure(original, step);
+
+    saveAndRestart(original);
+    TEST_ASSERT_TRUE(after.valid(MAGIC));
+    TEST_ASSERT_EQUAL(1, after.count);
+    TEST_ASSERT_EQUAL_STRING("apple:1005:9-26", after.entries[0].id);
+
+    FilteredDistance restored(FCMIN, BETA, DCUTOFF), cold(FCMIN, BETA, DCUTOFF);
+    restored.restore(after.entries[0].filter);
+    TEST_ASSERT_TRUE(restored.hasValue());
+    TEST_ASSERT_EQUAL_FLOAT(original.getDistance(), restored.getDistance());
+
+    float worst = 0, worstCold = 0;
+    for (int n = 0; n < 60; n++, step++) {
+        nativeMillis() += 100;
+        measure(original, step);
+        measure(restored, step);
+        measure(cold, step);
+        worst = fmaxf(worst, fabsf(restored.getDistance() - original.getDistance()));
+        worstCold = fmaxf(worstCold, fabsf(cold.getDistance() - original.getDistance()));
+    }
+    char message[96];
+    snprintf(message, sizeof(message), "largest gap after restore: %.3f m, starting cold: %.3f m", worst, worstCold);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN(0.1f, worst);
+    TEST_ASSERT_LESS_THAN(worstCold, worst);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, original.getDistance(), restored.getDistance());
+}
+
+void test_changed_filter_state_is_not_restored() {
+    FilteredDistance original(FCMIN, BETA, DCUTOFF);
+    for (int step = 0; step < 20; step++, nativeMillis() += 100) measure(original, step);
+    saveAndRestart(original);
+    after.entries[0].filter.mean += 0.5f;  // Memory changed across the reset
+    TEST_ASSERT_FALSE(after.valid(MAGIC));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_restored_filter_tracks_the_original);
+    RUN_TEST(test_changed_filter_state_is_not_restored);
+    return UNITY_END();
+}
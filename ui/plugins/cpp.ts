@@ -1,8 +1,8 @@
 import type { Plugin } from 'vite';
 import { resolve, dirname } from 'path';
+import { createHash } from 'crypto';
 import { promisify } from 'util';
 import fs from 'fs/promises';
-import { pascalCase } from 'change-case';
 import mime from 'mime';
 import type { OutputBundle } from 'rollup';
 import { gzip } from '@gfx/zopfli';
@@ -16,6 +16,7 @@ interface CompressedOutput {
   array: string;
   contentType: string;
   useCompression: boolean;
+  etag: string;
 }
 
 interface Asset {
@@ -27,6 +28,18 @@ interface Asset {
   isServer: boolean;
 }
 
+interface AssetRoute {
+  path: string;
+  immutable: boolean;
+}
+
+interface AssetEntry extends AssetRoute {
+  name: string;
+  contentType: string;
+  useCompression: boolean;
+  etag: string;
+}
+
 interface CompressStats {
   fileName: string;
   inputSize: number;
@@ -88,7 +101,9 @@ async function compressAsset(
     length: finalBuffer.length,
     array: hexdump(finalBuffer),
     contentType: contentType || mime.getType(fileName) || 'application/octet-stream',
-    useCompression
+    useCompression,
+    // Strong validator: the first 64 bits of a hash of exactly the bytes that get served
+    etag: createHash('sha256').update(finalBuffer).digest('hex').slice(0, 16)
   };
 }
 
@@ -113,42 +128,38 @@ function normalizeAssetPath(asset: Asset): string {
 }
 
 /**
- * Given an asset, returns one or more route strings.
+ * Given an asset, returns the one or more paths it is served at.
  */
-function generateRoutesForAsset(
-  asset: Asset,
-  basePath: string
-): { routes: string[]; htmlRoutes: string[] } {
-  const routes: string[] = [];
-  const htmlRoutes: string[] = [];
-  const assetName = pascalCase(asset.name);
+function generateRoutesForAsset(asset: Asset, basePath: string, immutablePrefix: string): AssetRoute[] {
+  const routes: AssetRoute[] = [];
   if (asset.type === 'html') {
     // For HTML, serve at both the base route and the file route (except for index.html).
     const routePath =
       asset.path === 'index.html'
         ? basePath + '/'
         : basePath + '/' + asset.path.slice(0, -5); // remove ".html"
-    htmlRoutes.push(`    server->on("${routePath}", HTTP_GET, serve${assetName});`);
+    routes.push({ path: routePath, immutable: false });
     if (routePath !== basePath + '/') {
-      htmlRoutes.push(`    server->on("${routePath}.html", HTTP_GET, serve${assetName});`);
+      routes.push({ path: `${routePath}.html`, immutable: false });
     }
   } else if (asset.path.includes('_app/immutable')) {
     // For immutable assets, use the exact route.
     const immutablePart = asset.path.split('_app/immutable/')[1];
     const routePath = `${basePath}/_app/immutable/${immutablePart}`;
-    routes.push(`    server->on("${routePath}", HTTP_GET, serve${assetName});`);
-    // If JS asset, add an alternative non-hashed route.
+    routes.push({ path: routePath, immutable: true });
+    // If JS asset, add an alternative non-hashed route, which must not be cached forever.
     if (asset.type === 'js') {
       const baseRoute = routePath.replace(/\.[A-Za-z0-9]+\.js$/, '.js');
       if (baseRoute !== routePath) {
-        routes.push(`    server->on("${baseRoute}", HTTP_GET, serve${assetName});`);
+        routes.push({ path: baseRoute, immutable: false });
       }
     }
   } else {
     // Default case for all other assets.
-    routes.push(`    server->on("${basePath}/${asset.path}", HTTP_GET, serve${assetName});`);
+    const routePath = `${basePath}/${asset.path}`;
+    routes.push({ path: routePath, immutable: routePath.startsWith(immutablePrefix) });
   }
-  return { routes, htmlRoutes };
+  return routes;
 }
 
 export function cppPlugin(options: CppPluginOptions = {}): Plugin {
@@ -334,8 +345,8 @@ export function cppPlugin(options: CppPluginOptions = {}): Plugin {
       // Prepare to generate headers.
       try {
         await fs.mkdir(outputDir, { recursive: true });
-        const routes: string[] = [];
-        const htmlRoutes: string[] = [];
+        const entries: AssetEntry[] = [];
+        const immutablePrefix = `${basePath}/${options.immutableDir || 'app/immutable'}/`;
         let totalInputSize = 0;
         let totalCompressedSize = 0;
 
@@ -346,7 +357,6 @@ export function cppPlugin(options: CppPluginOptions = {}): Plugin {
  */
 
 #pragma once
-#include <ESPAsyncWebServer.h>
 #include <Arduino.h>
 
 `;
@@ -368,18 +378,17 @@ export function cppPlugin(options: CppPluginOptions = {}): Plugin {
             header += `// ${asset.path}\n`;
             header += `const uint16_t ${compressed.name}_L = ${compressed.length};\n`;
             header += `const uint8_t ${compressed.name}[] PROGMEM = {\n${compressed.array}\n};\n\n`;
-            header += `inline void serve${pascalCase(asset.name)}(AsyncWebServerRequest* request) {\n`;
-            header += `  AsyncWebServerResponse *response = request->beginResponse_P(200, "${asset.contentType}", ${compressed.name}, ${compressed.name}_L);\n`;
-            if (compressed.useCompression) {
-              header += `  response->addHeader(F("Content-Encoding"), "gzip");\n`;
-            }
-            header += `  request->send(response);\n`;
-            header += `}\n\n`;
 
-            // Generate routes for this asset.
-            const { routes: assetRoutes, htmlRoutes: assetHtmlRoutes } = generateRoutesForAsset(asset, basePath);
-            routes.push(...assetRoutes);
-            htmlRoutes.push(...assetHtmlRoutes);
+            // Every path this asset is served at gets its own table entry pointing at the same data.
+            for (const route of generateRoutesForAsset(asset, basePath, immutablePrefix)) {
+              entries.push({
+                ...route,
+                name: compressed.name,
+                contentType: asset.contentType,
+                useCompression: compressed.useCompression,
+                etag: compressed.etag
+              });
+            }
           }
 
           // Write the group header.
@@ -425,6 +434,11 @@ export function cppPlugin(options: CppPluginOptions = {}): Plugin {
           const totalGroupBytes = groupStats.reduce((sum, stat) => sum + stat.compressedSize, 0);
           return ` * ${groupName}: ${totalGroupBytes.toLocaleString()} bytes`;
         });
+        // AssetHandler binary searches the table with strcmp, so sort by plain code unit order.
+        entries.sort((a, b) => (a.path < b.path ? -1 : a.path > b.path ? 1 : 0));
+        const table = entries.map(e =>
+          `    {"${e.path}", "${e.contentType}", ${e.name}, ${e.name}_L, ${e.useCompression}, ${e.immutable}, "\\"${e.etag}\\""},`
+        );
         const routesHeader = `/*
  * Web UI Routes
  *
@@ -436,12 +450,16 @@ ${groupSizeComments.join('\n')}
 #pragma once
 
 #include <ESPAsyncWebServer.h>
+#include "AssetHandler.h"
 ${Array.from(groupedAssets.keys()).map(group => `#include "${group}.h"`).join('\n')}
 
+// Sorted by path
+const Asset uiAssets[] = {
+${table.join('\n')}
+};
+
 inline void setupRoutes(AsyncWebServer* server) {
-${routes.join('\n')}
-    // HTML routes
-${htmlRoutes.join('\n')}
+    server->addHandler(new AssetHandler(uiAssets, sizeof(uiAssets) / sizeof(uiAssets[0])));
 }
 `;
         await fs.writeFile(resolve(outputDir, `${outPrefix}routes.h`), routesHeader);
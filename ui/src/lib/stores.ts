@@ -1,5 +1,5 @@
 import { readable, writable } from 'svelte/store';
-import type { ExtraSettings, Configs, Devices, WebSocketCommand, StartFunction, MainSettings } from './types';
+import type { ExtraSettings, Configs, Device, Devices, DevicesDelta, RawAdvert, WebSocketCommand, StartFunction, MainSettings } from './types';
 
 // Room name store that stops polling once room name is found
 export const roomName = readable<string>('', function start(set) {
@@ -83,36 +83,68 @@ export const configs = readable<Configs | null>({ room: '', configs: [] }, funct
     };
 });
 
+function wsUrl(path: string): string {
+    return `${location.origin.replace('http://', 'ws://').replace('https://', 'wss://')}${path}`;
+}
+
+// Follows the device table over the web socket: one snapshot, then batches of added/changed devices and removed serials
 export const devices = readable<Devices | null>({ room: '', devices: [] }, function start(set) {
     let errors = 0;
-    let outstanding = false;
-    const interval = setInterval(() => {
-        if (outstanding) return;
-        outstanding = true;
-        fetch("/json/devices?showAll")
-            .then(d => d.json())
-            .then((r: Devices) => {
-                outstanding = false;
-                errors = 0;
-                set(r);
-            })
-            .catch((ex) => {
-                outstanding = false;
-                if (errors++ > 5) set(null);
-                console.log(ex);
-            });
-    }, 1000);
+    let room = '';
+    let stopped = false;
+    let retry: ReturnType<typeof setTimeout> | undefined;
+    let sock: WebSocket | null = null;
+    const table = new Map<number, Device>();
+
+    function connect() {
+        sock = new WebSocket(wsUrl('/ws'));
+        sock.addEventListener('open', () => {
+            sock?.send(JSON.stringify({ subscribe: "devices", showAll: true }));
+        });
+        sock.addEventListener('message', (event: MessageEvent) => {
+            const msg: DevicesDelta = JSON.parse(event.data);
+            if (msg.type !== "snapshot" && msg.type !== "delta") return;
+            errors = 0;
+            if (msg.type === "snapshot") {
+                table.clear();
+                room = msg.room ?? room;
+            }
+            for (const d of msg.devices) if (d.serial !== undefined) table.set(d.serial, d);
+            for (const serial of msg.removed) table.delete(serial);
+            set({ room, devices: Array.from(table.values()) });
+        });
+        sock.addEventListener('close', () => {
+            if (stopped) return;
+            if (errors++ > 5) set(null);
+            retry = setTimeout(connect, 2000);
+        });
+    }
+    connect();
 
     return function stop() {
-        clearInterval(interval);
+        stopped = true;
+        clearTimeout(retry);
+        sock?.close();
     };
 });
 
+// Streams raw adverts whose mac or id starts with filter, every sample-th one; call the returned function to stop
+export function inspectAdverts(filter: string, sample: number, onAdvert: (advert: RawAdvert) => void): () => void {
+    const sock = new WebSocket(wsUrl('/ws/adverts'));
+    sock.addEventListener('open', () => {
+        sock.send(JSON.stringify({ filter, sample }));
+    });
+    sock.addEventListener('message', (event: MessageEvent) => {
+        onAdvert(JSON.parse(event.data));
+    });
+    return () => sock.close();
+}
+
 const initialValue: any = {};
 let socket: WebSocket | null = null;
 
 export const events = readable<any>(initialValue, function start(set) {
-    socket = new WebSocket(`${location.origin.replace('http://', 'ws://').replace('https://', 'wss://')}/ws`);
+    socket = new WebSocket(wsUrl('/ws'));
     socket.addEventListener('message', function (event: MessageEvent) {
         const parsedData = JSON.parse(event.data);
         console.log("Receive: " + event.data);
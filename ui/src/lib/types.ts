@@ -1,4 +1,5 @@
 export interface Device {
+    serial?: number;
     close: any;
     vis?: boolean;
     distance?: number;
@@ -34,6 +35,21 @@ export interface Devices {
     devices: Device[];
 }
 
+export interface DevicesDelta {
+    type: "snapshot" | "delta";
+    room?: string;
+    devices: Device[];
+    removed: number[];
+}
+
+// One advert from /ws/adverts, data is the raw advert and scan response payload in hex
+export interface RawAdvert {
+    mac: string;
+    rssi: number;
+    id: string;
+    data: string;
+}
+
 export interface LetterMap {
     [key: string]: {
         name: string;